@@ -0,0 +1,143 @@
+/**@file
+ *
+ * Bump-pointer memory arena.
+ */
+#ifndef support_Arena_hh
+#define support_Arena_hh 1
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+namespace spt
+{
+  /** Chunked bump-pointer allocator.  Allocation is a pointer
+   *  increment; memory is only released, all at once, when the arena
+   *  is reset or destroyed.
+   *
+   * Arena is not thread-safe; callers sharing one must serialize
+   * access to it.
+   */
+  class Arena
+  {
+  public:
+    /** Default size of each chunk, in bytes. */
+    static constexpr size_t default_chunk_size = 64 * 1024;
+
+    explicit inline Arena(size_t chunkSize = default_chunk_size)
+      : m_chunk ( NULL ),
+	m_next ( NULL ),
+	m_end ( NULL ),
+	m_chunkSize ( chunkSize ),
+	m_bytesAllocated ( 0 )
+    {
+    }
+
+    Arena(const Arena&) = delete;
+    Arena& operator = (const Arena&) = delete;
+
+    inline ~Arena()
+    {
+      while ( m_chunk )
+	{
+	  Chunk* prev ( m_chunk->prev );
+	  free(m_chunk);
+	  m_chunk = prev;
+	}
+    }
+
+    /** Allocate @p size bytes aligned to @p align (a power of two).
+     *
+     * @throws std::bad_alloc if memory is exhausted.
+     */
+    inline void*
+    allocate(size_t size, size_t align = alignof(std::max_align_t))
+    {
+      char* p ( align_up(m_next, align) );
+      if ( ! m_next || p + size > m_end )
+	{
+	  new_chunk(size + align);
+	  p = align_up(m_next, align);
+	}
+      m_next = p + size;
+      m_bytesAllocated += size;
+      return p;
+    }
+
+    /** Copy @p length characters from @p s into the arena, followed by
+     *	a terminating NUL.
+     */
+    inline char*
+    copy(const char* s, size_t length)
+    {
+      char* p ( static_cast<char*>(allocate(length + 1, 1)) );
+      memcpy(p, s, length);
+      p[length] = '\0';
+      return p;
+    }
+
+    /** Release everything allocated so far, keeping the memory for
+     *	reuse.  An arena that has grown past one chunk replaces them
+     *	with a single chunk as large as all of them together, so
+     *	repeating the same work after a reset allocates nothing.
+     */
+    inline void
+    reset()
+    {
+      if ( ! m_chunk )
+	return;
+      if ( m_chunk->prev )
+	{
+	  size_t total ( 0 );
+	  while ( m_chunk )
+	    {
+	      Chunk* prev ( m_chunk->prev );
+	      total += m_chunk->size - sizeof(Chunk);
+	      free(m_chunk);
+	      m_chunk = prev;
+	    }
+	  new_chunk(total);
+	}
+      m_next = reinterpret_cast<char*>(m_chunk + 1);
+      m_bytesAllocated = 0;
+    }
+
+    /** Total number of bytes handed out by allocate since construction
+     *	or the last reset.
+     */
+    inline size_t
+    bytesAllocated() const
+    {
+      return m_bytesAllocated;
+    }
+
+  private:
+    struct Chunk
+    {
+      Chunk* prev;
+
+      /** Size of the chunk, including this header. */
+      size_t size;
+    };
+
+    static inline char*
+    align_up(char* p, size_t align)
+    {
+      return reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(p) + align - 1) & ~(uintptr_t) (align - 1));
+    }
+
+    /** Start a chunk with room for at least @p minSize bytes. */
+    void
+    new_chunk(size_t minSize);
+
+    Chunk* m_chunk;
+    char* m_next;
+    char* m_end;
+    size_t m_chunkSize;
+    size_t m_bytesAllocated;
+  };
+}
+
+#endif	/* support_Arena_hh */
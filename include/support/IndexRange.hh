@@ -201,7 +201,7 @@ namespace spt
 #endif
 
 template < typename _index_type, _index_type _bad_index >
-inline std::basic_ostream<char>&
+std::basic_ostream<char>&
 operator << (std::basic_ostream<char>& os, const spt::IndexRange<_index_type, _bad_index>& r)
 {
 #ifdef SWIG
@@ -12,9 +12,67 @@
 #include <stdexcept>
 #include <stdint.h>
 #include <cstdlib>
+#include <sys/types.h>
+
+#include <support/support-config.h>
 
 namespace spt
 {
+  /** @name Reference-count primitives
+   *
+   * When the library is built with SPT_ATOMIC_REFCOUNT, these use
+   * atomic operations so that objects may be shared between threads:
+   * increments are relaxed, and the decrement that drops the count to
+   * zero synchronizes with every earlier release before the object is
+   * destroyed.  Otherwise they are plain integer operations.
+   *@{
+   */
+  /** Increment a reference count. */
+  inline void
+  refcount_increment(ssize_t& count)
+  {
+#ifdef SPT_ATOMIC_REFCOUNT
+    __atomic_fetch_add(&count, 1, __ATOMIC_RELAXED);
+#else
+    ++count;
+#endif
+  }
+
+  /** Read a reference count.  With atomic counts, a result of one
+   *  synchronizes with the releases of every other reference, so the
+   *  caller may then modify the object as its only owner.
+   */
+  inline ssize_t
+  refcount_load(const ssize_t& count)
+  {
+#ifdef SPT_ATOMIC_REFCOUNT
+    return __atomic_load_n(&count, __ATOMIC_ACQUIRE);
+#else
+    return count;
+#endif
+  }
+
+  /** Decrement a reference count.
+   *
+   * @return @c true if the count dropped to zero, i.e. the caller
+   * released the last reference.
+   */
+  inline bool
+  refcount_decrement(ssize_t& count)
+  {
+#ifdef SPT_ATOMIC_REFCOUNT
+    if ( __atomic_sub_fetch(&count, 1, __ATOMIC_RELEASE) == 0 )
+      {
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return true;
+      }
+    return false;
+#else
+    return --count == 0;
+#endif
+  }
+  /**@}*/
+
   /** Base class with reference counter, for use with intrusive pointer types.  Functions for
    *  use with boost::intrusive_ptr are included.
    *
@@ -36,10 +94,89 @@ namespace spt
      *
      * @throws runtime_error if object's reference count is non-zero.
      */
-    virtual ~RefCountedObject() throw ( std::runtime_error );
+    virtual ~RefCountedObject() noexcept(false);
 
     ssize_t refCount;
   };
+
+  /** Non-virtual reference-counted base class, for use with
+   *  boost::intrusive_ptr.
+   *
+   * Unlike RefCountedObject, this adds no vtable to the derived class:
+   * the last intrusive_ptr to be released deletes the object through a
+   * pointer to @p _Derived, so the destructor call is direct.  Use it
+   * for types that are never deleted through a pointer to a base
+   * class.
+   *
+   * @code
+   * struct Node : spt::RefCounted<Node> { ... };
+   * boost::intrusive_ptr<Node> n ( new Node() );
+   * @endcode
+   *
+   * @param _Derived The class deriving from RefCounted.
+   */
+  template < typename _Derived >
+  class RefCounted
+  {
+  public:
+    /** Get the current reference count.  A count of one means the
+     *	caller holds the only reference, and may modify the object.
+     */
+    inline ssize_t
+    use_count() const
+    {
+      return refcount_load(refCount);
+    }
+
+    friend inline void
+    intrusive_ptr_add_ref(const RefCounted* __rc)
+    {
+      refcount_increment(__rc->refCount);
+    }
+
+    friend void
+    intrusive_ptr_release(const RefCounted* __rc)
+    {
+      if ( refcount_decrement(__rc->refCount) )
+	_Derived::destroy(static_cast<const _Derived*>(__rc));
+    }
+
+  protected:
+    inline RefCounted()
+      : refCount ( 0 )
+    {
+    }
+
+    /** Copies start out unreferenced. */
+    inline RefCounted(const RefCounted&)
+      : refCount ( 0 )
+    {
+    }
+
+    inline RefCounted&
+    operator = (const RefCounted&)
+    {
+      return *this;
+    }
+
+    /** Non-virtual: instances are only deleted as @p _Derived. */
+    inline ~RefCounted()
+    {
+    }
+
+    /** Dispose of an instance whose last reference was released.
+     *	Derived classes that are not allocated with plain @c new hide
+     *	this with their own.
+     */
+    static inline void
+    destroy(const _Derived* __d)
+    {
+      delete __d;
+    }
+
+  private:
+    mutable ssize_t refCount;
+  };
 }
 
 /** Increments the reference count of a RefCountedObject.
@@ -50,7 +187,7 @@ namespace spt
 inline void
 intrusive_ptr_add_ref(spt::RefCountedObject* __rco)
 {
-  __rco->refCount++;
+  spt::refcount_increment(__rco->refCount);
 }
 
 /** Decrements the reference count of a RefCountedObject, and deletes the object if its
@@ -62,9 +199,7 @@ intrusive_ptr_add_ref(spt::RefCountedObject* __rco)
 inline void
 intrusive_ptr_release(spt::RefCountedObject* __rco)
 {
-  __rco->refCount--;
-
-  if ( __rco->refCount == 0 )
+  if ( spt::refcount_decrement(__rco->refCount) )
     delete __rco;
 }
 
@@ -0,0 +1,323 @@
+/**@file
+ *
+ * Rope: a String built from many pieces without copying them.
+ */
+#ifndef support_Rope_hh
+#define support_Rope_hh 1
+
+#include <cstddef>
+#include <vector>
+
+#include <support/RefCountedObject.hh>
+#include <support/String.hh>
+#include <support/StringBuilder.hh>
+
+namespace spt
+{
+  /** Immutable-tree representation of a long text.
+   *
+   * A Rope is a binary tree whose leaves are Strings; appending a
+   * String or another Rope adds a node rather than copying characters,
+   * and leaves share their data with the Strings they were built from.
+   * Subtrees are reference-counted and copied on write, so copying a
+   * Rope is O(1) and ropes may share structure.
+   *
+   * Appending keeps the tree balanced, and short pieces appended one
+   * after another are coalesced into a single leaf; concatenating
+   * ropes can unbalance it, so the tree is rebuilt whenever its depth
+   * passes max_depth.  flatten() produces the text as one String (with
+   * a single allocation) and keeps it as the rope's only leaf.
+   */
+  class Rope
+  {
+  public:
+    typedef String::element_type element_type;
+    typedef String::size_type size_type;
+
+    /** Appended pieces are merged into the preceding leaf while the
+     *	merged leaf is no longer than this.
+     */
+    static constexpr size_type short_leaf_length = 256;
+
+    /** Depth past which the tree is rebalanced. */
+    static constexpr unsigned int max_depth = 48;
+
+    inline Rope()
+      : m_root ( )
+    {
+    }
+
+    inline Rope(const String& s)
+      : m_root ( s.length() > 0 ? new Node(s) : NULL )
+    {
+    }
+
+    inline Rope(const element_type* s)
+      : Rope ( String::copy_of(s) )
+    {
+    }
+
+    inline size_type
+    length() const
+    {
+      return m_root ? m_root->length : 0;
+    }
+
+    inline bool
+    empty() const
+    {
+      return ! m_root;
+    }
+
+    /** Depth of the tree; zero for an empty or flat rope. */
+    inline unsigned int
+    depth() const
+    {
+      return m_root ? m_root->depth : 0;
+    }
+
+    /** Character at position @p i, in O(depth) time.
+     *
+     * @pre <code>i &lt; length()</code>
+     */
+    inline element_type
+    operator [] (size_type i) const
+    {
+      const Node* n ( m_root.get() );
+      while ( n->left )
+	{
+	  if ( i < n->left->length )
+	    n = n->left.get();
+	  else
+	    {
+	      i -= n->left->length;
+	      n = n->right.get();
+	    }
+	}
+      return n->leaf.data()[i];
+    }
+
+    Rope&
+    append(const String& s)
+    {
+      if ( s.length() == 0 )
+	return *this;
+      if ( ! m_root )
+	{
+	  m_root = new Node(s);
+	  return *this;
+	}
+
+      if ( ! merge_last(s) )
+	m_root = append_leaf(m_root, s);
+
+      if ( m_root->depth > max_depth )
+	rebalance();
+      return *this;
+    }
+
+    inline Rope&
+    append(const element_type* s)
+    {
+      return append(String::copy_of(s));
+    }
+
+    Rope&
+    append(const Rope& r)
+    {
+      if ( ! r.m_root )
+	return *this;
+      m_root = m_root ? concat(m_root, r.m_root) : r.m_root;
+      if ( m_root->depth > max_depth )
+	rebalance();
+      return *this;
+    }
+
+    template < typename _Tp >
+    inline Rope&
+    operator += (const _Tp& v)
+    {
+      return append(v);
+    }
+
+    template < typename _Tp >
+    Rope
+    operator + (const _Tp& v) const
+    {
+      Rope out ( *this );
+      out.append(v);
+      return out;
+    }
+
+    /** Call @p fn on each leaf String, in order. */
+    template < typename _Fn >
+    inline void
+    for_each_piece(_Fn fn) const
+    {
+      if ( m_root )
+	visit(m_root.get(), fn);
+    }
+
+    /** Get the rope's text as a single String.  The result replaces
+     *	the tree, so later calls (and operator[]) are O(1).  This
+     *	modifies the rope, so (unlike the const members) it must not be
+     *	called on a Rope that other threads are reading.
+     */
+    String
+    flatten()
+    {
+      if ( ! m_root )
+	return String();
+      if ( m_root->left )
+	{
+	  StringBuilder b ( m_root->length );
+	  for_each_piece([&b](const String& s) { b.append(s); });
+	  m_root = new Node(b.str());
+	}
+      return m_root->leaf;
+    }
+
+  private:
+    struct Node
+      : RefCounted<Node>
+    {
+      typedef boost::intrusive_ptr<Node> reference_type;
+
+      explicit inline Node(const String& s)
+	: leaf ( s ),
+	  left ( ),
+	  right ( ),
+	  length ( s.length() ),
+	  depth ( 0 )
+      {
+      }
+
+      inline Node(const reference_type& l, const reference_type& r)
+	: leaf ( ),
+	  left ( l ),
+	  right ( r ),
+	  length ( l->length + r->length ),
+	  depth ( 1 + ( l->depth > r->depth ? l->depth : r->depth ) )
+      {
+      }
+
+      /** Text of a leaf node; empty for interior nodes. */
+      String leaf;
+
+      /** Children of an interior node; both are @c NULL for leaves. */
+      reference_type left;
+      reference_type right;
+
+      size_type length;
+      unsigned int depth;
+    };
+    typedef Node::reference_type NodeRef;
+
+    static NodeRef
+    concat(const NodeRef& l, const NodeRef& r)
+    {
+      return new Node(l, r);
+    }
+
+    template < typename _Fn >
+    static void
+    visit(const Node* n, _Fn& fn)
+    {
+      while ( n->left )
+	{
+	  visit(n->left.get(), fn);
+	  n = n->right.get();
+	}
+      fn(n->leaf);
+    }
+
+    /** Append @p s to the rightmost leaf in place, if this rope owns
+     *	the whole path to it and the leaf is short enough.
+     *
+     * @return @c false, leaving the rope unchanged, otherwise.
+     */
+    bool
+    merge_last(const String& s)
+    {
+      Node* n ( m_root.get() );
+      for ( ; n->left; n = n->right.get() )
+	if ( n->use_count() != 1 )
+	  return false;
+      if ( n->use_count() != 1 || n->length + s.length() > short_leaf_length )
+	return false;
+
+      n->leaf += s;
+      for ( n = m_root.get(); n->left; n = n->right.get() )
+	n->length += s.length();
+      n->length += s.length();
+      return true;
+    }
+
+    /** Append @p s below @p n.  Nodes shared with other ropes are
+     *	copied (along the path to the rightmost leaf only), while nodes
+     *	this rope owns alone are updated in place.  Descending into the
+     *	right subtree while it is shallower than the left one fills the
+     *	tree like a binary counter, so a rope built by appending stays
+     *	O(log n) deep.
+     */
+    static NodeRef
+    append_leaf(const NodeRef& n, const String& s)
+    {
+      bool unique ( n->use_count() == 1 );
+      if ( ! n->left )
+	{
+	  if ( n->length + s.length() > short_leaf_length )
+	    return concat(n, new Node(s));
+	  else if ( ! unique )
+	    return new Node(n->leaf + s);
+
+	  n->leaf += s;
+	  n->length += s.length();
+	  return n;
+	}
+      else if ( n->right->depth >= n->left->depth )
+	return concat(n, new Node(s));
+      else if ( ! unique )
+	return concat(n->left, append_leaf(n->right, s));
+
+      n->right = append_leaf(n->right, s);
+      n->length += s.length();
+      n->depth = 1 + ( n->left->depth > n->right->depth ? n->left->depth : n->right->depth );
+      return n;
+    }
+
+    /** Rebuild a balanced tree over [@p first, @p last) leaves. */
+    static NodeRef
+    build(const std::vector<const Node*>& leaves, size_t first, size_t last)
+    {
+      if ( last - first == 1 )
+	return const_cast<Node*>(leaves[first]);
+      size_t mid ( first + ( last - first ) / 2 );
+      return concat(build(leaves, first, mid), build(leaves, mid, last));
+    }
+
+    void
+    rebalance()
+    {
+      std::vector<const Node*> leaves;
+      collect(m_root.get(), leaves);
+      m_root = build(leaves, 0, leaves.size());
+    }
+
+    static void
+    collect(const Node* n, std::vector<const Node*>& leaves)
+    {
+      while ( n->left )
+	{
+	  collect(n->left.get(), leaves);
+	  n = n->right.get();
+	}
+      leaves.push_back(n);
+    }
+
+    /** Root of the tree; @c NULL for an empty rope. */
+    NodeRef m_root;
+  };
+}
+
+#endif	/* support_Rope_hh */
@@ -6,11 +6,14 @@
 #include <cstdlib>
 #include <cstring>
 #include <algorithm>
+#include <functional>
+#include <iterator>
 #include <stdexcept>
 
 #include <support/support-config.h>
 #include <support/IndexRange.hh>
 #include <support/StringData.hh>
+#include <support/StringSearch.hh>
 
 #ifdef SPT_STRING_USE_REFCOUNTED_OBJECT
   #include <support/RefCountedObject.hh>
@@ -22,6 +25,7 @@
 namespace spt
 {
   class String;
+  class StringInternTable;
 }
 
 /**  Shift-append operator for output of a String to an STL stream.
@@ -34,6 +38,15 @@ namespace spt
 {
   /** Range-defined string view type.  String allows multiple views on
    *  the same data.
+   *
+   * Strings of up to String::inline_capacity characters created by
+   * copying (from a <code>const char*</code>, copy_of, concatenation,
+   * etc.) are stored inline in the String object itself, and need no
+   * StringData or reference count; copying such a String copies its
+   * characters.  Longer strings, and strings wrapping caller-owned
+   * buffers (take_ownership, StringData references), share a
+   * StringData as before.  Ranges, substrings and the other view
+   * operations behave the same for both representations.
    */
   class String
 #ifdef SPT_STRING_USE_REFCOUNTED_OBJECT
@@ -52,12 +65,280 @@ namespace spt
     /** a la std::string::npos */
     static constexpr size_type npos = static_cast<size_type>(-1);
 
+    /** Maximum length of a string stored inline in the String
+     *  object.  Chosen so that sizeof(String) is 48 on LP64 targets.
+     */
+    static constexpr size_type inline_capacity = 22;
+
     typedef IndexRange<size_type, npos> range_type;
 
+    /** @name Tokenization
+     *
+     * split, split_any and lines return lazy ranges of Tokens: views of
+     * consecutive pieces of a String that are found (with the
+     * vectorized search kernels) as the range is iterated.  Tokens do
+     * not touch the reference count; call Token::string to get a
+     * String that shares the original data.
+     *
+     * @code
+     * for ( const spt::String::Token& field : line.split(',') )
+     *   if ( field == "ERROR" ) ...
+     * @endcode
+     *
+     * @warning A range and its Tokens refer to the String (and, for
+     *   split_any, to the delimiter set) they were created from, which
+     *   must outlive them and must not be modified while they are in
+     *   use.
+     *@{
+     */
+    /** Lightweight, non-owning view of part of a String. */
+    class Token
+    {
+    public:
+      inline Token()
+	: m_parent ( NULL ),
+	  m_data ( NULL ),
+	  m_length ( 0 )
+      {
+      }
+
+      inline Token(const String* parent, const element_type* data, size_type length)
+	: m_parent ( parent ),
+	  m_data ( data ),
+	  m_length ( length )
+      {
+      }
+
+      inline const element_type*
+      data() const { return m_data; }
+
+      inline size_type
+      length() const { return m_length; }
+
+      inline bool
+      empty() const { return m_length == 0; }
+
+      /** Unchecked element access. */
+      inline element_type
+      operator [] (size_type __index) const
+      {  return m_data[__index];  }
+
+      /** Range of this token within the String it was split from. */
+      inline range_type
+      range() const
+      {
+	size_type start ( static_cast<size_type>(m_data - m_parent->data()) );
+	return range_type(start, start + m_length);
+      }
+
+      /** Get this token as a substring of the String it was split
+       *  from.
+       */
+      inline String
+      string() const
+      {
+	return m_parent->substring(range());
+      }
+
+      inline bool
+      operator == (const char* s) const
+      {
+	return s && 0 == strncmp(m_data, s, m_length) && s[m_length] == '\0';
+      }
+
+      inline bool
+      operator == (const Token& t) const
+      {
+	return m_length == t.m_length && ( m_data == t.m_data || 0 == memcmp(m_data, t.m_data, m_length) );
+      }
+
+      template < typename _Tp >
+      inline bool
+      operator != (_Tp s) const
+      {
+	return ! operator ==(s);
+      }
+
+    private:
+      const String* m_parent;
+      const element_type* m_data;
+      size_type m_length;
+    };
+
+    /** Forward iterator over the Tokens of a split. */
+    class SplitIterator
+    {
+    public:
+      typedef std::forward_iterator_tag iterator_category;
+      typedef Token value_type;
+      typedef ptrdiff_t difference_type;
+      typedef const Token* pointer;
+      typedef const Token& reference;
+
+      /** How delimiters are interpreted. */
+      enum Mode
+	{
+	  /** Every occurrence of one character ends a token. */
+	  CHAR,
+
+	  /** Runs of characters from a set separate tokens; no token is
+	   *  empty.
+	   */
+	  ANY,
+
+	  /** Lines ending in "\n" or "\r\n". */
+	  LINES
+	};
+
+      /** End-of-range iterator. */
+      inline SplitIterator()
+	: m_parent ( NULL ),
+	  m_next ( NULL ),
+	  m_end ( NULL ),
+	  m_set ( NULL ),
+	  m_setLength ( 0 ),
+	  m_delim ( '\0' ),
+	  m_mode ( CHAR ),
+	  m_atEnd ( true )
+      {
+      }
+
+      inline SplitIterator(const String* parent, Mode mode, element_type delim,
+			   const element_type* set = NULL, size_type setLength = 0)
+	: m_parent ( parent ),
+	  m_next ( parent->data() ),
+	  m_end ( parent->data() + parent->length() ),
+	  m_set ( set ),
+	  m_setLength ( setLength ),
+	  m_delim ( delim ),
+	  m_mode ( mode ),
+	  m_atEnd ( false )
+      {
+	if ( ! m_next || m_next == m_end )
+	  m_atEnd = true;	/* empty strings have no tokens */
+	else
+	  advance();
+      }
+
+      inline reference
+      operator * () const { return m_token; }
+
+      inline pointer
+      operator -> () const { return &m_token; }
+
+      inline SplitIterator&
+      operator ++ ()
+      {
+	advance();
+	return *this;
+      }
+
+      inline SplitIterator
+      operator ++ (int)
+      {
+	SplitIterator out ( *this );
+	advance();
+	return out;
+      }
+
+      inline bool
+      operator == (const SplitIterator& o) const
+      {
+	return m_atEnd == o.m_atEnd && ( m_atEnd || m_token.data() == o.m_token.data() );
+      }
+
+      inline bool
+      operator != (const SplitIterator& o) const
+      {
+	return ! operator ==(o);
+      }
+
+    private:
+      /** Find the token starting at m_next, or mark the iterator as
+       *	finished.  m_next is @c NULL once the last token is found.
+       */
+      void
+      advance()
+      {
+	if ( ! m_next )
+	  {
+	    m_atEnd = true;
+	    return;
+	  }
+
+	const element_type *start ( m_next ), *delim ( NULL );
+	size_type length;
+
+	switch ( m_mode )
+	  {
+	  case ANY:
+	    /* Usually a single delimiter separates tokens; only search
+	       for the end of a run when there is one. */
+	    if ( m_next == m_end || memchr(m_set, *m_next, m_setLength) )
+	      start = spt::find_first_of(m_next, static_cast<size_type>(m_end - m_next), m_set, m_setLength, true);
+	    if ( ! start )
+	      {
+		m_atEnd = true;
+		return;
+	      }
+	    delim = spt::find_first_of(start, static_cast<size_type>(m_end - start), m_set, m_setLength);
+	    break;
+
+	  case LINES:
+	    if ( start == m_end )
+	      {
+		m_atEnd = true;
+		return;
+	      }
+	    /* fall through */
+	  case CHAR:
+	    delim = spt::find_byte(start, static_cast<size_type>(m_end - start), m_delim);
+	    break;
+	  }
+
+	length = static_cast<size_type>(( delim ? delim : m_end ) - start);
+	if ( m_mode == LINES && length > 0 && start[length - 1] == '\r' )
+	  --length;
+
+	m_token = Token(m_parent, start, length);
+	m_next = delim ? delim + 1 : NULL;
+      }
+
+      const String* m_parent;
+      const element_type* m_next;
+      const element_type* m_end;
+      const element_type* m_set;
+      size_type m_setLength;
+      element_type m_delim;
+      Mode m_mode;
+      bool m_atEnd;
+      Token m_token;
+    };
+
+    /** Range of Tokens, for use with range-based @c for. */
+    class SplitRange
+    {
+    public:
+      explicit inline SplitRange(const SplitIterator& first)
+	: m_begin ( first )
+      {
+      }
+
+      inline SplitIterator
+      begin() const { return m_begin; }
+
+      inline SplitIterator
+      end() const { return SplitIterator(); }
+
+    private:
+      SplitIterator m_begin;
+    };
+    /**@}*/
+
     /**@name Copy/conversion utilities
      *@{
      */
-    static inline String
+    static String
     take_ownership(element_type* str, size_type len = npos, data_type::FreeFunction _ff = &free)
     {
       if ( str )
@@ -69,7 +350,7 @@ namespace spt
       return String();
     }
 
-    static inline String
+    static String
     copy_of(const element_type* str, size_type len = npos)
     {
       if ( str )
@@ -88,6 +369,24 @@ namespace spt
 	}
       return String();
     }
+
+    /** Get the contents of the file at @p path without copying them.
+     *
+     * Regular files are mapped into memory privately, so the pages are
+     * read on demand and the file is never modified; writing through
+     * data() copies only the pages written, and growing the String
+     * copies it to the heap.  The mapping is removed when the last
+     * String referring to it is destroyed.  Other files (and "-", for
+     * standard input) are read into a heap buffer instead.
+     *
+     * @return The file's contents, or an empty String if the file is
+     * empty.
+     *
+     * @throws std::system_error if the file cannot be opened, examined,
+     * mapped or read.
+     */
+    static String
+    map_file(const char* path);
     /**@}*/
 
 
@@ -97,7 +396,8 @@ namespace spt
       RefCountedObject ( ),
 #endif
       m_sdata ( NULL ),
-      m_range ( 0, 0 )
+      m_range ( 0, 0 ),
+      m_inlineSize ( 0 )
     {
     }
 
@@ -107,7 +407,8 @@ namespace spt
       RefCountedObject ( ),
 #endif
       m_sdata ( data.capacity > 0 ? new data_type(std::move(data)) : NULL ),
-      m_range ( 0, data.capacity )
+      m_range ( 0, data.capacity ),
+      m_inlineSize ( 0 )
     {
     }
 
@@ -118,7 +419,8 @@ namespace spt
       RefCountedObject ( ),
 #endif
       m_sdata ( sdata ),
-      m_range ( 0, sdata->capacity )
+      m_range ( 0, sdata->capacity ),
+      m_inlineSize ( 0 )
     {
     }
 
@@ -129,7 +431,8 @@ namespace spt
       RefCountedObject ( ),
 #endif
       m_sdata ( sdata ),
-      m_range ( range )
+      m_range ( range ),
+      m_inlineSize ( 0 )
     {
     }
 
@@ -140,7 +443,8 @@ namespace spt
       RefCountedObject ( ),
 #endif
       m_sdata ( range.length() > 0 ? new data_type(std::move(sdata)) : NULL),
-      m_range ( std::move(range) )
+      m_range ( std::move(range) ),
+      m_inlineSize ( 0 )
     {
     }
 
@@ -150,55 +454,80 @@ namespace spt
 #ifdef SPT_STRING_USE_REFCOUNTED_OBJECT
       RefCountedObject ( ),
 #endif
-      m_sdata ( length > 0 && s != NULL ? new data_type(s, length) : NULL),
-      m_range ( 0, length )
+      m_sdata ( length > inline_capacity && s != NULL ? new data_type(s, length) : NULL),
+      m_range ( 0, s != NULL ? length : 0 ),
+      m_inlineSize ( 0 )
     {
+      if ( ! m_sdata && m_range.length() > 0 )
+	initInline(s, length);
     }
 
-    inline String(const String& source)
+    String(const String& source)
       :
 #ifdef SPT_STRING_USE_REFCOUNTED_OBJECT
       RefCountedObject ( ),
 #endif
       m_sdata ( source.m_sdata ),
-      m_range ( source.m_range )
+      m_range ( source.m_range ),
+      m_inlineSize ( source.m_inlineSize )
     {
+      copyInline(source);
     }
 
-    inline String(const String& source, const range_type& range)
+    String(const String& source, const range_type& range)
       :
 #ifdef SPT_STRING_USE_REFCOUNTED_OBJECT
       RefCountedObject ( ),
 #endif
       m_sdata ( source.m_sdata ),
-      m_range ( source.m_range.startIndex + range.startIndex, source.m_range.startIndex + range.endIndex )
+      m_range ( source.m_range.startIndex + range.startIndex, source.m_range.startIndex + range.endIndex ),
+      m_inlineSize ( source.m_inlineSize )
     {
       source.assert_in_range(range);
+      copyInline(source);
     }
 
-    /** Read-only constructor. Does not free, copies on write.
+    /** Read-only constructor.  Short strings are copied inline;
+     *  longer ones are referenced without copying, and copied on
+     *  write.
      */
-    inline String(const char* s)
+    String(const char* s)
       :
 #ifdef SPT_STRING_USE_REFCOUNTED_OBJECT
       RefCountedObject ( ),
 #endif
-      m_sdata ( s ? new data_type(s) : NULL),
-      m_range ( 0, s ? m_sdata->capacity : 0 )
+      m_sdata ( NULL ),
+      m_range ( 0, 0 ),
+      m_inlineSize ( 0 )
     {
+      if ( s )
+	{
+	  /* Only scan as far as needed to pick a representation. */
+	  size_type len ( strnlen(s, inline_capacity + 1) );
+	  if ( len <= inline_capacity )
+	    {
+	      if ( len > 0 )
+		initInline(s, len);
+	    }
+	  else
+	    m_sdata = new data_type(s);
+	  m_range.endIndex = m_sdata ? m_sdata->capacity : len;
+	}
     }
 
     /** Move constructor.  This initializes the string using an r-value reference.
      */
-    inline String(String&& s)
+    String(String&& s)
       :
 #ifdef SPT_STRING_USE_REFCOUNTED_OBJECT
       RefCountedObject ( ),
 #endif
       m_sdata ( std::move(s.m_sdata) ),
-      m_range ( std::move(s.m_range) )
+      m_range ( std::move(s.m_range) ),
+      m_inlineSize ( s.m_inlineSize )
     {
       s.m_sdata.reset();
+      copyInline(s);
     }
 
 
@@ -208,27 +537,35 @@ namespace spt
 #ifdef SPT_STRING_USE_REFCOUNTED_OBJECT
       RefCountedObject ( ),
 #endif
-      m_sdata ( count > 0 ? new data_type(count + 1) : NULL ),
-      m_range ( 0, count )
+      m_sdata ( count > inline_capacity ? new data_type(count + 1) : NULL ),
+      m_range ( 0, count ),
+      m_inlineSize ( m_sdata ? 0 : static_cast<unsigned char>(count) )
     {
-      memset(m_sdata->data, c, count);
-      m_sdata->data[count] = '\0';
+      if ( count > 0 )
+	{
+	  element_type* p ( count > inline_capacity ? m_sdata->data : m_inline );
+	  memset(p, c, count);
+	  p[count] = '\0';
+	}
     }
 
     /** empty, with space for @p capacity characters (not including terminating null)  */
-    explicit inline String(size_type capacity)
+    explicit String(size_type capacity)
       :
 #ifdef SPT_STRING_USE_REFCOUNTED_OBJECT
       RefCountedObject ( ),
 #endif
-      m_sdata ( capacity > 0 ? new data_type(capacity) : NULL ),
-      m_range ( 0, capacity )
+      m_sdata ( capacity > inline_capacity ? new data_type(capacity) : NULL ),
+      m_range ( 0, capacity ),
+      m_inlineSize ( m_sdata ? 0 : static_cast<unsigned char>(capacity) )
     {
+      if ( m_inlineSize )
+	memset(m_inline, 0, sizeof(m_inline));
     }
 
     inline ~String()
 #ifdef SPT_STRING_USE_REFCOUNTED_OBJECT
-    throw ( std::runtime_error )
+    noexcept(false)
 #endif
     {
     }
@@ -239,6 +576,7 @@ namespace spt
       return m_range.length();
     }
 
+    /** Count non-overlapping occurrences of a substring. */
     inline size_type
     count(const_needle_type needle, size_t needleLength = npos) const
     {
@@ -246,16 +584,15 @@ namespace spt
 	needleLength = strlen(needle);
       size_t numFound ( 0 );
 
-      if ( needleLength )
+      if ( needleLength && data() )
 	{
-	  const_needle_type found ( static_cast<const_needle_type>(memmem(data(), length(), needle, needleLength)) );
-	  const element_type* end ( data() + length() );
-	  while ( found )
+	  const element_type
+	    * cur ( data() ),
+	    * end ( cur + length() );
+	  while ( ( cur = spt::find_substring(cur, static_cast<size_type>(end - cur), needle, needleLength) ) )
 	    {
 	      ++numFound;
-	      found = static_cast<const_needle_type>((found + needleLength) < end
-						     ? memmem(found + needleLength, end - found + needleLength, needle, needleLength)
-						     : NULL);
+	      cur += needleLength;
 	    }
 	}
       return numFound;
@@ -264,31 +601,25 @@ namespace spt
     inline size_type
     count(element_type elem) const
     {
-      size_type out ( 0 );
-
-      if ( data() && length() )
-	{
-	  const element_type* end ( data() + length() );
-	  for ( const element_type* cur ( data() ); cur < end; ++cur )
-	    {
-	      if ( *cur == elem )
-		++out;
-	    }
-	}
-
-      return out;
+      return data() ? spt::count_byte(data(), length(), elem) : 0;
     }
 
     inline size_type
     find_element(element_type elem, size_type startIndex, size_type endIndex = npos) const
     {
-      return find_first_of(&elem, range_type(startIndex, endIndex));
+      return find_element(elem, range_type(startIndex, endIndex));
     }
 
+    /** Find the first occurrence of @p elem within @p range (by
+     *	default, the whole string).
+     */
     inline size_type
     find_element(element_type elem, range_type range = range_type(npos, npos)) const
     {
-      return find_first_of(&elem, range);
+      if ( ! data() )
+	return npos;
+      normalize_range(range);
+      return to_index(spt::find_byte(data() + range.startIndex, range.length(), elem));
     }
 
     inline size_type
@@ -297,20 +628,16 @@ namespace spt
       return find_first_of(set, range_type(startIndex, endIndex));
     }
 
+    /** Find the first character within @p range (by default, the
+     *	whole string) that is in the NUL-terminated @p set.
+     */
     inline size_type
     find_first_of(const_needle_type set, range_type range = range_type(npos, npos)) const
     {
-      if ( data() )
-	{
-	  if ( range.startIndex == npos )
-	    range.startIndex = 0;
-	  if ( range.endIndex == npos )
-	    range = length();
-	  size_type p ( strcspn(m_sdata->data + m_range.startIndex, set) );
-	  return p != length() && p >= range.startIndex && p < range.endIndex ? p : npos;
-	}
-      else
+      if ( ! data() )
 	return npos;
+      normalize_range(range);
+      return to_index(spt::find_first_of(data() + range.startIndex, range.length(), set, strlen(set)));
     }
 
     /* inline reference_type
@@ -324,15 +651,53 @@ namespace spt
     inline const element_type*
     data() const
     {
-      return m_sdata ? m_sdata->data + m_range.startIndex : NULL;
+      return m_sdata ? m_sdata->data + m_range.startIndex
+	: ( m_inlineSize ? m_inline + m_range.startIndex : NULL );
     }
 
-    /** Get a pointer to this string's first character.
+    /** Get a pointer to this string's first character.  The caller
+     *	may write through it, so a buffer shared with other Strings (or
+     *	interned) is first replaced with a private copy of the range,
+     *	and any cached hash is discarded.  Use the @c const overload to
+     *	read a shared String without copying it.
      */
-    inline element_type*
+    element_type*
     data()
     {
-      return m_sdata ? m_sdata->data + m_range.startIndex : NULL;
+      if ( m_sdata )
+	{
+	  if ( ! isSoleOwner() || m_sdata->internTable )
+	    detach();
+	  else
+	    m_sdata->invalidateHash();
+	}
+      return m_sdata ? m_sdata->data + m_range.startIndex
+	: ( m_inlineSize ? m_inline + m_range.startIndex : NULL );
+    }
+
+    /** Check if this string's characters are stored inline.  */
+    inline bool
+    isInline() const
+    {
+      return m_inlineSize != 0;
+    }
+
+    /** Check if this is a canonical String returned by
+     *	StringInternTable::intern (and not a substring of one).
+     */
+    inline bool
+    isInterned() const
+    {
+      return m_sdata && m_sdata->internTable
+	&& m_range.startIndex == 0 && m_range.endIndex == m_sdata->capacity;
+    }
+
+    /** Check if this is the canonical String for its value in @p table.
+     */
+    bool
+    isInternedIn(const StringInternTable& table) const
+    {
+      return isInterned() && m_sdata->internTable == &table;
     }
 
     inline String
@@ -373,17 +738,25 @@ namespace spt
       return trim(trimSet, trimSet);
     }
 
-    inline String
+    String
     trim(const char* trimSetS, const char* trimSetE) const
     {
       String::range_type outRange ( 0, length() );
 
-      if ( trimSetS )
-	while ( outRange.startIndex < outRange.endIndex && std::strchr(trimSetS, (*this)[outRange.startIndex]) )
-	  ++outRange.startIndex;
-      if ( trimSetE )
-	while ( outRange.endIndex > outRange.startIndex && std::strchr(trimSetE, (*this)[outRange.endIndex - 1]) )
-	  --outRange.endIndex;
+      if ( data() )
+	{
+	  if ( trimSetS )
+	    {
+	      const element_type* p ( spt::find_first_of(data(), length(), trimSetS, strlen(trimSetS), true) );
+	      outRange.startIndex = p ? to_index(p) : length();
+	    }
+	  if ( trimSetE )
+	    {
+	      const element_type* p ( spt::find_last_of(data() + outRange.startIndex, outRange.length(),
+							trimSetE, strlen(trimSetE), true) );
+	      outRange.endIndex = p ? to_index(p) + 1 : outRange.startIndex;
+	    }
+	}
 
       return substring(outRange);
     }
@@ -407,28 +780,16 @@ namespace spt
       return substring(range_type(startIndex, endIndex));
     }
 
-    inline size_type
+    /** Find the first occurrence of @p __sLength characters at @p __s
+     *	lying entirely within @p range (by default, the whole string).
+     */
+    size_type
     find(const_needle_type __s, size_type __sLength, range_type range = range_type(npos, npos)) const
     {
-      if ( data() )
-	{
-	  if ( range.startIndex == npos )
-	    {
-	      range.startIndex = 0;
-	      range.endIndex = length();
-	    }
-	  assert_in_range(range);
-	  element_type* p ( static_cast<element_type*>(memmem(m_sdata->data + m_range.startIndex + range.startIndex,
-							      m_sdata->capacity - m_range.startIndex - range.startIndex,
-							      __s, __sLength)) );
-	  return p != NULL
-	    ? ( p - m_sdata->data - static_cast<signed long int>(m_range.startIndex) < static_cast<ptrdiff_t>(range.endIndex)
-		? p - m_sdata->data - m_range.startIndex
-		: npos )
-	    : npos;
-	}
-      else
+      if ( ! data() )
 	return npos;
+      normalize_range(range);
+      return to_index(spt::find_substring(data() + range.startIndex, range.length(), __s, __sLength));
     }
 
     inline size_type
@@ -437,35 +798,17 @@ namespace spt
       return find(__s, strlen(__s), range);
     }
 
-    inline size_type
+    size_type
     find(element_type __s) const
     {
-      if ( data() && length() )
-	{
-	  const element_type
-	    * cur ( data() ),
-	    * end ( cur + length() );
-	  for ( ; cur < end; ++cur )
-	    if ( *cur == __s )
-	      return cur - data();
-	}
-      return npos;
+      return data() ? to_index(spt::find_byte(data(), length(), __s)) : npos;
     }
 
 
     inline size_type
     rfind(element_type __s) const
     {
-      if ( data() && length() )
-	{
-	  const element_type
-	    * begin ( data() ),
-	    * cur ( begin + length() );
-	  for ( ; cur >= begin; --cur )
-	    if ( *cur == __s )
-	      return cur - begin;
-	}
-      return npos;
+      return data() ? to_index(spt::rfind_byte(data(), length(), __s)) : npos;
     }
 
 
@@ -474,7 +817,7 @@ namespace spt
     {
       if ( data() )
 	{
-	  const element_type* __data = m_sdata->data + m_range.startIndex;
+	  const element_type* __data = data();
 	  size_type __size = this->length();
 
 	  if ( __n == npos )
@@ -506,7 +849,7 @@ namespace spt
     /** Ensure that the given range, relative to the current string's
      *    range, is within bounds.
      */
-    inline void
+    void
     assert_in_range(const range_type& r) const
     {
       if ( r.length() > length() )
@@ -525,9 +868,9 @@ namespace spt
     inline element_type
     at(size_type __index) const
     {
-      if ( ! data() || __index >= m_range.length() || __index + m_range.startIndex >= m_sdata->capacity )
+      if ( ! data() || __index >= m_range.length() || __index + m_range.startIndex >= bufferCapacity() )
 	throw std::out_of_range("Element at __index is not in valid window");
-      return m_sdata->data[__index + m_range.startIndex];
+      return data()[__index];
     }
 
     /** @name Operators
@@ -560,18 +903,18 @@ namespace spt
      */
     inline element_type
     operator [] (size_type __index) const
-    {  return m_sdata->data[__index + m_range.startIndex];  }
+    {  return data()[__index];  }
 
 
-    inline String
+    String
     operator + (const String& s) const
     {
       if ( data() && s.data() )
 	{
-	  data_type::reference_type sdata ( new data_type(this->length() + s.length()) );
-	  memcpy(stpncpy(sdata->data, this->m_sdata->data + m_range.startIndex, this->length()),
-		 s.m_sdata->data + s.m_range.startIndex, s.length());
-	  return String(sdata, range_type(0, sdata->capacity));
+	  String out ( this->length() + s.length() );
+	  memcpy(out.data(), this->data(), this->length());
+	  memcpy(out.data() + this->length(), s.data(), s.length());
+	  return out;
 	}
       else if ( data() )
 	return *this;
@@ -579,7 +922,7 @@ namespace spt
 	return s;
     }
 
-    inline bool
+    bool
     operator == (const char* s) const
     {
       return data()
@@ -599,76 +942,46 @@ namespace spt
       return ! operator ==(s);
     }
 
-    inline bool
+    bool
     operator == (const String& s) const
     {
-      if ( m_sdata.get() == NULL || s.m_sdata.get() == NULL )
+      if ( data() == NULL || s.data() == NULL )
 	return m_range.length() == 0 && s.m_range.length() == 0;
+      else if ( isInterned() && s.isInterned()
+		&& m_sdata->internTable == s.m_sdata->internTable )
+	/* One StringData per distinct value in each table. */
+	return m_sdata == s.m_sdata;
       else
 	return m_range.length() == s.m_range.length()
-	  && 0 == strncmp(m_sdata->data + m_range.startIndex,
-			  s.m_sdata->data + s.m_range.startIndex,
-			  m_range.length());
+	  && ( data() == s.data()
+	       || 0 == strncmp(data(), s.data(), m_range.length()) );
     }
-    inline String&
-    operator += (const char* s)
+    /** Hash of the characters in range, equal for equal Strings.
+     *	Strings viewing all of their shared data (including interned
+     *	ones) compute it once and cache it in the data.
+     */
+    size_t
+    hash() const noexcept
     {
-      size_type sLen ( strlen(s) );
-
-      if ( data() )
-	{
-	  if ( !hasFullRange() )
-	    {
-	      data_type* nd ( new data_type(length() + sLen) );
-	      strncpy(nd->data, data(), length());
-	      m_sdata = nd;
-	    }
-	  else
-	    m_sdata->ensureWritable();
-
-	  size_type minCapacity ( this->length() + sLen );
-
-	  if ( m_sdata->capacity < minCapacity )
-	    m_sdata->resize(minCapacity);
-
-	  strncpy(m_sdata->data + this->length(), s, sLen);
-	  m_range.expand(0, sLen);
-	}
-      else
-	*this = String::copy_of(s);
+      if ( m_sdata && m_range.startIndex == 0 && m_range.endIndex == m_sdata->capacity )
+	return m_sdata->hash();
+      return hash_chars(data(), length());
+    }
 
-      return *this;
+    String&
+    operator += (const char* s)
+    {
+      return append(s, strlen(s));
     }
 
 
-    inline String&
+    String&
     operator += (const String& s)
     {
       if ( data() )
-	{
-	  if ( ! hasFullRange() )
-	    {
-	      data_type* nd ( new data_type(length() + s.length()) );
-	      strncpy(nd->data, data(), length());
-	      m_sdata = nd;
-	    }
-	  else
-	    m_sdata->ensureWritable();
-	  size_type minCapacity ( this->length() + s.length() );
-
-	  if ( m_sdata->capacity < minCapacity )
-	    m_sdata->resize(minCapacity);
-
-	  strncpy(m_sdata->data + this->length(), s.m_sdata->data, s.length());
-	  m_range.expand(0, s.length());
-	}
+	return append(s.data(), s.length());
       else
-	{
-	  m_sdata = s.m_sdata;
-	  m_range = s.m_range;
-	}
-
-      return *this;
+	return *this = s;
     }
 
     inline String&
@@ -676,14 +989,18 @@ namespace spt
     {
       m_sdata = s.m_sdata;
       m_range = s.m_range;
+      m_inlineSize = s.m_inlineSize;
+      copyInline(s);
       return *this;
     }
 
-    inline String&
+    String&
     operator = (String&& s)
     {
       m_sdata.swap(s.m_sdata);
       m_range = std::move(s.m_range);
+      m_inlineSize = s.m_inlineSize;
+      copyInline(s);
       return *this;
     }
     /**@}*/
@@ -702,14 +1019,20 @@ namespace spt
        * ranges do not include the terminating NUL.
        */
       return
-	(!data()) || ( m_range.startIndex == 0 && ( m_range.endIndex == m_sdata->capacity
-						    || ( m_range.endIndex == m_sdata->capacity - 1
-							 && m_sdata->data[m_sdata->capacity - 1] == '\0' ) ));
+	(!data()) || ( m_range.startIndex == 0 && ( m_range.endIndex == bufferCapacity()
+						    || ( m_range.endIndex == bufferCapacity() - 1
+							 && buffer()[bufferCapacity() - 1] == '\0' ) ));
     }
 
     inline String
     withFullRange() const
     {
+      if ( m_inlineSize )
+	{
+	  String out ( *this );
+	  out.m_range = range_type(0, m_inlineSize);
+	  return out;
+	}
       return String(m_sdata);
     }
 
@@ -723,6 +1046,11 @@ namespace spt
     inline bool
     isSubstringOf(const String& s) const
     {
+      if ( m_inlineSize || s.m_inlineSize )
+	/* Inline data is copied with the String, so compare contents. */
+	return m_inlineSize == s.m_inlineSize
+	  && 0 == memcmp(m_inline, s.m_inline, m_inlineSize)
+	  && s.m_range.contains(m_range);
       return s.m_sdata == m_sdata && s.m_range.contains(m_range);
     }
 
@@ -747,34 +1075,104 @@ namespace spt
     }
 
 
-    inline int
-    compare(const String& s) const
+    /** Split at every occurrence of @p delim.  Adjacent delimiters
+     *	produce empty tokens, as does a trailing delimiter; an empty
+     *	string produces no tokens.
+     */
+    SplitRange
+    split(element_type delim) const
     {
-      /* Since strcoll relies on nul-terminated buffers (and String does
-	 not use those -- ever), we must copy the data in each string's
-	 range. */
-      char
-	*buf ( static_cast<char*>(alloca(this->length() + s.length() + 2)) ),
-	*sbuf ( buf + this->length() + 1 );
+      return SplitRange(SplitIterator(this, SplitIterator::CHAR, delim));
+    }
 
-      if ( data() )
-	strncpy(buf, data(), this->length());
-      buf[this->length()] = '\0';
+    /** Split into the runs of characters that are not in the
+     *	NUL-terminated @p delims.  No token is empty.
+     */
+    SplitRange
+    split_any(const element_type* delims) const
+    {
+      return SplitRange(SplitIterator(this, SplitIterator::ANY, '\0', delims, strlen(delims)));
+    }
+
+    /** Split into lines terminated by "\n" or "\r\n"; the terminators
+     *	are not included, and a final terminator does not start an
+     *	empty line.
+     */
+    inline SplitRange
+    lines() const
+    {
+      return SplitRange(SplitIterator(this, SplitIterator::LINES, '\n'));
+    }
 
-      if ( s.data() )
-	strncpy(sbuf, s.data(), s.length());
-      sbuf[s.length()] = '\0';
+    /** Byte-wise three-way comparison, ordering by unsigned
+     *	character values and then by length.  This neither copies nor
+     *	consults the locale; use collate for locale-aware ordering.
+     *
+     * @return A negative value, zero or a positive value if
+     * <code>*this</code> sorts before, equal to or after @p s.
+     */
+    int
+    compare(const String& s) const
+    {
+      size_type n ( length() ), sn ( s.length() );
+      const element_type *a ( data() ), *b ( s.data() );
+
+      size_type common ( n < sn ? n : sn );
+      if ( common > 0 && a != b )
+	{
+	  int r ( memcmp(a, b, common) );
+	  if ( r != 0 )
+	    return r;
+	}
+      return n < sn ? -1 : ( n > sn ? 1 : 0 );
+    }
 
-      return strcoll(buf, sbuf);
+    /** Locale-aware three-way comparison using @c strcoll and the
+     *	current @c LC_COLLATE.  Values that are not NUL-terminated in
+     *	their buffer are copied first (to the stack when short), so
+     *	prefer compare where byte order will do.
+     *
+     * @return A negative value, zero or a positive value if
+     * <code>*this</code> collates before, equal to or after @p s.
+     */
+    int
+    collate(const String& s) const
+    {
+      char stackBuffer[256];
+      size_type need ( ( isTerminated() ? 0 : length() + 1 ) + ( s.isTerminated() ? 0 : s.length() + 1 ) );
+      char* heapBuffer ( need > sizeof(stackBuffer) ? static_cast<char*>(malloc(need)) : NULL );
+      if ( need > sizeof(stackBuffer) && ! heapBuffer )
+	throw std::bad_alloc();
+
+      char* next ( heapBuffer ? heapBuffer : stackBuffer );
+      const char* a ( terminated(next) );
+      const char* b ( s.terminated(next) );
+      int r ( strcoll(a, b) );
+      free(heapBuffer);
+      return r;
     }
 
-    /** Collation-order comparator method.  This allows String to be
-     *  used inside of STL containers.
+    /** Comparator for ordered containers and algorithms that should
+     *	follow the current locale's collation order rather than byte
+     *	order.
+     */
+    struct collate_less
+    {
+      inline bool
+      operator () (const String& a, const String& b) const
+      {
+	return a.collate(b) < 0;
+      }
+    };
+
+    /** Byte-order comparator method.  This allows String to be used
+     *  inside of STL containers; see collate_less for locale-aware
+     *  ordering.
      *
      * @param s Another String against which the current object is to be compared.
      *
-     * @return @c true if <code>*this</code> sorts before @c s in the
-     * current locale.
+     * @return @c true if <code>*this</code> sorts before @c s in byte
+     * order.
      */
     inline bool
     operator < (const String& s) const
@@ -782,20 +1180,219 @@ namespace spt
       return compare(s) < 0;
     }
 
+    inline bool
+    operator > (const String& s) const
+    {
+      return compare(s) > 0;
+    }
+
+    inline bool
+    operator <= (const String& s) const
+    {
+      return compare(s) <= 0;
+    }
+
+    inline bool
+    operator >= (const String& s) const
+    {
+      return compare(s) >= 0;
+    }
+
     /**  Shift-append operator for output of a String to an STL stream.
      */
     inline
     String&
     operator >> (std::basic_ostream<char>& os)
     {
-      element_type* _data ( data() );
+      const element_type* _data ( static_cast<const String&>(*this).data() );
       os.write(_data ? _data : "(null)", _data ? length() : 6);
       return *this;
     }
 
   private:
+    /** Replace unset (@c npos) limits in @p range with the limits of
+     *	the string, and check that it is in bounds.
+     */
+    inline void
+    normalize_range(range_type& range) const
+    {
+      if ( range.startIndex == npos )
+	range.startIndex = 0;
+      if ( range.endIndex == npos )
+	range.endIndex = length();
+      assert_in_range(range);
+    }
+
+    /** Convert a pointer returned by a search kernel to an index. */
+    inline size_type
+    to_index(const element_type* p) const
+    {
+      return p ? static_cast<size_type>(p - data()) : npos;
+    }
+
+    /** Pointer to the start of the underlying buffer (inline or shared). */
+    inline const element_type*
+    buffer() const
+    {
+      return m_sdata ? m_sdata->data : m_inline;
+    }
+
+    inline element_type*
+    buffer()
+    {
+      return m_sdata ? m_sdata->data : m_inline;
+    }
+
+    /** Size of the underlying buffer. */
+    inline size_type
+    bufferCapacity() const
+    {
+      return m_sdata ? m_sdata->capacity : m_inlineSize;
+    }
+
+    /** Store @p length characters from @p s inline.
+     *
+     * @pre <code>0 &lt; length &lt;= inline_capacity</code>
+     */
+    inline void
+    initInline(const element_type* s, size_type length)
+    {
+      if ( length > inline_capacity )
+	__builtin_unreachable();
+      memcpy(m_inline, s, length);
+      m_inline[length] = '\0';
+      m_inlineSize = static_cast<unsigned char>(length);
+    }
+
+    /** Copy the inline characters, if any, from @p s. */
+    inline void
+    copyInline(const String& s)
+    {
+      if ( s.m_inlineSize && &s != this )
+	memcpy(m_inline, s.m_inline, s.m_inlineSize + 1U);
+    }
+
+    /** Append @p n characters to the string, copying its data into
+     *	a new buffer first if it no longer fits inline, is a substring,
+     *	is interned, or is shared with other Strings.
+     */
+    String&
+    append(const element_type* s, size_type n)
+    {
+      const element_type* current ( static_cast<const String&>(*this).data() );
+
+      if ( ! current )
+	return *this = String::copy_of(s, n);
+      if ( n == 0 )
+	return *this;
+
+      size_type minLength ( length() + n );
+
+      if ( m_inlineSize && m_range.endIndex + n <= inline_capacity )
+	{
+	  /* Inline data is never shared; append in place. */
+	  memcpy(m_inline + m_range.endIndex, s, n);
+	  m_range.endIndex += n;
+	  m_inline[m_range.endIndex] = '\0';
+	  m_inlineSize = static_cast<unsigned char>(m_range.endIndex);
+	}
+      else if ( m_inlineSize || m_range.startIndex != 0 || m_sdata->internTable
+		|| ! isSoleOwner() )
+	{
+	  String out ( minLength );
+	  memcpy(out.data(), current, length());
+	  memcpy(out.data() + length(), s, n);
+	  *this = std::move(out);
+	}
+      else
+	{
+	  /* Nothing else can see the buffer; append in place.  Grow
+	   * geometrically so that repeated appends take amortized linear
+	   * time, and keep the slack past the range zeroed as the
+	   * allocating constructor does.
+	   */
+	  m_sdata->ensureWritable();
+	  size_type oldCapacity ( m_sdata->capacity );
+	  if ( oldCapacity < minLength )
+	    {
+	      /* `s += s' appends from the buffer we are about to move. */
+	      const element_type* oldData ( m_sdata->data );
+	      bool aliased ( std::less_equal<const element_type*>()(oldData, s)
+			     && std::less<const element_type*>()(s, oldData + oldCapacity) );
+
+	      size_type newCapacity ( std::max(minLength, oldCapacity + oldCapacity / 2) );
+	      m_sdata->resize(newCapacity);
+	      memset(m_sdata->data + oldCapacity, 0, newCapacity - oldCapacity);
+	      if ( aliased )
+		s = m_sdata->data + ( s - oldData );
+	    }
+
+	  memcpy(m_sdata->data + length(), s, n);
+	  m_range.expand(0, n);
+	}
+
+      return *this;
+    }
+
+    /** Replace this String's buffer with a copy of its range that no
+     *	other String shares.
+     */
+    void
+    detach()
+    {
+      String out ( length() );
+      memcpy(out.data(), static_cast<const String&>(*this).data(), length());
+      *this = std::move(out);
+    }
+
+    /** Check if this String holds the only reference to its
+     *	StringData, so that no other String can observe its buffer and
+     *	it may be modified or grown in place.
+     */
+    inline bool
+    isSoleOwner() const
+    {
+      return m_sdata && m_sdata->use_count() == 1;
+    }
+
+    /** Check if the character after the range is a readable NUL, so
+     *	that data() may be passed to C string functions as-is.
+     */
+    inline bool
+    isTerminated() const
+    {
+      /* Inline values are always followed by a NUL. */
+      size_type readable ( m_inlineSize ? m_inlineSize + 1U : bufferCapacity() );
+      return data() && m_range.endIndex < readable && buffer()[m_range.endIndex] == '\0';
+    }
+
+    /** Get a NUL-terminated copy of the range, or data() itself if it
+     *	is already terminated.  Copies are written to @p next, which is
+     *	advanced past them.
+     */
+    inline const char*
+    terminated(char*& next) const
+    {
+      if ( isTerminated() )
+	return data();
+      char* out ( next );
+      if ( length() > 0 )
+	memcpy(out, data(), length());
+      out[length()] = '\0';
+      next += length() + 1;
+      return out;
+    }
+
+    /** Shared string data; @c NULL for inline and null strings. */
     data_type::reference_type m_sdata;
     range_type m_range;
+
+    /** Number of characters in the inline buffer, or zero if the
+     *	string is not stored inline.
+     */
+    unsigned char m_inlineSize;
+
+    element_type m_inline[inline_capacity + 1];
   };
 }
 
@@ -805,11 +1402,7 @@ namespace std {
   {
     size_t operator()(const spt::String& _s) const noexcept
     {
-#if defined(_LIBCPP_VERSION)
-      return __do_string_hash(_s.data(), _s.data() + _s.length());
-#else
-      return std::_Hash_impl::hash(_s.data(), _s.length());
-#endif
+      return _s.hash();
     }
   };
 }
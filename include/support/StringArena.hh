@@ -0,0 +1,81 @@
+/**@file
+ *
+ * Arena allocation for spt::String data.
+ */
+#ifndef support_StringArena_hh
+#define support_StringArena_hh 1
+
+#include <support/Arena.hh>
+
+namespace spt
+{
+  /** Get the calling thread's current string arena; see
+   *  StringArenaScope.
+   */
+  inline Arena*&
+  string_arena()
+  {
+    static thread_local Arena* arena ( NULL );
+    return arena;
+  }
+
+  /** Allocate @p size bytes for a StringData object from the calling
+   *  thread's string arena, if any, or the heap.
+   */
+  void*
+  string_data_allocate(size_t size, size_t align);
+
+  /** Free memory returned by string_data_allocate; memory from an
+   *  arena (@p inArena) is left for the arena to reclaim.
+   */
+  void
+  string_data_free(void* p, bool inArena);
+
+  /** Route the calling thread's String allocations to an arena for the
+   *  lifetime of the scope object.
+   *
+   * While a scope is active, every StringData created on this thread,
+   * and every buffer it allocates (including when it is later copied
+   * or grown), comes from @p arena.  Releasing the last reference to
+   * such data frees nothing; the memory is reclaimed all at once by
+   * Arena::reset or the arena's destructor.  Every String using it
+   * must be gone (or never used again) by then.
+   *
+   * Scopes nest; passing @c NULL suspends arena allocation for code
+   * that must create longer-lived Strings.
+   *
+   * @code
+   * spt::Arena arena;
+   * for ( const Request& r : requests )
+   *   {
+   *     {
+   *       spt::StringArenaScope scope ( &arena );
+   *       handle(r);
+   *     }
+   *     arena.reset();
+   *   }
+   * @endcode
+   */
+  class StringArenaScope
+  {
+  public:
+    explicit inline StringArenaScope(Arena* arena)
+      : m_previous ( string_arena() )
+    {
+      string_arena() = arena;
+    }
+
+    inline ~StringArenaScope()
+    {
+      string_arena() = m_previous;
+    }
+
+    StringArenaScope(const StringArenaScope&) = delete;
+    StringArenaScope& operator = (const StringArenaScope&) = delete;
+
+  private:
+    Arena* m_previous;
+  };
+}
+
+#endif	/* support_StringArena_hh */
@@ -0,0 +1,211 @@
+/**@file
+ *
+ * Incremental construction of spt::String values.
+ */
+#ifndef support_StringBuilder_hh
+#define support_StringBuilder_hh 1
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include <support/String.hh>
+
+namespace spt
+{
+  /** Growable character buffer for building a String piece by piece.
+   *
+   * The buffer grows geometrically, so appending @e n characters in
+   * any number of pieces costs amortized O(@e n); use reserve to
+   * allocate once up front when the final length is known.  str()
+   * hands the buffer itself to the resulting String instead of copying
+   * it (short results are stored inline, and the buffer is kept for
+   * reuse).
+   */
+  class StringBuilder
+  {
+  public:
+    typedef String::element_type element_type;
+    typedef String::size_type size_type;
+
+    /** Capacity of the first buffer allocated by a builder that was
+     *	not given one.
+     */
+    static constexpr size_type initial_capacity = 64;
+
+    inline StringBuilder()
+      : m_data ( NULL ),
+	m_length ( 0 ),
+	m_capacity ( 0 )
+    {
+    }
+
+    /** Construct an empty builder with room for @p capacity
+     *	characters.
+     */
+    explicit inline StringBuilder(size_type capacity)
+      : m_data ( NULL ),
+	m_length ( 0 ),
+	m_capacity ( 0 )
+    {
+      reserve(capacity);
+    }
+
+    inline StringBuilder(StringBuilder&& b)
+      : m_data ( b.m_data ),
+	m_length ( b.m_length ),
+	m_capacity ( b.m_capacity )
+    {
+      b.m_data = NULL;
+      b.m_length = b.m_capacity = 0;
+    }
+
+    StringBuilder(const StringBuilder&) = delete;
+    StringBuilder& operator = (const StringBuilder&) = delete;
+
+    inline ~StringBuilder()
+    {
+      free(m_data);
+    }
+
+    inline size_type
+    length() const { return m_length; }
+
+    inline bool
+    empty() const { return m_length == 0; }
+
+    /** Number of characters the builder can hold without
+     *	reallocating.
+     */
+    inline size_type
+    capacity() const { return m_capacity; }
+
+    /** Characters appended so far; not NUL-terminated. */
+    inline const element_type*
+    data() const { return m_data; }
+
+    /** Ensure room for at least @p n characters in total.
+     *
+     * @throws std::bad_alloc if memory is exhausted.
+     */
+    inline void
+    reserve(size_type n)
+    {
+      if ( n > m_capacity )
+	reallocate(n);
+    }
+
+    /** Discard the contents, keeping the buffer. */
+    inline void
+    clear() { m_length = 0; }
+
+    inline StringBuilder&
+    append(const element_type* s, size_type n)
+    {
+      if ( n == 0 )
+	return *this;
+      if ( m_length + n > m_capacity )
+	grow(m_length + n);
+      memcpy(m_data + m_length, s, n);
+      m_length += n;
+      return *this;
+    }
+
+    inline StringBuilder&
+    append(const element_type* s)
+    {
+      return s ? append(s, strlen(s)) : *this;
+    }
+
+    inline StringBuilder&
+    append(const String& s)
+    {
+      return append(s.data(), s.length());
+    }
+
+    inline StringBuilder&
+    append(element_type c)
+    {
+      if ( m_length == m_capacity )
+	grow(m_length + 1);
+      m_data[m_length++] = c;
+      return *this;
+    }
+
+    /** Append @p count copies of @p c. */
+    inline StringBuilder&
+    append(size_type count, element_type c)
+    {
+      if ( m_length + count > m_capacity )
+	grow(m_length + count);
+      memset(m_data + m_length, c, count);
+      m_length += count;
+      return *this;
+    }
+
+    template < typename _Tp >
+    inline StringBuilder&
+    operator += (const _Tp& v)
+    {
+      return append(v);
+    }
+
+    template < typename _Tp >
+    inline StringBuilder&
+    operator << (const _Tp& v)
+    {
+      return append(v);
+    }
+
+    /** Get the built String and leave the builder empty.
+     *
+     * Results longer than String::inline_capacity take over the
+     * builder's buffer without copying it, and the builder allocates
+     * afresh on its next append.  Shorter results are copied into the
+     * String's inline storage, and the buffer is kept.
+     */
+    String
+    str()
+    {
+      if ( m_length <= String::inline_capacity )
+	{
+	  String out ( m_length > 0 ? String(m_data, m_length) : String() );
+	  m_length = 0;
+	  return out;
+	}
+
+      /* There is always room for the terminator; see reallocate. */
+      m_data[m_length] = '\0';
+      String out ( String::take_ownership(m_data, m_length) );
+      m_data = NULL;
+      m_length = m_capacity = 0;
+      return out;
+    }
+
+  private:
+    inline void
+    grow(size_type minCapacity)
+    {
+      size_type newCapacity ( m_capacity > 0 ? m_capacity * 2 : initial_capacity );
+      reallocate(newCapacity > minCapacity ? newCapacity : minCapacity);
+    }
+
+    inline void
+    reallocate(size_type newCapacity)
+    {
+      /* One extra element for the terminator added by str(). */
+      element_type* p ( static_cast<element_type*>(realloc(m_data, newCapacity + 1)) );
+      if ( ! p )
+	throw std::bad_alloc();
+      m_data = p;
+      m_capacity = newCapacity;
+    }
+
+    element_type* m_data;
+    size_type m_length;
+    size_type m_capacity;
+  };
+}
+
+#endif	/* support_StringBuilder_hh */
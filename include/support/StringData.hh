@@ -2,19 +2,27 @@
 #define support_StringData_hh 1
 
 #include <support/RefCountedObject.hh>
+#include <support/StringArena.hh>
+#include <support/StringHash.hh>
 
 namespace spt
 {
   /** String-data management helper.  The StringData structure stores
    *  string data independently of its access semantics.
    *
+   * StringData is reference-counted through the non-virtual
+   * RefCounted base, so it carries no vtable.
+   *
+   * StringData objects created while a StringArenaScope is active
+   * live in its arena, along with any buffers they allocate.
+   *
    * @param _T Element (character) type.
    *
    * @param _U Type used by data-free function (e.g., void -> free(void*)).
    */
   template < typename _T, typename _U = _T >
   struct StringData
-    : RefCountedObject
+    : RefCounted< StringData<_T,_U> >
   {
     /** Element (character) type. */
     typedef _T element_type;
@@ -22,6 +30,7 @@ namespace spt
     typedef size_t size_type;
     typedef boost::intrusive_ptr< StringData<_T,_U> > reference_type;
     typedef void (*FreeFunction) (_U*);
+    typedef void (*SizedFreeFunction) (_U*, size_type);
 
     /** Pointer to first byte of data buffer. */
     element_type*	data;
@@ -36,14 +45,41 @@ namespace spt
     /** Function the StringData will use to free data. */
     FreeFunction	freeFunction;
 
+    /** If non-@c NULL, used instead of freeFunction, and passed the
+     *	capacity as well (e.g. to @c munmap a mapped file).  Data freed
+     *	this way cannot be reallocated, so ensureWritable copies it.
+     */
+    SizedFreeFunction	sizedFreeFunction;
+
+    /** If non-@c NULL, this StringData is the canonical copy of its
+     *	value in the StringInternTable at this address, and must not be
+     *	modified.
+     */
+    const void*	internTable;
+
+    /** Arena holding this object, and the buffers it allocates;
+     *	@c NULL for heap-allocated StringData.  Arena buffers have a
+     *	@c NULL freeFunction.
+     */
+    Arena*	arena;
+
+    /** Cached hash_chars value for the whole buffer, or zero if not
+     *	yet computed; see hash().  Accessed atomically since readers on
+     *	different threads may fill it in concurrently.
+     */
+    mutable size_t	cachedHash;
 
 #ifndef SWIG_VERSION
     inline StringData(StringData&& __sd)
-      : RefCountedObject ( ),
+      : RefCounted< StringData<_T,_U> > ( ),
 	data ( std::move ( __sd.data ) ),
 	capacity ( std::move ( __sd.capacity ) ),
 	ownsData ( std::move ( __sd.ownsData ) ),
-	freeFunction ( std::move ( __sd.freeFunction ) )
+	freeFunction ( std::move ( __sd.freeFunction ) ),
+	sizedFreeFunction ( __sd.sizedFreeFunction ),
+	internTable ( __sd.internTable ),
+	arena ( string_arena() ),
+	cachedHash ( __sd.cachedHash )
     {
       __sd.data = NULL;
       __sd.ownsData = false;
@@ -53,43 +89,63 @@ namespace spt
     /** Allocating constructor.  Allocates and initializes the specified number of elements.
      */
     explicit inline StringData(size_type _capacity)
-      : RefCountedObject ( ),
-	data ( static_cast<element_type*>(calloc(_capacity, sizeof(_T))) ),
+      : RefCounted< StringData<_T,_U> > ( ),
+	data ( NULL ),
 	capacity ( _capacity ),
 	ownsData ( true ),
-	freeFunction ( &free )
+	freeFunction ( &free ),
+	sizedFreeFunction ( NULL ),
+	internTable ( NULL ),
+	arena ( string_arena() ),
+	cachedHash ( 0 )
     {
+      data = allocate(_capacity);
+      if ( _capacity > 0 )
+	memset(data, 0, _capacity * sizeof(_T));
     }
 
     explicit inline StringData(const element_type* s, size_type knownCapacity = 0, bool takeOwnership = false, FreeFunction _freeFunction = &free)
-      : RefCountedObject ( ),
+      : RefCounted< StringData<_T,_U> > ( ),
 	data ( const_cast<element_type*>(s) ),
 	capacity ( knownCapacity != 0 ? knownCapacity : ( s == NULL ? 0 : strlen(s) ) ),
 	ownsData ( takeOwnership ),
-	freeFunction ( _freeFunction )
+	freeFunction ( _freeFunction ),
+	sizedFreeFunction ( NULL ),
+	internTable ( NULL ),
+	arena ( string_arena() ),
+	cachedHash ( 0 )
     {
     }
 
     /** Destructor.  Calls freeFunction on data if data is non-@c NULL and ownsData is @c true.
      */
-    inline virtual ~StringData() throw ( std::runtime_error )
+    inline ~StringData()
     {
-      if ( ownsData )
-	freeFunction(data);
+      release();
     }
 
-    /** Ensure that the current StringData owns its data.  If ownsData
-     * is @c false, the contents of data will be copied into a new
-     *  buffer.
+    /** Ensure that the current StringData owns its data in a buffer
+     * that may be resized.  If ownsData is @c false, or the data is
+     * freed by sizedFreeFunction, the contents of data will be copied
+     * into a new buffer.
+     *
+     * This changes the buffer for every reference to the StringData,
+     * so call it only while holding the sole reference (use_count() ==
+     * 1); String copies shared data instead (see String::data).
      */
     inline void ensureWritable()
     {
-      if ( ! ownsData )
+      if ( this->use_count() > 1 )
+	throw std::logic_error("ensureWritable called on shared StringData");
+      invalidateHash();
+      if ( ! ownsData || sizedFreeFunction )
 	{
-	  element_type* newData = static_cast<element_type*>(malloc(capacity));
-	  memcpy(newData, data, capacity);
+	  element_type* newData = allocate(capacity);
+	  memcpy(newData, data, capacity * sizeof(_T));
+	  release();
 	  data = newData;
 	  ownsData = true;
+	  sizedFreeFunction = NULL;
 	}
     }
 
@@ -99,11 +155,99 @@ namespace spt
 	throw std::runtime_error("Resize not allowed on non-owning StringData!");
       else if ( capacity != newCapacity )
 	{
-	  data = static_cast<element_type*>(realloc(data, newCapacity));
+	  invalidateHash();
+	  if ( freeFunction )
+	    data = static_cast<element_type*>(realloc(data, newCapacity * sizeof(_T)));
+	  else
+	    {
+	      /* Arena buffers are never freed individually; move to a
+		 new one. */
+	      element_type* newData = allocate(newCapacity);
+	      memcpy(newData, data, ( capacity < newCapacity ? capacity : newCapacity ) * sizeof(_T));
+	      data = newData;
+	    }
 	  capacity = newCapacity;
 	}
     }
 
+    /** Get hash_chars(data, capacity), computing it on first use. */
+    inline size_t hash() const noexcept
+    {
+      size_t h ( __atomic_load_n(&cachedHash, __ATOMIC_RELAXED) );
+      if ( h == 0 )
+	{
+	  h = hash_chars(reinterpret_cast<const char*>(data), capacity * sizeof(_T));
+	  __atomic_store_n(&cachedHash, h, __ATOMIC_RELAXED);
+	}
+      return h;
+    }
+
+    /** Forget the cached hash; call before modifying data. */
+    inline void invalidateHash() noexcept
+    {
+      __atomic_store_n(&cachedHash, 0, __ATOMIC_RELAXED);
+    }
+
+    /** Allocate StringData objects from the current string arena, if
+     *	any.
+     */
+    static void*
+    operator new(size_t size)
+    {
+      return string_data_allocate(size, alignof(StringData));
+    }
+
+    /** Only used when a constructor throws, while the arena that
+     *	operator new chose is still current.
+     */
+    static void
+    operator delete(void* p)
+    {
+      string_data_free(p, string_arena() != NULL);
+    }
+
+    /** Called by RefCounted when the last reference is released.
+     *	Arena-allocated objects are destroyed but not freed.
+     */
+    static void
+    destroy(const StringData* sd)
+    {
+      bool inArena ( sd->arena != NULL );
+      sd->~StringData();
+      string_data_free(const_cast<StringData*>(sd), inArena);
+    }
+
+
+  private:
+    inline void release()
+    {
+      if ( ! ownsData )
+	return;
+      else if ( sizedFreeFunction )
+	sizedFreeFunction(data, capacity);
+      else if ( freeFunction )
+	freeFunction(data);
+    }
+
+    /** Allocate an uninitialized buffer for @p n elements from this
+     *	object's arena or the heap, and set freeFunction to match.
+     *
+     * @throws std::bad_alloc if memory is exhausted.
+     */
+    element_type* allocate(size_type n)
+    {
+      if ( arena )
+	{
+	  freeFunction = NULL;
+	  return static_cast<element_type*>(arena->allocate(n * sizeof(_T), alignof(_T)));
+	}
+
+      element_type* p ( static_cast<element_type*>(malloc(n * sizeof(_T))) );
+      if ( ! p && n > 0 )
+	throw std::bad_alloc();
+      freeFunction = &free;
+      return p;
+    }
   };
 }
 
@@ -0,0 +1,89 @@
+/**@file
+ *
+ * Fast non-cryptographic hashing of byte buffers.
+ */
+#ifndef support_StringHash_hh
+#define support_StringHash_hh 1
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace spt
+{
+  /**@name Hash primitives
+   *
+   * A multiply-and-fold hash in the style of wyhash: each step
+   * multiplies two 64-bit words into a 128-bit product and folds its
+   * halves together.  Inputs longer than 48 bytes are consumed by
+   * three independent lanes, so the multiplies overlap in the
+   * pipeline; short inputs (the common case for keys) take a single
+   * branch and two multiplies.  Not suitable where hash-flooding
+   * resistance is required.
+   *@{
+   */
+  namespace hash_detail
+  {
+    static constexpr uint64_t p0 = 0xa0761d6478bd642fULL;
+    static constexpr uint64_t p1 = 0xe7037ed1a0b428dbULL;
+    static constexpr uint64_t p2 = 0x8ebc6af09c88c6e3ULL;
+    static constexpr uint64_t p3 = 0x589965cc75374cc3ULL;
+
+    /** Multiply @p a by @p b and fold the 128-bit product to 64 bits. */
+    inline uint64_t
+    mix(uint64_t a, uint64_t b) noexcept
+    {
+#ifdef __SIZEOF_INT128__
+      __uint128_t r ( static_cast<__uint128_t>(a) * b );
+      return static_cast<uint64_t>(r) ^ static_cast<uint64_t>(r >> 64);
+#else
+      uint64_t ha ( a >> 32 ), hb ( b >> 32 ), la ( static_cast<uint32_t>(a) ), lb ( static_cast<uint32_t>(b) );
+      uint64_t rh ( ha * hb ), rm0 ( ha * lb ), rm1 ( hb * la ), rl ( la * lb );
+      uint64_t t ( rl + ( rm0 << 32 ) ), c ( t < rl );
+      uint64_t lo ( t + ( rm1 << 32 ) );
+      c += lo < t;
+      uint64_t hi ( rh + ( rm0 >> 32 ) + ( rm1 >> 32 ) + c );
+      return lo ^ hi;
+#endif
+    }
+
+    inline uint64_t
+    read64(const unsigned char* p) noexcept
+    {
+      uint64_t v;
+      memcpy(&v, p, sizeof(v));
+      return v;
+    }
+
+    inline uint64_t
+    read32(const unsigned char* p) noexcept
+    {
+      uint32_t v;
+      memcpy(&v, p, sizeof(v));
+      return v;
+    }
+  }
+
+  /** Hash @p length bytes at @p data.
+   *
+   * @param seed Perturbs the result; different seeds give unrelated
+   * hash functions.
+   */
+  uint64_t
+  hash_bytes(const void* data, size_t length, uint64_t seed = 0) noexcept;
+  /**@}*/
+
+  /** Hash @p length bytes at @p s for hash tables.
+   *
+   * @return The hash; never zero, which StringData reserves to mean
+   * "not computed".
+   */
+  inline size_t
+  hash_chars(const char* s, size_t length) noexcept
+  {
+    size_t h ( static_cast<size_t>(hash_bytes(s, length)) );
+    return h != 0 ? h : 1;
+  }
+}
+
+#endif	/* support_StringHash_hh */
@@ -0,0 +1,133 @@
+/**@file
+ *
+ * String interning for spt::String.
+ */
+#ifndef support_StringIntern_hh
+#define support_StringIntern_hh 1
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+#include <support/Arena.hh>
+#include <support/String.hh>
+
+namespace spt
+{
+  /** Table of canonical String values.
+   *
+   * intern returns, for each distinct value, a String that shares a
+   * single StringData with every other String interned from an equal
+   * value in the same table; comparing two Strings interned in the
+   * same table with @c == compares pointers only.  Canonical Strings
+   * are never stored inline, and appending to one copies it first.
+   *
+   * The table is split into independently-locked shards selected by
+   * hash, so threads interning different values rarely contend.
+   * Interned values live as long as the table; HEAP-stored Strings
+   * that outlive it keep their value, but are no longer interned.
+   */
+  class StringInternTable
+  {
+  public:
+    /** Storage for interned characters. */
+    enum Storage
+      {
+	/** One heap allocation per value, freed with the table. */
+	HEAP,
+
+	/** Per-shard arenas; cheaper to allocate, and released only
+	 *  when the table is destroyed.
+	 */
+	ARENA
+      };
+
+    /** Number of shards; a power of two. */
+    static constexpr size_t num_shards = 32;
+
+    explicit StringInternTable(Storage storage = HEAP);
+    ~StringInternTable();
+
+    StringInternTable(const StringInternTable&) = delete;
+    StringInternTable& operator = (const StringInternTable&) = delete;
+
+    /** Get the canonical String for @p length characters at @p s.
+     *
+     * @return The canonical String, or an empty String if @p s is
+     * @c NULL or @p length is zero.
+     */
+    String
+    intern(const String::element_type* s, String::size_type length);
+
+    String
+    intern(const String::element_type* s)
+    {
+      return s ? intern(s, strlen(s)) : String();
+    }
+
+    String
+    intern(const String& s)
+    {
+      return s.isInternedIn(*this) ? s : intern(s.data(), s.length());
+    }
+
+    /** Number of distinct values in the table. */
+    size_t
+    size() const;
+
+    /** Process-wide, arena-backed table used by spt::intern.  It is
+     *	never destroyed, so Strings interned in it remain valid during
+     *	static destruction.
+     */
+    static StringInternTable&
+    global();
+
+  private:
+    struct Entry
+    {
+      size_t hash;
+      String::data_type::reference_type data;
+    };
+
+    struct Shard
+    {
+      Shard();
+      ~Shard();
+
+      mutable std::mutex lock;
+
+      /** Open-addressed (linear probing) slots; size is a power of two. */
+      std::vector<Entry> slots;
+      size_t count;
+
+      Arena arena;
+    };
+
+    static void
+    grow(Shard& shard);
+
+    Storage m_storage;
+    Shard m_shards[num_shards];
+  };
+
+  /** Intern a value in StringInternTable::global(). */
+  inline String
+  intern(const String::element_type* s, String::size_type length)
+  {
+    return StringInternTable::global().intern(s, length);
+  }
+
+  inline String
+  intern(const String::element_type* s)
+  {
+    return StringInternTable::global().intern(s);
+  }
+
+  inline String
+  intern(const String& s)
+  {
+    return StringInternTable::global().intern(s);
+  }
+}
+
+#endif	/* support_StringIntern_hh */
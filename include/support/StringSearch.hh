@@ -0,0 +1,82 @@
+/**@file
+ *
+ * Vectorized search kernels for character buffers.
+ *
+ * These operate on explicit (pointer, length) buffers, which need not
+ * be NUL-terminated, and never read outside them.  On x86 the
+ * implementation is chosen at run time from AVX2, SSE2 and portable
+ * scalar code.
+ */
+#ifndef support_StringSearch_hh
+#define support_StringSearch_hh 1
+
+#include <cstddef>
+
+namespace spt
+{
+  /** Instruction-set levels available to the search kernels. */
+  enum StringSearchISA
+    {
+      STRING_SEARCH_SCALAR,
+      STRING_SEARCH_SSE2,
+      STRING_SEARCH_AVX2
+    };
+
+  /** Find the first occurrence of @p c in @p n bytes at @p s.
+   *
+   * @return Pointer to the match, or @c NULL.
+   */
+  const char*
+  find_byte(const char* s, size_t n, char c);
+
+  /** Find the last occurrence of @p c in @p n bytes at @p s.
+   *
+   * @return Pointer to the match, or @c NULL.
+   */
+  const char*
+  rfind_byte(const char* s, size_t n, char c);
+
+  /** Count occurrences of @p c in @p n bytes at @p s. */
+  size_t
+  count_byte(const char* s, size_t n, char c);
+
+  /** Find the first byte in @p s that is (or, if @p negate is @c true,
+   *  is not) one of the @p setLength bytes at @p set.
+   *
+   * @return Pointer to the match, or @c NULL.
+   */
+  const char*
+  find_first_of(const char* s, size_t n, const char* set, size_t setLength, bool negate = false);
+
+  /** Find the last byte in @p s that is (or, if @p negate is @c true,
+   *  is not) one of the @p setLength bytes at @p set.
+   *
+   * @return Pointer to the match, or @c NULL.
+   */
+  const char*
+  find_last_of(const char* s, size_t n, const char* set, size_t setLength, bool negate = false);
+
+  /** Find the first occurrence of the @p m bytes at @p needle within
+   *  @p n bytes at @p s.
+   *
+   * @return Pointer to the match, or @c NULL.  An empty needle matches
+   * at @p s.
+   */
+  const char*
+  find_substring(const char* s, size_t n, const char* needle, size_t m);
+
+  /** Get the instruction set currently used by the search kernels. */
+  StringSearchISA
+  string_search_isa();
+
+  /** Select the instruction set used by the search kernels (mainly for
+   *  testing and benchmarking).
+   *
+   * @return @c false, leaving the selection unchanged, if @p isa is
+   * not supported on this machine.
+   */
+  bool
+  string_search_set_isa(StringSearchISA isa);
+}
+
+#endif	/* support_StringSearch_hh */
@@ -5,16 +5,70 @@
 #include <cmath>
 #include <type_traits>
 #include <support/scalar.h>
-#include <cstdarg>
+#include <support/VecExpr.hh>
+#include <support/VecMagCache.hh>
+#include <support/VecSIMD.hh>
 #include <cstring>
 #include <stdexcept>
 
 namespace spt
 {
+  namespace vec_detail
+  {
+    /** A pack of indices, for expanding array initializers. */
+    template < size_t... _I >
+    struct indices
+    {
+    };
+
+    template < size_t _N, size_t... _I >
+    struct make_indices
+      : make_indices<_N - 1, _N - 1, _I...>
+    {
+    };
+
+    template < size_t... _I >
+    struct make_indices<0, _I...>
+    {
+      typedef indices<_I...> type;
+    };
+
+    /** Whether every type in @p _S is arithmetic. */
+    template < typename... _S >
+    struct all_arithmetic
+      : std::true_type
+    {
+    };
+
+    template < typename _First, typename... _Rest >
+    struct all_arithmetic<_First, _Rest...>
+      : std::integral_constant<bool, std::is_arithmetic<_First>::value && all_arithmetic<_Rest...>::value>
+    {
+    };
+  }
+
   /** A templatized implementation of Vector
+   *
+   * Arithmetic goes through vec_simd::ops, which has SSE/AVX versions
+   * for two- to four-component float and double vectors; those are
+   * stored padded to a whole number of registers (see
+   * vec_simd::layout).
+   *
+   * The arithmetic operators (+, -, and * or / by a scalar) return
+   * expression objects (see VecExpr), which are evaluated in one pass
+   * when assigned to a Vec.
+   *
+   * Construction, copying, element access, expressions, dot() and
+   * cross() are @c constexpr, so tables of constant vectors can be
+   * computed at compile time.  A constexpr Vec lands in read-only data
+   * only with NoMagCache, whose vectors have no mutable members.
+   *
+   * @tparam _MagCache Whether to cache computed magnitudes: MagCache or
+   * NoMagCache.  Vecs with different policies can be mixed freely.
    */
-  template < size_t _N, typename _ValueType = scalar_t >
+  template < size_t _N, typename _ValueType = scalar_t, typename _MagCache = DefaultMagCache >
   class Vec
+    : private _MagCache::template cache<_ValueType>
   {
   public:
     typedef  _ValueType value_type;
@@ -22,196 +76,194 @@ namespace spt
 
     static const size_type N = _N;
 
+    /** Kernels used for this vector type's arithmetic. */
+    typedef vec_simd::ops<_N, _ValueType> ops_type;
+
+    typedef _MagCache mag_cache_policy;
+
   protected:
-    value_type _M_val[_N];
+    typedef typename _MagCache::template cache<_ValueType> mag_cache_type;
+    typedef vec_simd::layout<_N, _ValueType> layout;
 
-#ifdef SPT_VECT_CACHE_MAGNITUDE
-    mutable value_type _M_mag_cached;
-    mutable bool _M_recalc_mag;
-    mutable value_type _M_mag2_cached;
-    mutable bool _M_recalc_mag2;
-#endif
+    inline const mag_cache_type&
+    mag_cache() const
+    {
+      return *this;
+    }
+
+    alignas(layout::alignment)
+    value_type _M_val[layout::lanes];
 
   public:
-    inline
+    constexpr
     Vec()
-      : _M_val { 0 }
-#ifdef SPT_VECT_CACHE_MAGNITUDE
-        ,_M_mag_cached(0), _M_recalc_mag(false),
-	_M_mag2_cached(0), _M_recalc_mag2(false)
-#endif
+      : mag_cache_type ( 0, 0 ),
+	_M_val { 0 }
     {
     }
 
-    inline
+    constexpr
     Vec(const Vec& v)
-      : _M_val ( )
-#ifdef SPT_VECT_CACHE_MAGNITUDE
-        ,_M_mag_cached(v._M_mag_cached), _M_recalc_mag(v._M_recalc_mag),
-	_M_mag2_cached(v._M_mag2_cached), _M_recalc_mag2(v._M_recalc_mag2)
-#endif
+      : Vec(v.mag_cache(), vec_expr::Leaf<_N, _ValueType>(v._M_val),
+	    typename vec_detail::make_indices<layout::lanes>::type())
     {
-      for ( size_type i ( 0 ); i < _N; ++i )
-	_M_val[i] = v._M_val[i];
     }
 
 
-    template < typename _OtherValueType,
+    template < typename _OtherValueType, typename _OtherMagCache,
                typename = typename std::enable_if<std::is_arithmetic<_OtherValueType>::value>::type>
-    Vec(const Vec<_N, _OtherValueType>& v)
-      : _M_val ( )
-#ifdef SPT_VECT_CACHE_MAGNITUDE
-        ,_M_mag_cached(), _M_recalc_mag(true), _M_mag2_cached(0), _M_recalc_mag2(true)
-#endif
+    Vec(const Vec<_N, _OtherValueType, _OtherMagCache>& v)
     {
+      value_type nv[_N];
       for ( size_type i ( 0 ); i < _N; ++i )
-	_M_val[i] = static_cast<value_type>(v.val()[i]);
+	nv[i] = static_cast<value_type>(v.val()[i]);
+      ops_type::set(_M_val, nv);
     }
 
-    template < typename... _S>
+    /** Construct from up to @p _N components; the rest are zero. */
+    template < typename... _S,
+	       typename = typename std::enable_if<vec_detail::all_arithmetic<_S...>::value>::type >
+    constexpr
     Vec(_S... values)
       : _M_val { static_cast<value_type>(values)... }
-#ifdef SPT_VECT_CACHE_MAGNITUDE
-        ,_M_mag_cached(0), _M_recalc_mag(true), _M_mag2_cached(0), _M_recalc_mag2(true)
-#endif
     {
+      static_assert(sizeof...(_S) <= _N, "too many initializers for Vec");
     }
 
     Vec(const value_type* values)
-      : _M_val ( )
-#ifdef SPT_VECT_CACHE_MAGNITUDE
-        ,_M_mag_cached(0), _M_recalc_mag(true), _M_mag2_cached(0), _M_recalc_mag2(true)
-#endif
     {
-      for ( size_type i ( 0 ); i < _N; ++i )
-	_M_val[i] = values[i];
+      ops_type::set(_M_val, values);
     }
 
 
     Vec(std::initializer_list<_ValueType> values)
-      : _M_val ( )
-#ifdef SPT_VECT_CACHE_MAGNITUDE
-        ,_M_mag_cached(0), _M_recalc_mag(true), _M_mag2_cached(0), _M_recalc_mag2(true)
-#endif
     {
+      value_type nv[_N] = { };
       size_type i ( 0 );
       for ( const _ValueType* v ( values.begin() ); v != values.end(); ++v, ++i )
-	_M_val[i] = static_cast<value_type>(*v);
+	nv[i] = static_cast<value_type>(*v);
+      ops_type::set(_M_val, nv);
     }
 
 
+    /** Construct the vector by evaluating expression @p e. */
+    template < typename _Expr,
+	       typename = typename std::enable_if<vec_expr::is_expression<_Expr>::value>::type >
+    constexpr
+    Vec(const _Expr& e)
+      : Vec(mag_cache_type(), e, typename vec_detail::make_indices<layout::lanes>::type())
+    {
+      static_assert(_Expr::N == _N && std::is_same<typename _Expr::value_type, value_type>::value,
+		    "Vec expression has a different dimension or value type");
+    }
+
     /** Destructor. */
     ~Vec() = default;
 
+    /* Writes store whole registers, padding lanes included (see
+       vec_simd::ops::set), so that the SIMD kernels can load them
+       right away.  Element writes through operator [] can't. */
+
     Vec&
     operator =(const Vec& other)
     {
-      for ( size_type i ( 0 ); i < _N; ++i )
-    	_M_val[i] = other._M_val[i];
+      ops_type::copy(_M_val, other._M_val);
+      static_cast<mag_cache_type&>(*this) = other.mag_cache();
 
-#ifdef SPT_VECT_CACHE_MAGNITUDE
-      _M_recalc_mag = other._M_recalc_mag;
-      _M_mag_cached = other._M_mag_cached;
-      _M_recalc_mag2 = other._M_recalc_mag2;
-      _M_mag2_cached = other._M_mag2_cached;
-#endif
-      
+      return *this;
+    }
+
+    /** Evaluate expression @p e into this vector.  Each component of
+     *	the result depends only on the same component of the operands,
+     *	so @p e may refer to this vector.
+     */
+    template < typename _Expr >
+    inline typename std::enable_if<vec_expr::is_expression<_Expr>::value, Vec&>::type
+    operator =(const _Expr& e)
+    {
+      assign(e);
+      mag_cache().invalidate();
+      return *this;
+    }
+
+    template < typename _Expr >
+    inline typename std::enable_if<vec_expr::is_expression<_Expr>::value, Vec&>::type
+    operator +=(const _Expr& e)
+    {
+      for ( size_type i ( 0 ); i < _Expr::lanes; ++i )
+	_M_val[i] += e.eval(i);
+      mag_cache().invalidate();
+      return *this;
+    }
+
+    template < typename _Expr >
+    inline typename std::enable_if<vec_expr::is_expression<_Expr>::value, Vec&>::type
+    operator -=(const _Expr& e)
+    {
+      for ( size_type i ( 0 ); i < _Expr::lanes; ++i )
+	_M_val[i] -= e.eval(i);
+      mag_cache().invalidate();
       return *this;
     }
 
     Vec&
     operator =(const value_type s[_N])
     {
-      for ( size_type i ( 0 ); i < _N; ++i )
-	_M_val[i] = s[i];
-#ifdef SPT_VECT_CACHE_MAGNITUDE
-      _M_recalc_mag = true;
-      _M_recalc_mag2 = true;
-#endif
+      ops_type::set(_M_val, s);
+      mag_cache().invalidate();
       return *this;
     }
 
-    __attribute__(( noinline ))	/* Variadic, so it's (apparently) not inlinable. */
-    void
-    set(value_type first, ...)
-    {
-      _M_val[0] = first;
-      va_list ap;
-      va_start(ap, first);
-      for ( size_type i ( 1 ); i < _N; ++i )
-	_M_val[i] = static_cast<value_type>(va_arg(ap, double));
-
-      va_end(ap);
-#ifdef SPT_VECT_CACHE_MAGNITUDE
-      _M_recalc_mag = true;
-      _M_recalc_mag2 = true;
-#endif
+    /** Set all @p _N components. */
+    template < typename... _S >
+    inline typename std::enable_if<sizeof...(_S) == _N && vec_detail::all_arithmetic<_S...>::value>::type
+    set(_S... values)
+    {
+      const value_type nv[] = { static_cast<value_type>(values)... };
+      ops_type::set(_M_val, nv);
+      mag_cache().invalidate();
     }
 
     inline void
     set(value_type nv[_N])
     {
-      for ( size_type i ( 0 ); i < _N; ++i )
-	_M_val[i] = nv[i];
-#ifdef SPT_VECT_CACHE_MAGNITUDE
-      _M_recalc_mag = true;
-      _M_recalc_mag2 = true;
-#endif
+      ops_type::set(_M_val, nv);
+      mag_cache().invalidate();
     }
 
     inline void
     set(const Vec& r)
     {
-      memcpy(_M_val, r._M_val, _N * sizeof(value_type));
-#ifdef SPT_VECT_CACHE_MAGNITUDE
-      _M_recalc_mag = true;
-      _M_recalc_mag2 = true;
-#endif
+      ops_type::copy(_M_val, r._M_val);
+      mag_cache().invalidate();
     }
 
     inline void
     clear()
     {
-      for ( size_type i ( 0 ); i < _N; ++i )
+      for ( size_type i ( 0 ); i < layout::lanes; ++i )
 	_M_val[i] = 0;
 
-#ifdef SPT_VECT_CACHE_MAGNITUDE
-      _M_mag_cached = 0;
-      _M_mag2_cached = 0;
-      _M_recalc_mag = false;
-      _M_recalc_mag2 = false;
-#endif
+      mag_cache().known(0, 0);
     }
 
 
     value_type
     mag2() const
     {
-#ifdef SPT_VECT_CACHE_MAGNITUDE
-      if ( _M_recalc_mag2 )
-	{
-	  _M_mag2_cached = compute_mag2();
-	  _M_recalc_mag2 = false;
-	}
-      return _M_mag2_cached;
-#else
-      return compute_mag2();
-#endif
+      value_type m2 ( 0 );
+      if ( ! mag_cache().get_mag2(m2) )
+	mag_cache().put_mag2(m2 = compute_mag2());
+      return m2;
     }
 
     value_type
     mag() const
     {
-#ifdef SPT_VECT_CACHE_MAGNITUDE
-      if ( _M_recalc_mag )
-	{
-	  _M_mag_cached = compute_mag();
-	  _M_recalc_mag = false;
-	}
-      return _M_mag_cached;
-#else
-      return compute_mag();
-#endif
+      value_type m ( 0 );
+      if ( ! mag_cache().get_mag(m) )
+	mag_cache().put_mag(m = compute_mag());
+      return m;
     }
 
 
@@ -228,7 +280,7 @@ namespace spt
 #endif
     }
 
-    value_type
+    constexpr value_type
     compute_mag2() const
     {
       return dot(*this);
@@ -245,16 +297,26 @@ namespace spt
 	   S_LT(m, S_SLOP) )
 	return;
 
-      for ( size_type i = 0; i < _N; ++i )
-	_M_val[i] /= m;
+      ops_type::divide(_M_val, _M_val, m);
+      mag_cache().known(S_LITERAL(1.0), S_LITERAL(1.0));
+    }
 
+    /** Transform the vector to a unit vector, in-place, scaling by an
+     *	approximate reciprocal square root where the hardware has one
+     *	(SSE, for float vectors).  The resulting magnitude is then one
+     *	to within about 1e-6.
+     */
+    void
+    normalize_fast()
+    {
+      value_type m2 ( mag2() );
 
-#ifdef SPT_VECT_CACHE_MAGNITUDE
-      _M_mag_cached = _M_mag2_cached = S_LITERAL(1.0);
-      _M_recalc_mag = _M_recalc_mag2 = false;
-#endif
+      if ( S_LT(m2, S_SLOP * S_SLOP) )
+	return;
 
-      return;
+      ops_type::scale(_M_val, _M_val, ops_type::rsqrt(m2));
+
+      mag_cache().invalidate();
     }
 
     Vec
@@ -267,17 +329,12 @@ namespace spt
 	return *this;
 
       Vec o;
-
-      for ( size_type i = 0; i < _N; ++i )
-	o._M_val[i] = _M_val[i] / m;
+      ops_type::divide(o._M_val, _M_val, m);
 
 #ifdef USE_DEBUG
       assert(S_EQ(o.compute_mag(), S_LITERAL(1.0)));
 #endif
-#ifdef SPT_VECT_CACHE_MAGNITUDE
-      o._M_mag_cached = o._M_mag2_cached = S_LITERAL(1.0);
-      o._M_recalc_mag = o._M_recalc_mag2 = false;
-#endif
+      o.mag_cache().known(S_LITERAL(1.0), S_LITERAL(1.0));
 
       return o;
     }
@@ -285,7 +342,7 @@ namespace spt
     /** @bug Possible buffer overflow for template parameter _N
      *	greater than BUFSIZ.  Unlikely, but possible.
      */
-    inline const char*
+    const char*
     to_s() const
     {
       unsigned int i;
@@ -317,16 +374,15 @@ namespace spt
     }
 
 
-    inline value_type
+    constexpr value_type
     operator[](const size_type vn) const
     {
-      if ( vn < _N )
-	return const_cast<value_type&>(_M_val[vn]);
-      else
-	throw std::out_of_range("Bad index in access operator [] !");
+      return vn < _N
+	? _M_val[vn]
+	: throw std::out_of_range("Bad index in access operator [] !");
     }
 
-    inline bool
+    bool
     operator==(const Vec& r) const
     {
       if ( std::is_floating_point<value_type>::value )
@@ -353,116 +409,77 @@ namespace spt
       return !operator==(r);
     }
 
-    inline Vec
-    operator+(const Vec& r) const
-    {
-      Vec out (*this);
-      out += r;
-
-      return out;
-    }
-
     inline Vec&
     operator+=(const Vec& r)
     {
-      for ( size_type i = 0; i < _N; ++i )
-	_M_val[i] += r._M_val[i];
+      ops_type::add(_M_val, _M_val, r._M_val);
 
-#ifdef SPT_VECT_CACHE_MAGNITUDE
-      _M_recalc_mag = _M_recalc_mag2 = true;
-#endif
+      mag_cache().invalidate();
       return *this;
     }
 
 
-    inline Vec
-    operator-() const
-    {
-      Vec o ( *this );
-
-      for ( size_type i = 0; i < _N; ++i )
-	o._M_val[i] = -_M_val[i];
-
-      return o;
-    }
-
-
-
-    inline Vec
-    operator-(const Vec& r) const
-    {
-      Vec o ( *this );
-      o -= r;
-
-      return o;
-    }
-
-
     inline Vec&
     operator-=(const Vec& r)
     {
-      for ( size_type i = 0; i < _N; ++i )
-	_M_val[i] -= r._M_val[i];
+      ops_type::sub(_M_val, _M_val, r._M_val);
 
-#ifdef SPT_VECT_CACHE_MAGNITUDE
-      _M_recalc_mag = _M_recalc_mag2 = true;
-#endif
+      mag_cache().invalidate();
       return *this;
     }
 
 
-    inline Vec
-    operator*(value_type r) const
-    {
-      Vec out ( *this );
-      out *= r;
-      return out;
-    }
-
     inline Vec&
     operator*=(value_type r)
     {
-      for ( size_type i = 0; i < _N; ++i )
-	_M_val[i] *= r;
+      ops_type::scale(_M_val, _M_val, r);
 
-#ifdef SPT_VECT_CACHE_MAGNITUDE
-      _M_recalc_mag = _M_recalc_mag2 = true;
-#endif
+      mag_cache().invalidate();
       return *this;
     }
 
 
 
-    inline Vec
-    operator/(value_type r) const
+    inline Vec&
+    operator/=(value_type r)
     {
-      Vec o ( *this );
-      o /= r;
+      ops_type::divide(_M_val, _M_val, r);
 
-      return o;
+      mag_cache().invalidate();
+      return *this;
     }
 
+
+    /** Add @p r scaled by @p s to this vector, as a single fused
+     *	operation: <code>*this += r * s</code>.
+     */
     inline Vec&
-    operator/=(value_type r)
+    madd(const Vec& r, value_type s)
     {
-      for ( size_type i = 0; i < _N; ++i )
-	_M_val[i] /= r;
+      ops_type::madd(_M_val, _M_val, r._M_val, s);
 
-#ifdef SPT_VECT_CACHE_MAGNITUDE
-      _M_recalc_mag = _M_recalc_mag2 = true;
-#endif
+      mag_cache().invalidate();
       return *this;
     }
 
-
-    inline value_type
+    constexpr value_type
     dot(const Vec& r) const
     {
-      value_type o(0);
-      for ( size_type i = 0; i < _N; ++i )
-	o += _M_val[i] * r._M_val[i];
+      return SPT_VEC_CONSTANT_EVALUATED()
+	? vec_simd::scalar_ops<_N, _ValueType>::dot(_M_val, r._M_val)
+	: ops_type::dot(_M_val, r._M_val);
+    }
 
-      return o;
+    /** Cross product; three-component vectors only. */
+    constexpr Vec
+    cross(const Vec& r) const
+    {
+      /* Same arithmetic as vec_simd::scalar_ops::cross. */
+      return SPT_VEC_CONSTANT_EVALUATED()
+	? Vec(vec_simd::fmadd(_M_val[1], r._M_val[2], -( _M_val[2] * r._M_val[1] )),
+	      vec_simd::fmadd(_M_val[2], r._M_val[0], -( _M_val[0] * r._M_val[2] )),
+	      vec_simd::fmadd(_M_val[0], r._M_val[1], -( _M_val[1] * r._M_val[0] )))
+	: cross_simd(r);
     }
 
     template < typename _VectorType >
@@ -476,10 +493,10 @@ namespace spt
     }
 
 
-    inline const value_type*
+    constexpr const value_type*
     val() const
     {
-      return const_cast<value_type*>(_M_val);
+      return _M_val;
     }
 
     inline bool
@@ -532,23 +549,49 @@ namespace spt
         }
       return false;
     }
-  };
 
-  template < size_t _N = 3, typename _ValueType, typename _FactorType >
-  spt::Vec<_N, _ValueType>
-  operator*(const _FactorType s, const spt::Vec<_N, _ValueType>& v)
-  {
-    /* static_assert(std::is_arithmetic<_FactorType>::value, "Invalid coefficient type for vector multiplication"); */
-    return v * s;
-  }
+  private:
+    /** Initialize the components from @p e, and the magnitude cache
+     *	from @p c.
+     */
+    template < typename _Expr, size_t... _I >
+    constexpr
+    Vec(const mag_cache_type& c, const _Expr& e, vec_detail::indices<_I...>)
+      : mag_cache_type ( c ),
+	_M_val { e.eval(_I)... }
+    {
+    }
+
+    inline Vec
+    cross_simd(const Vec& r) const
+    {
+      Vec o;
+      ops_type::cross(o._M_val, _M_val, r._M_val);
+      o.mag_cache().invalidate();
+      return o;
+    }
+
+    /** Store the value of @p e.  Padding lanes are computed too, which
+     *	lets the loop compile to whole-register operations.
+     */
+    template < typename _Expr >
+    inline void
+    assign(const _Expr& e)
+    {
+      static_assert(_Expr::N == _N && std::is_same<typename _Expr::value_type, value_type>::value,
+		    "Vec expression has a different dimension or value type");
+      for ( size_type i ( 0 ); i < _Expr::lanes; ++i )
+	_M_val[i] = e.eval(i);
+    }
+  };
 }
 #include <ostream>
 
 /**  Shift-append operator for output of an spt::Vec<_N> to an STL stream.
  */
-template < size_t _N, typename _ValueType >
+template < size_t _N, typename _ValueType, typename _MagCache >
 std::basic_ostream<char>&
-operator << (std::basic_ostream<char>& os, const spt::Vec<_N, _ValueType>& v)
+operator << (std::basic_ostream<char>& os, const spt::Vec<_N, _ValueType, _MagCache>& v)
 {
   os << "{ " << v[0];
   for ( size_t i = 1; i < _N; ++i )
@@ -556,10 +599,20 @@ operator << (std::basic_ostream<char>& os, const spt::Vec<_N, _ValueType>& v)
   return ( os << " }" );
 }
 
+/**  Shift-append operator for output of the value of an spt::Vec
+ *   expression.
+ */
+template < typename _Expr >
+typename std::enable_if<spt::vec_expr::is_expression<_Expr>::value, std::basic_ostream<char>&>::type
+operator << (std::basic_ostream<char>& os, const _Expr& e)
+{
+  return os << typename _Expr::vec_type(e);
+}
+
 namespace std
 {
-  template < size_t _N, typename _ValueType >
-  struct is_array<spt::Vec<_N, _ValueType> > : std::true_type {};
+  template < size_t _N, typename _ValueType, typename _MagCache >
+  struct is_array<spt::Vec<_N, _ValueType, _MagCache> > : std::true_type {};
 }
 
 #endif	/* Vec_hh */
@@ -0,0 +1,512 @@
+/**@file
+ *
+ * Structure-of-arrays storage and batch operations for spt::Vec.
+ */
+#ifndef support_VecArray_hh
+#define support_VecArray_hh 1
+
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <utility>
+
+#include <support/Vec.hh>
+
+namespace spt
+{
+  /** Array of @p _N-component vectors stored as one contiguous array
+   *  per component ("structure of arrays").
+   *
+   * Unlike <code>std::vector< Vec<_N> ></code>, elements carry no
+   * cached magnitudes and the components of consecutive elements are
+   * adjacent, so the batch operations below compile to SIMD loops.
+   * Each component array starts on an @c alignment boundary.
+   *
+   * Elements are read as Vec values and written through a small proxy;
+   * component() gives direct access to the arrays.
+   */
+  template < size_t _N, typename _ValueType = scalar_t >
+  class VecArray
+  {
+  public:
+    typedef _ValueType value_type;
+    typedef size_t size_type;
+    typedef Vec<_N, _ValueType> vec_type;
+
+    static const size_type N = _N;
+
+    /** Alignment, in bytes, of each component array. */
+    static constexpr size_type alignment = 64;
+
+    /** Writable view of one element. */
+    class reference
+    {
+    public:
+      inline operator vec_type() const
+      {
+	return m_array->get(m_index);
+      }
+
+      inline reference&
+      operator = (const vec_type& v)
+      {
+	m_array->set(m_index, v);
+	return *this;
+      }
+
+      inline reference&
+      operator = (const reference& r)
+      {
+	return operator = (static_cast<vec_type>(r));
+      }
+
+      /** Component @p k of the element. */
+      inline value_type&
+      operator [] (size_type k) const
+      {
+	return m_array->component(k)[m_index];
+      }
+
+    private:
+      friend class VecArray;
+
+      inline reference(VecArray* array, size_type index)
+	: m_array ( array ),
+	  m_index ( index )
+      {
+      }
+
+      VecArray* m_array;
+      size_type m_index;
+    };
+
+    inline VecArray()
+      : m_data ( NULL ),
+	m_size ( 0 ),
+	m_stride ( 0 )
+    {
+    }
+
+    /** Construct an array of @p n zero vectors. */
+    explicit inline VecArray(size_type n)
+      : m_data ( NULL ),
+	m_size ( 0 ),
+	m_stride ( 0 )
+    {
+      resize(n);
+    }
+
+    inline VecArray(const VecArray& a)
+      : m_data ( NULL ),
+	m_size ( 0 ),
+	m_stride ( 0 )
+    {
+      *this = a;
+    }
+
+    inline VecArray(VecArray&& a)
+      : m_data ( a.m_data ),
+	m_size ( a.m_size ),
+	m_stride ( a.m_stride )
+    {
+      a.m_data = NULL;
+      a.m_size = a.m_stride = 0;
+    }
+
+    inline ~VecArray()
+    {
+      free(m_data);
+    }
+
+    inline VecArray&
+    operator = (const VecArray& a)
+    {
+      if ( this != &a )
+	{
+	  m_size = 0;
+	  reserve(a.m_size);
+	  for ( size_type k ( 0 ); k < _N; ++k )
+	    if ( a.m_size > 0 )
+	      memcpy(component(k), a.component(k), a.m_size * sizeof(value_type));
+	  m_size = a.m_size;
+	}
+      return *this;
+    }
+
+    inline VecArray&
+    operator = (VecArray&& a)
+    {
+      std::swap(m_data, a.m_data);
+      std::swap(m_size, a.m_size);
+      std::swap(m_stride, a.m_stride);
+      return *this;
+    }
+
+    inline size_type
+    size() const { return m_size; }
+
+    inline bool
+    empty() const { return m_size == 0; }
+
+    /** Number of elements the array can hold without reallocating. */
+    inline size_type
+    capacity() const { return m_stride; }
+
+    /** Pointer to the (aligned) array of component @p k. */
+    inline value_type*
+    component(size_type k)
+    {
+      return static_cast<value_type*>(__builtin_assume_aligned(m_data + k * m_stride, alignment));
+    }
+
+    inline const value_type*
+    component(size_type k) const
+    {
+      return static_cast<const value_type*>(__builtin_assume_aligned(m_data + k * m_stride, alignment));
+    }
+
+    /** Get element @p i as a Vec. */
+    vec_type
+    get(size_type i) const
+    {
+      value_type v[_N];
+      for ( size_type k ( 0 ); k < _N; ++k )
+	v[k] = component(k)[i];
+      return vec_type(static_cast<const value_type*>(v));
+    }
+
+    inline void
+    set(size_type i, const vec_type& v)
+    {
+      for ( size_type k ( 0 ); k < _N; ++k )
+	component(k)[i] = v.val()[k];
+    }
+
+    inline vec_type
+    operator [] (size_type i) const
+    {
+      return get(i);
+    }
+
+    inline reference
+    operator [] (size_type i)
+    {
+      return reference(this, i);
+    }
+
+    inline void
+    push_back(const vec_type& v)
+    {
+      if ( m_size == m_stride )
+	reserve(m_stride > 0 ? m_stride * 2 : alignment / sizeof(value_type));
+      set(m_size++, v);
+    }
+
+    /** Ensure room for @p n elements.
+     *
+     * @throws std::bad_alloc if memory is exhausted.
+     */
+    void
+    reserve(size_type n)
+    {
+      if ( n <= m_stride )
+	return;
+
+      /* Round each component array up to a whole number of aligned
+	 blocks, so that every one of them starts aligned. */
+      const size_type per_block ( alignment / sizeof(value_type) );
+      size_type stride ( ( n + per_block - 1 ) / per_block * per_block );
+
+      void* p;
+      if ( posix_memalign(&p, alignment, _N * stride * sizeof(value_type)) != 0 )
+	throw std::bad_alloc();
+      value_type* data ( static_cast<value_type*>(p) );
+      if ( m_size > 0 )
+	for ( size_type k ( 0 ); k < _N; ++k )
+	  memcpy(data + k * stride, component(k), m_size * sizeof(value_type));
+
+      free(m_data);
+      m_data = data;
+      m_stride = stride;
+    }
+
+    /** Change the number of elements to @p n; new elements are zero. */
+    void
+    resize(size_type n)
+    {
+      reserve(n);
+      if ( n > m_size )
+	for ( size_type k ( 0 ); k < _N; ++k )
+	  memset(component(k) + m_size, 0, ( n - m_size ) * sizeof(value_type));
+      m_size = n;
+    }
+
+    inline void
+    clear() { m_size = 0; }
+
+  private:
+    value_type* m_data;
+    size_type m_size;
+
+    /** Distance, in elements, between consecutive component arrays. */
+    size_type m_stride;
+  };
+
+  namespace vec_array_detail
+  {
+    /**@name Square-root loops
+     *
+     * GCC only vectorizes sqrt where it need not set @c errno, so the
+     * float and double versions live in a source file built with
+     * -fno-math-errno (their arguments are sums of squares, for which
+     * errno would never be set anyway).
+     *@{
+     */
+    /** <code>x[i] = sqrt(x[i])</code> */
+    void
+    sqrt_n(float* x, size_t n);
+
+    void
+    sqrt_n(double* x, size_t n);
+
+    template < typename _T >
+    inline void
+    sqrt_n(_T* x, size_t n)
+    {
+      for ( size_t i ( 0 ); i < n; ++i )
+	x[i] = std::sqrt(x[i]);
+    }
+
+    /** <code>x[i] = 1 / sqrt(x[i])</code>, or 1 where
+     *	<code>sqrt(x[i]) < slop</code>.
+     */
+    void
+    inverse_sqrt_n(float* x, size_t n, float slop);
+
+    void
+    inverse_sqrt_n(double* x, size_t n, double slop);
+
+    template < typename _T >
+    inline void
+    inverse_sqrt_n(_T* x, size_t n, _T slop)
+    {
+      for ( size_t i ( 0 ); i < n; ++i )
+	{
+	  _T mag ( std::sqrt(x[i]) );
+	  x[i] = mag < slop ? static_cast<_T>(1) : static_cast<_T>(1) / mag;
+	}
+    }
+    /**@}*/
+  }
+
+  /**@name VecArray batch operations
+   *
+   * Element-wise operations over whole arrays.  Output arrays are
+   * resized to match the input, and may be the same object as an
+   * input; plain output buffers must hold size() values.
+   *@{
+   */
+
+  /** <code>out[i] = a[i] + b[i]</code>
+   *
+   * @pre <code>a.size() == b.size()</code>
+   */
+  template < size_t _N, typename _T >
+  void
+  add(const VecArray<_N,_T>& a, const VecArray<_N,_T>& b, VecArray<_N,_T>& out)
+  {
+    size_t n ( a.size() );
+    out.resize(n);
+    for ( size_t k ( 0 ); k < _N; ++k )
+      {
+	const _T *x ( a.component(k) ), *y ( b.component(k) );
+	_T* o ( out.component(k) );
+	for ( size_t i ( 0 ); i < n; ++i )
+	  o[i] = x[i] + y[i];
+      }
+  }
+
+  /** <code>out[i] = a[i] * s</code> */
+  template < size_t _N, typename _T >
+  void
+  scale(const VecArray<_N,_T>& a, _T s, VecArray<_N,_T>& out)
+  {
+    size_t n ( a.size() );
+    out.resize(n);
+    for ( size_t k ( 0 ); k < _N; ++k )
+      {
+	const _T* x ( a.component(k) );
+	_T* o ( out.component(k) );
+	for ( size_t i ( 0 ); i < n; ++i )
+	  o[i] = x[i] * s;
+      }
+  }
+
+  /** <code>out[i] = a[i].dot(b[i])</code>
+   *
+   * @pre <code>a.size() == b.size()</code>
+   */
+  template < size_t _N, typename _T >
+  void
+  dot(const VecArray<_N,_T>& a, const VecArray<_N,_T>& b, _T* out)
+  {
+    size_t n ( a.size() );
+    for ( size_t i ( 0 ); i < n; ++i )
+      out[i] = 0;
+    for ( size_t k ( 0 ); k < _N; ++k )
+      {
+	const _T *x ( a.component(k) ), *y ( b.component(k) );
+	for ( size_t i ( 0 ); i < n; ++i )
+	  out[i] += x[i] * y[i];
+      }
+  }
+
+  /** <code>out[i] = a[i] &times; b[i]</code>, for three-component
+   *  vectors.
+   *
+   * @pre <code>a.size() == b.size()</code>, and @p out is neither @p a
+   * nor @p b.
+   */
+  template < typename _T >
+  void
+  cross(const VecArray<3,_T>& a, const VecArray<3,_T>& b, VecArray<3,_T>& out)
+  {
+    size_t n ( a.size() );
+    out.resize(n);
+    const _T
+      *ax ( a.component(0) ), *ay ( a.component(1) ), *az ( a.component(2) ),
+      *bx ( b.component(0) ), *by ( b.component(1) ), *bz ( b.component(2) );
+    _T *ox ( out.component(0) ), *oy ( out.component(1) ), *oz ( out.component(2) );
+    for ( size_t i ( 0 ); i < n; ++i )
+      {
+	_T x ( ay[i] * bz[i] - az[i] * by[i] );
+	_T y ( az[i] * bx[i] - ax[i] * bz[i] );
+	_T z ( ax[i] * by[i] - ay[i] * bx[i] );
+	ox[i] = x;
+	oy[i] = y;
+	oz[i] = z;
+      }
+  }
+
+  /** <code>out[i] = a[i].mag()</code> */
+  template < size_t _N, typename _T >
+  void
+  magnitude(const VecArray<_N,_T>& a, _T* out)
+  {
+    dot(a, a, out);
+    vec_array_detail::sqrt_n(out, a.size());
+  }
+
+  /** Scale each element of @p a to unit length, in place.  As with
+   *  Vec::normalize, elements shorter than @c S_SLOP are left
+   *  unchanged.
+   */
+  template < size_t _N, typename _T >
+  void
+  normalize(VecArray<_N,_T>& a)
+  {
+    size_t n ( a.size() );
+    const size_t block ( 256 );
+    _T inv[block];
+
+    /* Work in cache-sized blocks so the reciprocals stay in L1. */
+    for ( size_t start ( 0 ); start < n; start += block )
+      {
+	size_t m ( n - start < block ? n - start : block );
+	for ( size_t i ( 0 ); i < m; ++i )
+	  inv[i] = 0;
+	for ( size_t k ( 0 ); k < _N; ++k )
+	  {
+	    const _T* x ( a.component(k) + start );
+	    for ( size_t i ( 0 ); i < m; ++i )
+	      inv[i] += x[i] * x[i];
+	  }
+	vec_array_detail::inverse_sqrt_n(inv, m, static_cast<_T>(S_SLOP));
+	for ( size_t k ( 0 ); k < _N; ++k )
+	  {
+	    _T* x ( a.component(k) + start );
+	    for ( size_t i ( 0 ); i < m; ++i )
+	      x[i] *= inv[i];
+	  }
+      }
+  }
+
+  /** Component-wise minimum and maximum over all elements (the
+   *  bounding box of a point set).
+   *
+   * @pre <code>! a.empty()</code>
+   */
+  template < size_t _N, typename _T >
+  void
+  bounds(const VecArray<_N,_T>& a, Vec<_N,_T>& lo, Vec<_N,_T>& hi)
+  {
+    size_t n ( a.size() );
+    _T l[_N], h[_N];
+    for ( size_t k ( 0 ); k < _N; ++k )
+      {
+	/* A min/max reduction only vectorizes as such with
+	   -ffinite-math-only; keep independent running values per lane
+	   instead, which vectorize as plain element-wise operations. */
+	const size_t lanes ( 32 / sizeof(_T) > 0 ? 32 / sizeof(_T) : 1 );
+	const _T* x ( a.component(k) );
+	_T mn[lanes], mx[lanes];
+	for ( size_t j ( 0 ); j < lanes; ++j )
+	  mn[j] = mx[j] = x[0];
+
+	size_t i ( 0 );
+	for ( ; i + lanes <= n; i += lanes )
+	  for ( size_t j ( 0 ); j < lanes; ++j )
+	    {
+	      mn[j] = x[i + j] < mn[j] ? x[i + j] : mn[j];
+	      mx[j] = x[i + j] > mx[j] ? x[i + j] : mx[j];
+	    }
+	for ( ; i < n; ++i )
+	  {
+	    mn[0] = x[i] < mn[0] ? x[i] : mn[0];
+	    mx[0] = x[i] > mx[0] ? x[i] : mx[0];
+	  }
+
+	l[k] = mn[0];
+	h[k] = mx[0];
+	for ( size_t j ( 1 ); j < lanes; ++j )
+	  {
+	    l[k] = mn[j] < l[k] ? mn[j] : l[k];
+	    h[k] = mx[j] > h[k] ? mx[j] : h[k];
+	  }
+      }
+    lo = Vec<_N,_T>(static_cast<const _T*>(l));
+    hi = Vec<_N,_T>(static_cast<const _T*>(h));
+  }
+
+  /** Component-wise minimum over all elements.
+   *
+   * @pre <code>! a.empty()</code>
+   */
+  template < size_t _N, typename _T >
+  Vec<_N,_T>
+  min(const VecArray<_N,_T>& a)
+  {
+    Vec<_N,_T> lo, hi;
+    bounds(a, lo, hi);
+    return lo;
+  }
+
+  /** Component-wise maximum over all elements.
+   *
+   * @pre <code>! a.empty()</code>
+   */
+  template < size_t _N, typename _T >
+  Vec<_N,_T>
+  max(const VecArray<_N,_T>& a)
+  {
+    Vec<_N,_T> lo, hi;
+    bounds(a, lo, hi);
+    return hi;
+  }
+  /**@}*/
+}
+
+#endif	/* support_VecArray_hh */
@@ -0,0 +1,376 @@
+/**@file
+ *
+ * Expression templates for spt::Vec arithmetic.
+ */
+#ifndef support_VecExpr_hh
+#define support_VecExpr_hh 1
+
+#include <cstddef>
+#include <type_traits>
+
+#include <support/VecMagCache.hh>
+#include <support/VecSIMD.hh>
+
+namespace spt
+{
+  template < size_t _N, typename _ValueType, typename _MagCache >
+  class Vec;
+
+  /** Base of the objects built by Vec arithmetic operators.
+   *
+   * Evaluating <code>a + b * s - c</code> for Vecs @c a, @c b and @c c
+   * does no arithmetic: it builds a small object that refers to the
+   * operands.  The sum is computed when the expression is assigned to
+   * a Vec (or used to construct one), in a single loop over the
+   * components and without intermediate Vec objects.
+   *
+   * Expressions refer to their Vec operands, so don't keep them past
+   * the end of the full expression that creates them (e.g. with
+   * @c auto); use eval() or assign them to a Vec instead.
+   */
+  template < typename _Derived, size_t _N, typename _ValueType >
+  struct VecExpr
+  {
+    typedef _ValueType value_type;
+    typedef Vec<_N, _ValueType, DefaultMagCache> vec_type;
+
+    /** Marks expression types; see vec_expr::is_expression. */
+    typedef void vec_expression_tag;
+
+    static const size_t N = _N;
+
+    /** Number of elements computed when evaluating the expression;
+     *	those past @c N are padding (see vec_simd::layout).
+     */
+    static const size_t lanes = vec_simd::layout<_N, _ValueType>::lanes;
+
+    constexpr const _Derived&
+    derived() const
+    {
+      return static_cast<const _Derived&>(*this);
+    }
+
+    /** Component @p i of the result. */
+    constexpr value_type
+    operator [] (size_t i) const
+    {
+      return derived().eval(i);
+    }
+
+    /** Evaluate the expression into a Vec. */
+    constexpr vec_type
+    eval() const
+    {
+      return vec_type(derived());
+    }
+
+    /**@name Vec operations on the result
+     *
+     * These evaluate the expression first.
+     *@{
+     */
+    constexpr value_type dot(const vec_type& r) const { return eval().dot(r); }
+    constexpr vec_type cross(const vec_type& r) const { return eval().cross(r); }
+    inline value_type mag() const { return eval().compute_mag(); }
+    constexpr value_type mag2() const { return eval().compute_mag2(); }
+    inline vec_type unit() const { return eval().unit(); }
+    bool isFinite() const { return eval().isFinite(); }
+    bool hasNaN() const { return eval().hasNaN(); }
+    bool hasInfinite() const { return eval().hasInfinite(); }
+    const char* to_s() const { return eval().to_s(); }
+    /**@}*/
+  };
+
+  namespace vec_expr
+  {
+    /** Whether @p _T is a VecExpr. */
+    template < typename _T, typename = void >
+    struct is_expression
+      : std::false_type
+    {
+    };
+
+    template < typename _T >
+    struct is_expression<_T, typename _T::vec_expression_tag>
+      : std::true_type
+    {
+    };
+
+    /** Whether @p _T can be an operand of a Vec expression. */
+    template < typename _T >
+    struct is_operand
+      : is_expression<_T>
+    {
+    };
+
+    template < size_t _N, typename _T, typename _C >
+    struct is_operand< Vec<_N, _T, _C> >
+      : std::true_type
+    {
+    };
+
+
+    /** A Vec operand. */
+    template < size_t _N, typename _T >
+    struct Leaf
+      : VecExpr<Leaf<_N, _T>, _N, _T>
+    {
+      explicit constexpr Leaf(const _T* p)
+	: m_p ( p )
+      {
+      }
+
+      constexpr _T eval(size_t i) const { return m_p[i]; }
+
+      const _T* m_p;
+    };
+
+    /** Expression node type for an operand of type @p _T: Vecs are
+     *	wrapped in a Leaf, and expressions stand for themselves.
+     */
+    template < typename _T >
+    struct operand
+    {
+      typedef _T type;
+      static constexpr const _T& make(const _T& e) { return e; }
+    };
+
+    template < size_t _N, typename _T, typename _C >
+    struct operand< Vec<_N, _T, _C> >
+    {
+      typedef Leaf<_N, _T> type;
+      static constexpr type make(const Vec<_N, _T, _C>& v) { return type(v.val()); }
+    };
+
+
+    /**@name Element operations
+     *@{
+     */
+    struct add { template < typename _T > static constexpr _T apply(_T a, _T b) { return a + b; } };
+    struct sub { template < typename _T > static constexpr _T apply(_T a, _T b) { return a - b; } };
+    struct mul { template < typename _T > static constexpr _T apply(_T a, _T b) { return a * b; } };
+    struct div { template < typename _T > static constexpr _T apply(_T a, _T b) { return a / b; } };
+    /**@}*/
+
+    /** Element-wise operation on two vector expressions. */
+    template < typename _Op, typename _L, typename _R >
+    struct Binary
+      : VecExpr<Binary<_Op, _L, _R>, _L::N, typename _L::value_type>
+    {
+      typedef typename _L::value_type value_type;
+
+      static_assert(_L::N == _R::N && std::is_same<value_type, typename _R::value_type>::value,
+		    "Vec expression operands must have the same dimension and value type");
+
+      constexpr Binary(const _L& l, const _R& r)
+	: m_l ( l ),
+	  m_r ( r )
+      {
+      }
+
+      constexpr value_type
+      eval(size_t i) const
+      {
+	return _Op::apply(m_l.eval(i), m_r.eval(i));
+      }
+
+      _L m_l;
+      _R m_r;
+    };
+
+    /** Operation between each element of a vector expression and a
+     *	scalar.
+     */
+    template < typename _Op, typename _L >
+    struct Scalar
+      : VecExpr<Scalar<_Op, _L>, _L::N, typename _L::value_type>
+    {
+      typedef typename _L::value_type value_type;
+
+      constexpr Scalar(const _L& l, value_type s)
+	: m_l ( l ),
+	  m_s ( s )
+      {
+      }
+
+      constexpr value_type
+      eval(size_t i) const
+      {
+	return _Op::apply(m_l.eval(i), m_s);
+      }
+
+      _L m_l;
+      value_type m_s;
+    };
+
+    template < typename _L >
+    struct Negate
+      : VecExpr<Negate<_L>, _L::N, typename _L::value_type>
+    {
+      typedef typename _L::value_type value_type;
+
+      explicit constexpr Negate(const _L& l)
+	: m_l ( l )
+      {
+      }
+
+      constexpr value_type eval(size_t i) const { return -m_l.eval(i); }
+
+      _L m_l;
+    };
+
+
+    /** Result types of the operators below; empty, so that the
+     *	operators drop out of overload resolution, for other operands.
+     */
+    template < typename _Op, typename _L, typename _R, typename = void >
+    struct binary_result
+    {
+    };
+
+    template < typename _Op, typename _L, typename _R >
+    struct binary_result<_Op, _L, _R,
+			 typename std::enable_if<is_operand<_L>::value && is_operand<_R>::value>::type>
+    {
+      typedef Binary<_Op, typename operand<_L>::type, typename operand<_R>::type> type;
+    };
+
+    template < typename _Op, typename _L, typename _S, typename = void >
+    struct scalar_result
+    {
+    };
+
+    template < typename _Op, typename _L, typename _S >
+    struct scalar_result<_Op, _L, _S,
+			 typename std::enable_if<is_operand<_L>::value && std::is_arithmetic<_S>::value>::type>
+    {
+      typedef Scalar<_Op, typename operand<_L>::type> type;
+    };
+
+    template < typename _L, typename = void >
+    struct negate_result
+    {
+    };
+
+    template < typename _L >
+    struct negate_result<_L, typename std::enable_if<is_operand<_L>::value>::type>
+    {
+      typedef Negate<typename operand<_L>::type> type;
+    };
+
+    /** Result type of the comparison operators below: @c bool when
+     *	either operand is an expression (Vecs compare themselves).
+     */
+    template < typename _L, typename _R, typename = void >
+    struct comparison_result
+    {
+    };
+
+    template < typename _L, typename _R >
+    struct comparison_result<_L, _R,
+			     typename std::enable_if<is_operand<_L>::value && is_operand<_R>::value
+						     && ( is_expression<_L>::value
+							  || is_expression<_R>::value )>::type>
+    {
+      typedef bool type;
+    };
+
+    /** A Vec operand itself, or an expression evaluated into a Vec. */
+    template < size_t _N, typename _T, typename _C >
+    constexpr const Vec<_N, _T, _C>&
+    evaluate(const Vec<_N, _T, _C>& v)
+    {
+      return v;
+    }
+
+    template < typename _E >
+    constexpr typename std::enable_if<is_expression<_E>::value, typename _E::vec_type>::type
+    evaluate(const _E& e)
+    {
+      return typename _E::vec_type(e);
+    }
+  }
+
+  /**@name Vec expression operators
+   *
+   * Operands may be Vecs or expressions.
+   *@{
+   */
+  template < typename _L, typename _R >
+  constexpr typename vec_expr::binary_result<vec_expr::add, _L, _R>::type
+  operator + (const _L& l, const _R& r)
+  {
+    return typename vec_expr::binary_result<vec_expr::add, _L, _R>::type
+      (vec_expr::operand<_L>::make(l), vec_expr::operand<_R>::make(r));
+  }
+
+  template < typename _L, typename _R >
+  constexpr typename vec_expr::binary_result<vec_expr::sub, _L, _R>::type
+  operator - (const _L& l, const _R& r)
+  {
+    return typename vec_expr::binary_result<vec_expr::sub, _L, _R>::type
+      (vec_expr::operand<_L>::make(l), vec_expr::operand<_R>::make(r));
+  }
+
+  template < typename _L >
+  constexpr typename vec_expr::negate_result<_L>::type
+  operator - (const _L& l)
+  {
+    return typename vec_expr::negate_result<_L>::type(vec_expr::operand<_L>::make(l));
+  }
+
+  template < typename _L, typename _S >
+  constexpr typename vec_expr::scalar_result<vec_expr::mul, _L, _S>::type
+  operator * (const _L& l, _S s)
+  {
+    typedef typename vec_expr::scalar_result<vec_expr::mul, _L, _S>::type result_type;
+    return result_type(vec_expr::operand<_L>::make(l), static_cast<typename result_type::value_type>(s));
+  }
+
+  template < typename _S, typename _R >
+  constexpr typename vec_expr::scalar_result<vec_expr::mul, _R, _S>::type
+  operator * (_S s, const _R& r)
+  {
+    typedef typename vec_expr::scalar_result<vec_expr::mul, _R, _S>::type result_type;
+    return result_type(vec_expr::operand<_R>::make(r), static_cast<typename result_type::value_type>(s));
+  }
+
+  template < typename _L, typename _S >
+  constexpr typename vec_expr::scalar_result<vec_expr::div, _L, _S>::type
+  operator / (const _L& l, _S s)
+  {
+    typedef typename vec_expr::scalar_result<vec_expr::div, _L, _S>::type result_type;
+    return result_type(vec_expr::operand<_L>::make(l), static_cast<typename result_type::value_type>(s));
+  }
+  /**@}*/
+
+  /**@name Vec expression comparisons
+   *
+   * Compare the values of expressions (with Vecs or each other), as
+   * the Vec operators do.
+   *@{
+   */
+  template < typename _L, typename _R >
+  typename vec_expr::comparison_result<_L, _R>::type
+  operator == (const _L& l, const _R& r)
+  {
+    return vec_expr::evaluate(l) == vec_expr::evaluate(r);
+  }
+
+  template < typename _L, typename _R >
+  typename vec_expr::comparison_result<_L, _R>::type
+  operator != (const _L& l, const _R& r)
+  {
+    return vec_expr::evaluate(l) != vec_expr::evaluate(r);
+  }
+
+  template < typename _L, typename _R >
+  typename vec_expr::comparison_result<_L, _R>::type
+  operator < (const _L& l, const _R& r)
+  {
+    return vec_expr::evaluate(l) < vec_expr::evaluate(r);
+  }
+  /**@}*/
+}
+
+#endif	/* support_VecExpr_hh */
@@ -0,0 +1,133 @@
+/**@file
+ *
+ * Magnitude-cache policies for spt::Vec.
+ */
+#ifndef support_VecMagCache_hh
+#define support_VecMagCache_hh 1
+
+#include <support/support-config.h>
+
+namespace spt
+{
+  /** Vec policy that remembers the last computed magnitude and squared
+   *  magnitude, at the cost of two values and two flags per vector and
+   *  a flag update on every change.  Suits long-lived vectors whose
+   *  magnitude is asked for repeatedly.
+   */
+  struct MagCache
+  {
+    template < typename _T >
+    class cache
+    {
+    public:
+      constexpr cache()
+	: m_mag ( 0 ),
+	  m_mag2 ( 0 ),
+	  m_have_mag ( false ),
+	  m_have_mag2 ( false )
+      {
+      }
+
+      /** Start out with known magnitudes. */
+      constexpr cache(_T mag, _T mag2)
+	: m_mag ( mag ),
+	  m_mag2 ( mag2 ),
+	  m_have_mag ( true ),
+	  m_have_mag2 ( true )
+      {
+      }
+
+      /** Forget the cached values; called whenever the vector changes. */
+      inline void
+      invalidate() const
+      {
+	m_have_mag = m_have_mag2 = false;
+      }
+
+      /** Record magnitudes known without computing them (e.g. 1 after
+       *	normalizing).
+       */
+      inline void
+      known(_T mag, _T mag2) const
+      {
+	m_mag = mag;
+	m_mag2 = mag2;
+	m_have_mag = m_have_mag2 = true;
+      }
+
+      /** Get the cached magnitude into @p out.
+       *
+       * @return @c false, leaving @p out unchanged, if there is none.
+       */
+      inline bool
+      get_mag(_T& out) const
+      {
+	if ( m_have_mag )
+	  out = m_mag;
+	return m_have_mag;
+      }
+
+      inline bool
+      get_mag2(_T& out) const
+      {
+	if ( m_have_mag2 )
+	  out = m_mag2;
+	return m_have_mag2;
+      }
+
+      inline void
+      put_mag(_T mag) const
+      {
+	m_mag = mag;
+	m_have_mag = true;
+      }
+
+      inline void
+      put_mag2(_T mag2) const
+      {
+	m_mag2 = mag2;
+	m_have_mag2 = true;
+      }
+
+    private:
+      mutable _T m_mag;
+      mutable _T m_mag2;
+      mutable bool m_have_mag;
+      mutable bool m_have_mag2;
+    };
+  };
+
+  /** Vec policy that computes magnitudes on every request.  Adds
+   *  nothing to the size of a vector or to the cost of changing it,
+   *  which suits vectors kept in bulk or used in tight loops.
+   */
+  struct NoMagCache
+  {
+    template < typename _T >
+    class cache
+    {
+    public:
+      constexpr cache() { }
+      constexpr cache(_T, _T) { }
+
+      inline void invalidate() const { }
+      inline void known(_T, _T) const { }
+      inline bool get_mag(_T&) const { return false; }
+      inline bool get_mag2(_T&) const { return false; }
+      inline void put_mag(_T) const { }
+      inline void put_mag2(_T) const { }
+    };
+  };
+
+  /** Policy used by Vec unless another is given: MagCache if the
+   *  library was configured with SPT_VECT_CACHE_MAGNITUDE, NoMagCache
+   *  otherwise.
+   */
+#ifdef SPT_VECT_CACHE_MAGNITUDE
+  typedef MagCache DefaultMagCache;
+#else
+  typedef NoMagCache DefaultMagCache;
+#endif
+}
+
+#endif	/* support_VecMagCache_hh */
@@ -0,0 +1,525 @@
+/**@file
+ *
+ * Per-component kernels behind spt::Vec and spt::Vector, with SSE/AVX
+ * versions for two- to four-component float and double vectors.
+ */
+#ifndef support_VecSIMD_hh
+#define support_VecSIMD_hh 1
+
+#include <cmath>
+#include <cstddef>
+
+#include <support/support-config.h>
+
+#if defined(SPT_VEC_SIMD) && defined(__SSE2__)
+#  define SPT_VEC_SIMD_SSE 1
+#  include <immintrin.h>
+#endif
+
+/* Whether a constexpr function is being evaluated at compile time, in
+   which case it must use scalar_ops (which give the same results as
+   the SIMD kernels).  Without the builtin, scalar_ops are used always. */
+#if defined(__has_builtin)
+#  if __has_builtin(__builtin_is_constant_evaluated)
+#    define SPT_VEC_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#  endif
+#endif
+#ifndef SPT_VEC_CONSTANT_EVALUATED
+#  define SPT_VEC_CONSTANT_EVALUATED() true
+#endif
+
+namespace spt
+{
+  namespace vec_simd
+  {
+    /** Storage layout for an @p _N-component vector of @p _T.
+     *
+     * Small float and double vectors are padded to a whole number of
+     * SSE registers, so that the kernels below can load and store them
+     * whole.  The padding is the same whether or not SIMD kernels are
+     * in use.
+     */
+    template < size_t _N, typename _T >
+    struct layout
+    {
+      /** Number of elements stored; those past @p _N are padding. */
+      static constexpr size_t lanes = _N;
+      static constexpr size_t alignment = alignof(_T);
+    };
+
+    /* Alignment is capped at 16 bytes, which is all that operator new
+       guarantees before C++17; the kernels use unaligned loads. */
+    template <> struct layout<2, float>  { static constexpr size_t lanes = 4, alignment = 16; };
+    template <> struct layout<3, float>  { static constexpr size_t lanes = 4, alignment = 16; };
+    template <> struct layout<4, float>  { static constexpr size_t lanes = 4, alignment = 16; };
+    template <> struct layout<2, double> { static constexpr size_t lanes = 2, alignment = 16; };
+    template <> struct layout<3, double> { static constexpr size_t lanes = 4, alignment = 16; };
+    template <> struct layout<4, double> { static constexpr size_t lanes = 4, alignment = 16; };
+
+
+    /** <code>x * y + z</code>.  The float and double versions round
+     *	once on targets with FMA instructions: the compiler would
+     *	otherwise contract some multiply-adds and not others, and the
+     *	kernels below could not promise matching results.
+     */
+    template < typename _T >
+    constexpr _T
+    fmadd(_T x, _T y, _T z)
+    {
+      return x * y + z;
+    }
+
+#ifdef __FMA__
+    /* The builtins, unlike std::fma, can be evaluated at compile time. */
+    constexpr float fmadd(float x, float y, float z) { return __builtin_fmaf(x, y, z); }
+    constexpr double fmadd(double x, double y, double z) { return __builtin_fma(x, y, z); }
+#endif
+
+
+    /** Dot product of @p _N components.
+     *
+     * Up to four products are summed pairwise, (p0 + p2) + (p1 + p3),
+     * as a SIMD horizontal add does; scalar_ops uses the same order so
+     * that its results match the SIMD kernels bit for bit.
+     */
+    template < size_t _N, typename _T >
+    struct dot_order
+    {
+      static constexpr _T
+      dot(const _T* a, const _T* b)
+      {
+	return dot_from(a, b, 0, static_cast<_T>(0));
+      }
+
+      /* Recursive, so that it can be evaluated at compile time. */
+      static constexpr _T
+      dot_from(const _T* a, const _T* b, size_t i, _T o)
+      {
+	return i < _N ? dot_from(a, b, i + 1, fmadd(a[i], b[i], o)) : o;
+      }
+    };
+
+    template < typename _T >
+    struct dot_order<2, _T>
+    {
+      static constexpr _T
+      dot(const _T* a, const _T* b)
+      {
+	return fmadd(a[0], b[0], a[1] * b[1]);
+      }
+    };
+
+    template < typename _T >
+    struct dot_order<3, _T>
+    {
+      static constexpr _T
+      dot(const _T* a, const _T* b)
+      {
+	return fmadd(a[1], b[1], fmadd(a[0], b[0], a[2] * b[2]));
+      }
+    };
+
+    template < typename _T >
+    struct dot_order<4, _T>
+    {
+      static constexpr _T
+      dot(const _T* a, const _T* b)
+      {
+	return fmadd(a[0], b[0], a[2] * b[2]) + fmadd(a[1], b[1], a[3] * b[3]);
+      }
+    };
+
+
+    /** Portable kernels over the first @p _N elements of each operand.
+     *
+     * These define the results of the SIMD kernels: apart from rsqrt,
+     * each specialization of ops returns the same bits as scalar_ops
+     * for the same inputs.  Output arrays may alias input arrays.
+     */
+    template < size_t _N, typename _T >
+    struct scalar_ops
+    {
+      /** Store the @p _N components at @p a into @p o, and zero its
+       *  padding lanes.  @p a need not be padded; @p o must be aligned
+       *  as layout requires.
+       */
+      static inline void
+      set(_T* o, const _T* a)
+      {
+	for ( size_t i ( 0 ); i < _N; ++i )
+	  o[i] = a[i];
+	for ( size_t i ( _N ); i < layout<_N, _T>::lanes; ++i )
+	  o[i] = 0;
+      }
+
+      /** Copy all lanes of @p a, padding included, into @p o; both
+       *  must be aligned as layout requires.
+       */
+      static inline void
+      copy(_T* o, const _T* a)
+      {
+	for ( size_t i ( 0 ); i < layout<_N, _T>::lanes; ++i )
+	  o[i] = a[i];
+      }
+
+      /** <code>o = a + b</code> */
+      static inline void
+      add(_T* o, const _T* a, const _T* b)
+      {
+	for ( size_t i ( 0 ); i < _N; ++i )
+	  o[i] = a[i] + b[i];
+      }
+
+      /** <code>o = a - b</code> */
+      static inline void
+      sub(_T* o, const _T* a, const _T* b)
+      {
+	for ( size_t i ( 0 ); i < _N; ++i )
+	  o[i] = a[i] - b[i];
+      }
+
+      /** <code>o = -a</code> */
+      static inline void
+      neg(_T* o, const _T* a)
+      {
+	for ( size_t i ( 0 ); i < _N; ++i )
+	  o[i] = -a[i];
+      }
+
+      /** <code>o = a * s</code> */
+      static inline void
+      scale(_T* o, const _T* a, _T s)
+      {
+	for ( size_t i ( 0 ); i < _N; ++i )
+	  o[i] = a[i] * s;
+      }
+
+      /** <code>o = a / s</code> */
+      static inline void
+      divide(_T* o, const _T* a, _T s)
+      {
+	for ( size_t i ( 0 ); i < _N; ++i )
+	  o[i] = a[i] / s;
+      }
+
+      /** <code>o = a + b * s</code>, rounded once per element on targets
+       *  with fused multiply-add instructions.
+       */
+      static inline void
+      madd(_T* o, const _T* a, const _T* b, _T s)
+      {
+	for ( size_t i ( 0 ); i < _N; ++i )
+	  o[i] = fmadd(b[i], s, a[i]);
+      }
+
+      /** Dot product of @p a and @p b, summed in dot_order. */
+      static constexpr _T
+      dot(const _T* a, const _T* b)
+      {
+	return dot_order<_N, _T>::dot(a, b);
+      }
+
+      /** <code>o = a &times; b</code>; three-component vectors only. */
+      static inline void
+      cross(_T* o, const _T* a, const _T* b)
+      {
+	static_assert(_N == 3, "cross product is defined for three-component vectors only");
+	_T x ( fmadd(a[1], b[2], -( a[2] * b[1] )) ),
+	  y ( fmadd(a[2], b[0], -( a[0] * b[2] )) ),
+	  z ( fmadd(a[0], b[1], -( a[1] * b[0] )) );
+	o[0] = x;
+	o[1] = y;
+	o[2] = z;
+      }
+
+      /** Reciprocal square root of @p x.  SIMD versions may return an
+       *  approximation (with a relative error below 1e-6 for float).
+       */
+      static inline _T
+      rsqrt(_T x)
+      {
+	return static_cast<_T>(1) / std::sqrt(x);
+      }
+    };
+
+
+    /** Kernels for @p _N-component vectors of @p _T: SIMD versions where
+     *	available, scalar_ops otherwise.  Operands must be laid out as
+     *	described by layout.
+     */
+    template < size_t _N, typename _T >
+    struct ops
+      : scalar_ops<_N, _T>
+    {
+    };
+
+
+#ifdef SPT_VEC_SIMD_SSE
+    /* Element-wise kernels load and store whole registers, padding
+       lanes included; padding values are unspecified, and horizontal
+       kernels never read them.
+
+       set and copy, which fill a Vec, also store whole registers (to
+       its aligned storage): a register load of data written by
+       narrower stores can't be forwarded from the store buffer, and
+       stalls until the stores reach the cache. */
+
+    /** Kernels for float vectors held in one __m128. */
+    template < size_t _N >
+    struct sse_float_ops
+    {
+      static inline __m128 load(const float* a) { return _mm_loadu_ps(a); }
+      static inline void store(float* o, __m128 v) { _mm_storeu_ps(o, v); }
+
+      static inline void
+      set(float* o, const float* a)
+      {
+	_mm_store_ps(o, _N == 4 ? load(a)
+		     : _N == 3 ? _mm_setr_ps(a[0], a[1], a[2], 0.0f)
+		     : _mm_setr_ps(a[0], a[1], 0.0f, 0.0f));
+      }
+
+      static inline void
+      copy(float* o, const float* a)
+      {
+	_mm_store_ps(o, _mm_load_ps(a));
+      }
+
+      static inline void
+      add(float* o, const float* a, const float* b)
+      {
+	store(o, _mm_add_ps(load(a), load(b)));
+      }
+
+      static inline void
+      sub(float* o, const float* a, const float* b)
+      {
+	store(o, _mm_sub_ps(load(a), load(b)));
+      }
+
+      static inline void
+      neg(float* o, const float* a)
+      {
+	store(o, _mm_xor_ps(load(a), _mm_set1_ps(-0.0f)));
+      }
+
+      static inline void
+      scale(float* o, const float* a, float s)
+      {
+	store(o, _mm_mul_ps(load(a), _mm_set1_ps(s)));
+      }
+
+      static inline void
+      divide(float* o, const float* a, float s)
+      {
+	store(o, _mm_div_ps(load(a), _mm_set1_ps(s)));
+      }
+
+      static inline void
+      madd(float* o, const float* a, const float* b, float s)
+      {
+#ifdef __FMA__
+	store(o, _mm_fmadd_ps(load(b), _mm_set1_ps(s), load(a)));
+#else
+	store(o, _mm_add_ps(load(a), _mm_mul_ps(load(b), _mm_set1_ps(s))));
+#endif
+      }
+
+      static inline __m128 lane1(__m128 v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)); }
+
+      static inline float
+      dot(const float* a, const float* b)
+      {
+	__m128 va ( load(a) ), vb ( load(b) );
+	__m128 p ( _mm_mul_ps(va, vb) );
+#ifdef __FMA__
+	if ( _N == 2 )
+	  return _mm_cvtss_f32(_mm_fmadd_ss(va, vb, lane1(p)));
+
+	/* t = { a0 * b0 + p2, a1 * b1 + p3, ... } */
+	__m128 t ( _mm_fmadd_ps(va, vb, _mm_movehl_ps(p, p)) );
+	if ( _N == 3 )
+	  return _mm_cvtss_f32(_mm_fmadd_ss(lane1(va), lane1(vb), t));
+	return _mm_cvtss_f32(_mm_add_ss(t, lane1(t)));
+#else
+	if ( _N == 2 )
+	  return _mm_cvtss_f32(_mm_add_ss(p, lane1(p)));
+
+	/* t = { p0 + p2, p1 + p3, ... } */
+	__m128 t ( _mm_add_ps(p, _mm_movehl_ps(p, p)) );
+	if ( _N == 3 )
+	  return _mm_cvtss_f32(_mm_add_ss(t, lane1(p)));
+	return _mm_cvtss_f32(_mm_add_ss(t, lane1(t)));
+#endif
+      }
+
+      static inline void
+      cross(float* o, const float* a, const float* b)
+      {
+	static_assert(_N == 3, "cross product is defined for three-component vectors only");
+	__m128 va ( load(a) ), vb ( load(b) );
+	__m128
+	  a_yzx ( _mm_shuffle_ps(va, va, _MM_SHUFFLE(3, 0, 2, 1)) ),
+	  b_zxy ( _mm_shuffle_ps(vb, vb, _MM_SHUFFLE(3, 1, 0, 2)) ),
+	  a_zxy ( _mm_shuffle_ps(va, va, _MM_SHUFFLE(3, 1, 0, 2)) ),
+	  b_yzx ( _mm_shuffle_ps(vb, vb, _MM_SHUFFLE(3, 0, 2, 1)) );
+#ifdef __FMA__
+	store(o, _mm_fmsub_ps(a_yzx, b_zxy, _mm_mul_ps(a_zxy, b_yzx)));
+#else
+	store(o, _mm_sub_ps(_mm_mul_ps(a_yzx, b_zxy), _mm_mul_ps(a_zxy, b_yzx)));
+#endif
+      }
+
+      /** Hardware estimate refined by one Newton-Raphson step. */
+      static inline float
+      rsqrt(float x)
+      {
+	__m128 vx ( _mm_set_ss(x) );
+	__m128 y ( _mm_rsqrt_ss(vx) );
+	__m128 yyx ( _mm_mul_ss(_mm_mul_ss(y, y), vx) );
+	y = _mm_mul_ss(_mm_mul_ss(_mm_set_ss(0.5f), y), _mm_sub_ss(_mm_set_ss(3.0f), yyx));
+	return _mm_cvtss_f32(y);
+      }
+    };
+
+    template <> struct ops<2, float> : sse_float_ops<2> { };
+    template <> struct ops<3, float> : sse_float_ops<3> { };
+    template <> struct ops<4, float> : sse_float_ops<4> { };
+
+
+    /** Kernels for double vectors held in one (@p _N = 2) or two
+     *	__m128d, or in one __m256d where AVX is available.
+     */
+    template < size_t _N >
+    struct sse_double_ops
+      : scalar_ops<_N, double>
+    {
+      static constexpr size_t halves = _N > 2 ? 2 : 1;
+
+      static inline __m128d load(const double* a) { return _mm_loadu_pd(a); }
+      static inline void store(double* o, __m128d v) { _mm_storeu_pd(o, v); }
+
+      /* Vec storage is aligned to 16 bytes only, so these don't use
+	 AVX. */
+      static inline void
+      set(double* o, const double* a)
+      {
+	_mm_store_pd(o, load(a));
+	if ( _N > 2 )
+	  _mm_store_pd(o + 2, _N == 4 ? load(a + 2) : _mm_set_sd(a[2]));
+      }
+
+      static inline void
+      copy(double* o, const double* a)
+      {
+	for ( size_t h ( 0 ); h < halves; ++h )
+	  _mm_store_pd(o + 2 * h, _mm_load_pd(a + 2 * h));
+      }
+
+      /* Applies EXPR256 (to a4, the whole vector) with AVX, or EXPR128
+	 (to a2, its h'th half) otherwise. */
+#ifdef __AVX__
+#  define SPT_VEC_DOUBLE_OP_AVX(EXPR256)				\
+      if ( halves == 2 )						\
+	{								\
+	  __m256d a4 ( _mm256_loadu_pd(a) );				\
+	  _mm256_storeu_pd(o, EXPR256);					\
+	  return;							\
+	}
+#else
+#  define SPT_VEC_DOUBLE_OP_AVX(EXPR256)
+#endif
+#define SPT_VEC_DOUBLE_OP(EXPR128, EXPR256)				\
+      SPT_VEC_DOUBLE_OP_AVX(EXPR256)					\
+      for ( size_t h ( 0 ); h < halves; ++h, a += 2, o += 2 )		\
+	{								\
+	  __m128d a2 ( load(a) );					\
+	  store(o, EXPR128);						\
+	}
+
+      static inline void
+      add(double* o, const double* a, const double* b)
+      {
+	SPT_VEC_DOUBLE_OP(_mm_add_pd(a2, load(b + 2 * h)),
+			  _mm256_add_pd(a4, _mm256_loadu_pd(b)));
+      }
+
+      static inline void
+      sub(double* o, const double* a, const double* b)
+      {
+	SPT_VEC_DOUBLE_OP(_mm_sub_pd(a2, load(b + 2 * h)),
+			  _mm256_sub_pd(a4, _mm256_loadu_pd(b)));
+      }
+
+      static inline void
+      neg(double* o, const double* a)
+      {
+	SPT_VEC_DOUBLE_OP(_mm_xor_pd(a2, _mm_set1_pd(-0.0)),
+			  _mm256_xor_pd(a4, _mm256_set1_pd(-0.0)));
+      }
+
+      static inline void
+      scale(double* o, const double* a, double s)
+      {
+	SPT_VEC_DOUBLE_OP(_mm_mul_pd(a2, _mm_set1_pd(s)),
+			  _mm256_mul_pd(a4, _mm256_set1_pd(s)));
+      }
+
+      static inline void
+      divide(double* o, const double* a, double s)
+      {
+	SPT_VEC_DOUBLE_OP(_mm_div_pd(a2, _mm_set1_pd(s)),
+			  _mm256_div_pd(a4, _mm256_set1_pd(s)));
+      }
+
+      static inline void
+      madd(double* o, const double* a, const double* b, double s)
+      {
+#ifdef __FMA__
+	SPT_VEC_DOUBLE_OP(_mm_fmadd_pd(load(b + 2 * h), _mm_set1_pd(s), a2),
+			  _mm256_fmadd_pd(_mm256_loadu_pd(b), _mm256_set1_pd(s), a4));
+#else
+	SPT_VEC_DOUBLE_OP(_mm_add_pd(a2, _mm_mul_pd(load(b + 2 * h), _mm_set1_pd(s))),
+			  _mm256_add_pd(a4, _mm256_mul_pd(_mm256_loadu_pd(b), _mm256_set1_pd(s))));
+#endif
+      }
+#undef SPT_VEC_DOUBLE_OP
+#undef SPT_VEC_DOUBLE_OP_AVX
+
+      static inline __m128d lane1(__m128d v) { return _mm_unpackhi_pd(v, v); }
+
+      static inline double
+      dot(const double* a, const double* b)
+      {
+	__m128d a01 ( load(a) ), b01 ( load(b) );
+#ifdef __FMA__
+	if ( _N == 2 )
+	  return _mm_cvtsd_f64(_mm_fmadd_sd(a01, b01, _mm_mul_sd(lane1(a01), lane1(b01))));
+
+	/* t = { a0 * b0 + p2, a1 * b1 + p3 } */
+	__m128d t ( _mm_fmadd_pd(a01, b01, _mm_mul_pd(load(a + 2), load(b + 2))) );
+	if ( _N == 3 )
+	  return _mm_cvtsd_f64(_mm_fmadd_sd(lane1(a01), lane1(b01), t));
+	return _mm_cvtsd_f64(_mm_add_sd(t, lane1(t)));
+#else
+	__m128d lo ( _mm_mul_pd(a01, b01) );
+	if ( _N == 2 )
+	  return _mm_cvtsd_f64(_mm_add_sd(lo, lane1(lo)));
+
+	/* t = { p0 + p2, p1 + p3 } */
+	__m128d t ( _mm_add_pd(lo, _mm_mul_pd(load(a + 2), load(b + 2))) );
+	if ( _N == 3 )
+	  return _mm_cvtsd_f64(_mm_add_sd(t, lane1(lo)));
+	return _mm_cvtsd_f64(_mm_add_sd(t, lane1(t)));
+#endif
+      }
+    };
+
+    template <> struct ops<2, double> : sse_double_ops<2> { };
+    template <> struct ops<3, double> : sse_double_ops<3> { };
+    template <> struct ops<4, double> : sse_double_ops<4> { };
+#endif	/* SPT_VEC_SIMD_SSE */
+  }
+}
+
+#endif	/* support_VecSIMD_hh */
@@ -30,6 +30,11 @@ namespace spt
     typedef size_t size_type;
     static const size_type N = 3;
 
+    /** Kernels used for the vector arithmetic; _M_val has the padding
+     *	element they need.
+     */
+    typedef vec_simd::ops<3, scalar_t> ops_type;
+
     inline Vector(Vector&& v)
       : _M_val ( )
 #ifdef SPT_VECT_CACHE_MAGNITUDE
@@ -116,8 +121,9 @@ namespace spt
 
 
     inline Vector(const Vector& v)
+      : _M_val ( )
 #ifdef SPT_VECT_CACHE_MAGNITUDE
-      : _M_mag_cached(v._M_mag_cached), _M_mag2_cached ( v._M_mag2_cached ), _M_recalc_mag(true), _M_recalc_mag2 ( true )
+      , _M_mag_cached(v._M_mag_cached), _M_mag2_cached ( v._M_mag2_cached ), _M_recalc_mag(true), _M_recalc_mag2 ( true )
 #endif
     {
       SV_COPY(_M_val, v._M_val);
@@ -144,8 +150,9 @@ namespace spt
  *     } */
 
     Vector(const svec_t& v)
+      : _M_val ( )
 #ifdef SPT_VECT_CACHE_MAGNITUDE
-      : _M_mag_cached(0), _M_mag2_cached ( 0 ), _M_recalc_mag(true), _M_recalc_mag2 ( true )
+      , _M_mag_cached(0), _M_mag2_cached ( 0 ), _M_recalc_mag(true), _M_recalc_mag2 ( true )
 #endif
     {
       SV_COPY(_M_val, v);
@@ -153,8 +160,9 @@ namespace spt
 
 
     Vector(const svec_t* v)
+      : _M_val ( )
 #ifdef SPT_VECT_CACHE_MAGNITUDE
-      : _M_mag_cached(0), _M_mag2_cached ( 0 ), _M_recalc_mag(true), _M_recalc_mag2 ( true )
+      , _M_mag_cached(0), _M_mag2_cached ( 0 ), _M_recalc_mag(true), _M_recalc_mag2 ( true )
 #endif
     {
       SV_COPY(_M_val, *v);
@@ -251,10 +259,7 @@ namespace spt
     inline scalar_t
     compute_mag2() const
     {
-      return
-	( _M_val[0] * _M_val[0] ) +
-	( _M_val[1] * _M_val[1] ) +
-	( _M_val[2] * _M_val[2] );
+      return ops_type::dot(_M_val, _M_val);
     }
 
     inline void
@@ -332,18 +337,18 @@ namespace spt
     inline Vector
     operator+(const Vector& r) const
     {
-      return Vector( _M_val[0] + r._M_val[0],
-		     _M_val[1] + r._M_val[1],
-		     _M_val[2] + r._M_val[2] );
+      Vector o ( *this );
+      ops_type::add(o._M_val, _M_val, r._M_val);
+      return o;
     }
 
 
     inline Vector
     operator-(const Vector& r) const
     {
-      return Vector( _M_val[0] - r._M_val[0],
-		     _M_val[1] - r._M_val[1],
-		     _M_val[2] - r._M_val[2] );
+      Vector o ( *this );
+      ops_type::sub(o._M_val, _M_val, r._M_val);
+      return o;
     }
 
 
@@ -351,9 +356,9 @@ namespace spt
     inline Vector
     operator*(const scalar_t r) const
     {
-      return Vector( r * _M_val[0],
-		     r * _M_val[1],
-		     r * _M_val[2] );
+      Vector o ( *this );
+      ops_type::scale(o._M_val, _M_val, r);
+      return o;
     }
 
     // cross (vector) product
@@ -365,28 +370,40 @@ namespace spt
 	throw std::invalid_argument("Vector::operator*: right operand vector contains one or more NaN values");
 #endif
   
-      return Vector( ( _M_val[1] * r._M_val[2] ) - ( _M_val[2] * r._M_val[1] ),
-		     ( _M_val[2] * r._M_val[0] ) - ( _M_val[0] * r._M_val[2] ),
-		     ( _M_val[0] * r._M_val[1] ) - ( _M_val[1] * r._M_val[0] ) );
+      Vector o ( *this );
+      ops_type::cross(o._M_val, _M_val, r._M_val);
+      return o;
     }
 
     // dot (scalar) product
     inline scalar_t
     dot(const Vector& r) const
     {
-      return ( (_M_val[0] * r._M_val[0]) +
-	       (_M_val[1] * r._M_val[1]) +
-	       (_M_val[2] * r._M_val[2]) );
+      return ops_type::dot(_M_val, r._M_val);
     }
 
 
     inline Vector
     operator/(const scalar_t r) const
     {
-      return Vector( _M_val[0] / r,
-		     _M_val[1] / r,
-		     _M_val[2] / r );
+      Vector o ( *this );
+      ops_type::divide(o._M_val, _M_val, r);
+      return o;
+    }
 
+    /** Add @p r scaled by @p s to this vector, as a single fused
+     *	operation: <code>*this += r * s</code>.
+     */
+    inline Vector&
+    madd(const Vector& r, const scalar_t s)
+    {
+      ops_type::madd(_M_val, _M_val, r._M_val, s);
+
+#ifdef SPT_VECT_CACHE_MAGNITUDE
+      _M_recalc_mag = true;
+      _M_recalc_mag2 = true;
+#endif
+      return *this;
     }
 
 
@@ -406,9 +423,7 @@ namespace spt
     inline Vector&
     operator+=(const Vector& r)
     {
-      _M_val[0] += r._M_val[0];
-      _M_val[1] += r._M_val[1];
-      _M_val[2] += r._M_val[2];
+      ops_type::add(_M_val, _M_val, r._M_val);
 
 #ifdef SPT_VECT_CACHE_MAGNITUDE
       _M_recalc_mag = true;
@@ -420,9 +435,7 @@ namespace spt
     inline Vector&
     operator-=(const Vector& r)
     {
-      _M_val[0] -= r._M_val[0];
-      _M_val[1] -= r._M_val[1];
-      _M_val[2] -= r._M_val[2];
+      ops_type::sub(_M_val, _M_val, r._M_val);
 
 #ifdef SPT_VECT_CACHE_MAGNITUDE
       _M_recalc_mag = true;
@@ -435,23 +448,16 @@ namespace spt
     inline Vector
     operator-() const
     {
-      return Vector(-_M_val[0],
-		    -_M_val[1],
-		    -_M_val[2]);
+      Vector o ( *this );
+      ops_type::neg(o._M_val, _M_val);
+      return o;
     }
 
     // Cross product.
     inline Vector&
     operator*=(const Vector& r)
     {
-      scalar_t ov[3];
-      ov[0] = _M_val[0];
-      ov[1] = _M_val[1];
-      ov[2] = _M_val[2];
-
-      set( ( ov[1] * r._M_val[2] ) - ( ov[2] * r._M_val[1] ),
-	   ( ov[2] * r._M_val[0] ) - ( ov[0] * r._M_val[2] ),
-	   ( ov[0] * r._M_val[1] ) - ( ov[1] * r._M_val[0] ) );
+      ops_type::cross(_M_val, _M_val, r._M_val);
 
 #ifdef SPT_VECT_CACHE_MAGNITUDE
       _M_recalc_mag = true;
@@ -464,9 +470,7 @@ namespace spt
     inline Vector&
     operator*=(const scalar_t r)
     {
-      _M_val[0] *= r;
-      _M_val[1] *= r;
-      _M_val[2] *= r;
+      ops_type::scale(_M_val, _M_val, r);
 
 #ifdef SPT_VECT_CACHE_MAGNITUDE
       _M_recalc_mag = true;
@@ -479,9 +483,7 @@ namespace spt
     inline Vector&
     operator/=(const scalar_t r)
     {
-      _M_val[0] /= r;
-      _M_val[1] /= r;
-      _M_val[2] /= r;
+      ops_type::divide(_M_val, _M_val, r);
 
 #ifdef SPT_VECT_CACHE_MAGNITUDE
       _M_recalc_mag = true;
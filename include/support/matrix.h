@@ -1,6 +1,7 @@
 #ifndef SUPPORT_MATRIX_H
 #define SUPPORT_MATRIX_H
 
+#include <stddef.h>
 #include <support/scalar.h>
 
 
@@ -16,16 +17,29 @@
  * like creating minors or transposes without allocating much more
  * memory. Unfortunately, it also makes accessing the actual
  * data a whole lot more ugly - and SLOW.
+ *
+ * By storing all values in one aligned, row-major block, with a
+ * "stride" (leading dimension) between the starts of successive rows,
+ * we get both: views of sub-matrices share data simply by pointing
+ * into the block, and whole rows can be handed to SIMD kernels.
  */
 
+/* Contiguous rows; the default */
+#define MATRIX_CONTIGUOUS
+
 /* Less complicated, but also less flexible */
-#define  MATRIX_BY_ROW
+/* #define MATRIX_BY_ROW */
 
 /* More complicated, but also more flexible */
 /* #define MATRIX_BY_VALUE */
 
 
-#ifdef MATRIX_BY_ROW
+#ifdef MATRIX_CONTIGUOUS
+#define matrix_row(m,r) ((m)->values + (size_t) (r) * (m)->stride)
+#define matrix_get(m,r,c) (matrix_row(m,r)[c])
+#define matrix_set(m,r,c,v) (matrix_row(m,r)[c] = (v))
+#elif defined MATRIX_BY_ROW
+#define matrix_row(m,r) ((m)->data[r])
 #define matrix_get(m,r,c) (m->data[r][c])
 #define matrix_set(m,r,c,v) (m->data[r][c] = v)
 #elif defined MATRIX_BY_VALUE
@@ -42,6 +56,11 @@
 #define MATRIX_IS_SQUARE(m) (m->cols == m->rows)
 #define MATRIX_CONGRUENT(a, b) (a->rows == b->rows && a->cols == b->cols)
 
+/* Alignment, in bytes, of the storage allocated by matrix_new.  Rows of
+   at least this size are padded to a multiple of it, so each row starts
+   on a cache line. */
+#define MATRIX_ALIGNMENT 64
+
 typedef struct _matrix Matrix;
 
 enum _matrix_flags {
@@ -53,7 +72,12 @@ struct _matrix {
   unsigned int flags;
   unsigned int rows, cols;
 
+#ifdef MATRIX_CONTIGUOUS
+  unsigned int stride;		/* elements from the start of one row to the next */
+  scalar_t *values;
+#else
   scalar_t **data;
+#endif
 };
 
 Matrix *matrix_alloc();		/* allocate a new, uninitialized Matrix struct. */
@@ -79,14 +103,71 @@ Matrix *matrix_set_col(Matrix *m, const unsigned int col, ...);
 
 Matrix *matrix_minor(Matrix *m, const unsigned int i, const unsigned int j);
 
+#ifdef MATRIX_CONTIGUOUS
+Matrix *matrix_view(Matrix *m, const unsigned int row, const unsigned int col,
+		    const unsigned int rows, const unsigned int cols);
+#endif
+
 scalar_t matrix_det(Matrix *m);
 
+#ifndef MATRIX_BY_VALUE
+int matrix_lu_decompose(Matrix *m, unsigned int *pivots);
+
+void matrix_lu_solve(Matrix *lu, const unsigned int *pivots, Matrix *b);
+
+scalar_t matrix_det_in_place(Matrix *m);
+
+Matrix *matrix_inverse(Matrix *m, Matrix *dest);
+
+Matrix *matrix_solve(Matrix *a, Matrix *b, Matrix *dest);
+
+Matrix *matrix_solve_in_place(Matrix *a, Matrix *b);
+#endif
+
 Matrix *matrix_mult(Matrix *a, Matrix *b, Matrix *dest);
 
 Matrix *matrix_add(Matrix *a, Matrix *b, Matrix *dest);
 
 Matrix *matrix_transpose(Matrix *m, Matrix *dest);
 
+#ifndef MATRIX_BY_VALUE
+Matrix *matrix_transpose_in_place(Matrix *m);
+#endif
+
+
+/* Parallel execution
+ *
+ * matrix_mult, matrix_add and matrix_transpose split operations on large
+ * matrices into bands of rows (or columns) and hand them to a small pool
+ * of worker threads, which is started on first use; the calling thread
+ * works on one of the bands.  Smaller operations run on the calling
+ * thread alone.  Only one operation runs in parallel at a time: if
+ * another thread is already using the pool, an operation runs serially
+ * instead of waiting for it.
+ *
+ * The settings may be changed at any time, from any thread; operations
+ * already running finish with the settings they started with.
+ * Libraries built without SPT_MATRIX_THREADS always run serially.
+ */
+
+/* Default for matrix_set_parallel_threshold. */
+#define MATRIX_PARALLEL_THRESHOLD (1 << 20)
+
+/* Use n threads (including the calling thread) for large operations;
+   0, the default, means one per online processor, and 1 keeps every
+   operation on the calling thread. */
+void matrix_set_threads(const unsigned int n);
+
+/* Number of threads large operations are split between. */
+unsigned int matrix_get_threads(void);
+
+/* Run operations in parallel when they involve at least `work' scalar
+   operations: multiply-adds for matrix_mult, elements for matrix_add
+   and matrix_transpose. */
+void matrix_set_parallel_threshold(const size_t work);
+
+size_t matrix_get_parallel_threshold(void);
+
 
 int matrix_compare(Matrix *a, Matrix *b);
 
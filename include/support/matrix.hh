@@ -3,8 +3,14 @@
 
 #include <support/support-config.h>
 #include <support/scalar.h>
+#include <support/Vec.hh>
+#include <support/VecArray.hh>
 
+#include <cstddef>
+#include <cstdio>
 #include <stdexcept>
+#include <type_traits>
+#include <utility>
 
 #ifndef __cplusplus
 #error this is a c++ header file.
@@ -14,12 +20,286 @@
 
 namespace spt
 {
+  namespace matrix_detail
+  {
+    /** Closed-form determinant and inverse of @p _N x @p _N matrices,
+     *	written out in full for the sizes used in transforms.  @c
+     *	available is false for other sizes, which use LU decomposition.
+     */
+    template < unsigned int _R, unsigned int _C >
+    struct closed_form
+    {
+      typedef std::false_type available;
+    };
+
+    template < >
+    struct closed_form<2, 2>
+    {
+      typedef std::true_type available;
+
+      static scalar_t
+      determinant(const scalar_t (&m)[2][2])
+      {
+	return m[0][0] * m[1][1] - m[0][1] * m[1][0];
+      }
+
+      static bool
+      invert(const scalar_t (&m)[2][2], scalar_t (&out)[2][2])
+      {
+	scalar_t det ( determinant(m) );
+	if ( ! ( S_ABS(det) > 0 ) )
+	  return false;
+
+	scalar_t r ( 1 / det ),
+	  a ( m[0][0] ), b ( m[0][1] ), c ( m[1][0] ), d ( m[1][1] );
+	out[0][0] = d * r;
+	out[0][1] = -b * r;
+	out[1][0] = -c * r;
+	out[1][1] = a * r;
+	return true;
+      }
+    };
+
+    template < >
+    struct closed_form<3, 3>
+    {
+      typedef std::true_type available;
+
+      static scalar_t
+      determinant(const scalar_t (&m)[3][3])
+      {
+	return m[0][0] * ( m[1][1] * m[2][2] - m[1][2] * m[2][1] )
+	  - m[0][1] * ( m[1][0] * m[2][2] - m[1][2] * m[2][0] )
+	  + m[0][2] * ( m[1][0] * m[2][1] - m[1][1] * m[2][0] );
+      }
+
+      /** The inverse is the transposed matrix of cofactors over the
+       *  determinant.
+       */
+      static bool
+      invert(const scalar_t (&m)[3][3], scalar_t (&out)[3][3])
+      {
+	scalar_t
+	  c00 ( m[1][1] * m[2][2] - m[1][2] * m[2][1] ),
+	  c01 ( m[1][2] * m[2][0] - m[1][0] * m[2][2] ),
+	  c02 ( m[1][0] * m[2][1] - m[1][1] * m[2][0] );
+	scalar_t det ( m[0][0] * c00 + m[0][1] * c01 + m[0][2] * c02 );
+	if ( ! ( S_ABS(det) > 0 ) )
+	  return false;
+
+	scalar_t r ( 1 / det );
+	scalar_t t[3][3] =
+	  {
+	    { c00 * r, ( m[0][2] * m[2][1] - m[0][1] * m[2][2] ) * r, ( m[0][1] * m[1][2] - m[0][2] * m[1][1] ) * r },
+	    { c01 * r, ( m[0][0] * m[2][2] - m[0][2] * m[2][0] ) * r, ( m[0][2] * m[1][0] - m[0][0] * m[1][2] ) * r },
+	    { c02 * r, ( m[0][1] * m[2][0] - m[0][0] * m[2][1] ) * r, ( m[0][0] * m[1][1] - m[0][1] * m[1][0] ) * r }
+	  };
+	for ( unsigned int i ( 0 ); i < 3; i++ )
+	  for ( unsigned int j ( 0 ); j < 3; j++ )
+	    out[i][j] = t[i][j];
+	return true;
+      }
+    };
+
+    /** Four-by-four determinant and inverse by Laplace expansion along
+     *	the first two and last two rows, sharing the twelve 2x2
+     *	sub-determinants between all the cofactors.
+     */
+    template < >
+    struct closed_form<4, 4>
+    {
+      typedef std::true_type available;
+
+      static scalar_t
+      determinant(const scalar_t (&m)[4][4])
+      {
+	scalar_t s[6], c[6];
+	sub_determinants(m, s, c);
+	return s[0] * c[5] - s[1] * c[4] + s[2] * c[3] + s[3] * c[2] - s[4] * c[1] + s[5] * c[0];
+      }
+
+      static bool
+      invert(const scalar_t (&m)[4][4], scalar_t (&out)[4][4])
+      {
+	scalar_t s[6], c[6];
+	sub_determinants(m, s, c);
+	scalar_t det ( s[0] * c[5] - s[1] * c[4] + s[2] * c[3] + s[3] * c[2] - s[4] * c[1] + s[5] * c[0] );
+	if ( ! ( S_ABS(det) > 0 ) )
+	  return false;
+
+	scalar_t r ( 1 / det );
+	scalar_t t[4][4] =
+	  {
+	    { ( m[1][1] * c[5] - m[1][2] * c[4] + m[1][3] * c[3] ) * r,
+	      ( -m[0][1] * c[5] + m[0][2] * c[4] - m[0][3] * c[3] ) * r,
+	      ( m[3][1] * s[5] - m[3][2] * s[4] + m[3][3] * s[3] ) * r,
+	      ( -m[2][1] * s[5] + m[2][2] * s[4] - m[2][3] * s[3] ) * r },
+	    { ( -m[1][0] * c[5] + m[1][2] * c[2] - m[1][3] * c[1] ) * r,
+	      ( m[0][0] * c[5] - m[0][2] * c[2] + m[0][3] * c[1] ) * r,
+	      ( -m[3][0] * s[5] + m[3][2] * s[2] - m[3][3] * s[1] ) * r,
+	      ( m[2][0] * s[5] - m[2][2] * s[2] + m[2][3] * s[1] ) * r },
+	    { ( m[1][0] * c[4] - m[1][1] * c[2] + m[1][3] * c[0] ) * r,
+	      ( -m[0][0] * c[4] + m[0][1] * c[2] - m[0][3] * c[0] ) * r,
+	      ( m[3][0] * s[4] - m[3][1] * s[2] + m[3][3] * s[0] ) * r,
+	      ( -m[2][0] * s[4] + m[2][1] * s[2] - m[2][3] * s[0] ) * r },
+	    { ( -m[1][0] * c[3] + m[1][1] * c[1] - m[1][2] * c[0] ) * r,
+	      ( m[0][0] * c[3] - m[0][1] * c[1] + m[0][2] * c[0] ) * r,
+	      ( -m[3][0] * s[3] + m[3][1] * s[1] - m[3][2] * s[0] ) * r,
+	      ( m[2][0] * s[3] - m[2][1] * s[1] + m[2][2] * s[0] ) * r }
+	  };
+	for ( unsigned int i ( 0 ); i < 4; i++ )
+	  for ( unsigned int j ( 0 ); j < 4; j++ )
+	    out[i][j] = t[i][j];
+	return true;
+      }
+
+    private:
+      /** 2x2 determinants of the top two rows (@p s) and the bottom two
+       *	(@p c), for each pair of columns.
+       */
+      static void
+      sub_determinants(const scalar_t (&m)[4][4], scalar_t (&s)[6], scalar_t (&c)[6])
+      {
+	s[0] = m[0][0] * m[1][1] - m[1][0] * m[0][1];
+	s[1] = m[0][0] * m[1][2] - m[1][0] * m[0][2];
+	s[2] = m[0][0] * m[1][3] - m[1][0] * m[0][3];
+	s[3] = m[0][1] * m[1][2] - m[1][1] * m[0][2];
+	s[4] = m[0][1] * m[1][3] - m[1][1] * m[0][3];
+	s[5] = m[0][2] * m[1][3] - m[1][2] * m[0][3];
+
+	c[0] = m[2][0] * m[3][1] - m[3][0] * m[2][1];
+	c[1] = m[2][0] * m[3][2] - m[3][0] * m[2][2];
+	c[2] = m[2][0] * m[3][3] - m[3][0] * m[2][3];
+	c[3] = m[2][1] * m[3][2] - m[3][1] * m[2][2];
+	c[4] = m[2][1] * m[3][3] - m[3][1] * m[2][3];
+	c[5] = m[2][2] * m[3][3] - m[3][2] * m[2][3];
+      }
+    };
+
+
+    /**@name Cache-oblivious transposition
+     *
+     * Blocks are halved recursively, along their longer side, down to
+     * tiles of one cache line square, so that the source and
+     * destination of each block stay in cache whatever the matrix size.
+     * The C Matrix API (src/matrix.c) does the same.
+     *@{
+     */
+    template < typename _T >
+    struct transpose_tile
+    {
+      static const unsigned int size = 64 / sizeof(_T) > 0 ? 64 / sizeof(_T) : 1;
+
+      /** Half of @p n, rounded up to a whole number of tiles. */
+      static unsigned int
+      split(unsigned int n)
+      {
+	return ( n / 2 + size - 1 ) / size * size;
+      }
+    };
+
+    /** Copy the transpose of the @p rows x @p cols block at @p src,
+     *	with row stride @p ss, to @p dst, with row stride @p ds.
+     */
+    template < typename _T >
+    void
+    transpose_block(const _T* src, size_t ss, _T* dst, size_t ds,
+		    unsigned int rows, unsigned int cols)
+    {
+      typedef transpose_tile<_T> tile;
+
+      if ( rows <= tile::size && cols <= tile::size )
+	{
+	  for ( unsigned int j ( 0 ); j < cols; j++, dst += ds )
+	    for ( unsigned int i ( 0 ); i < rows; i++ )
+	      dst[i] = src[i * ss + j];
+	}
+      else if ( rows >= cols )
+	{
+	  unsigned int h ( tile::split(rows) );
+	  transpose_block(src, ss, dst, ds, h, cols);
+	  transpose_block(src + h * ss, ss, dst + h, ds, rows - h, cols);
+	}
+      else
+	{
+	  unsigned int h ( tile::split(cols) );
+	  transpose_block(src, ss, dst, ds, rows, h);
+	  transpose_block(src + h, ss, dst + h * ds, ds, rows, cols - h);
+	}
+    }
+
+    /** Swap each element (i, j) of the @p rows x @p cols block at @p a
+     *	with element (j, i) of the block at @p b.
+     */
+    template < typename _T >
+    void
+    transpose_swap(_T* a, _T* b, size_t stride, unsigned int rows, unsigned int cols)
+    {
+      typedef transpose_tile<_T> tile;
+
+      if ( rows <= tile::size && cols <= tile::size )
+	{
+	  for ( unsigned int i ( 0 ); i < rows; i++ )
+	    for ( unsigned int j ( 0 ); j < cols; j++ )
+	      std::swap(a[i * stride + j], b[j * stride + i]);
+	}
+      else if ( rows >= cols )
+	{
+	  unsigned int h ( tile::split(rows) );
+	  transpose_swap(a, b, stride, h, cols);
+	  transpose_swap(a + h * stride, b + h, stride, rows - h, cols);
+	}
+      else
+	{
+	  unsigned int h ( tile::split(cols) );
+	  transpose_swap(a, b, stride, rows, h);
+	  transpose_swap(a + h, b + h * stride, stride, rows, cols - h);
+	}
+    }
+
+    /** Transpose the @p n x @p n block at @p a in place. */
+    template < typename _T >
+    void
+    transpose_square(_T* a, size_t stride, unsigned int n)
+    {
+      typedef transpose_tile<_T> tile;
+
+      if ( n <= tile::size )
+	{
+	  for ( unsigned int i ( 1 ); i < n; i++ )
+	    for ( unsigned int j ( 0 ); j < i; j++ )
+	      std::swap(a[i * stride + j], a[j * stride + i]);
+	}
+      else
+	{
+	  unsigned int h ( tile::split(n) );
+	  transpose_square(a, stride, h);
+	  transpose_square(a + h * stride + h, stride, n - h);
+	  transpose_swap(a + h, a + h * stride, stride, h, n - h);
+	}
+    }
+    /**@}*/
+  }
+
   /** Template-instantiated matrix class that uses immediate storage for member data storage.
+   *
+   * There are no virtual members, and the storage is aligned for SIMD
+   * loads, so small matrices can be copied and kept in arrays as cheaply
+   * as the raw values.  All loops run to compile-time bounds, which
+   * lets the compiler unroll and vectorize the products; the 2x2, 3x3
+   * and 4x4 determinants and inverses are written out in closed form
+   * (see matrix_detail::closed_form).
    */
   template < unsigned int _T_rows, unsigned int _T_columns >
   class Matrix
   {
+    template < unsigned int, unsigned int >
+    friend class Matrix;
+
   public:
+    typedef Vec<_T_columns, scalar_t> column_vec_type;
+    typedef Vec<_T_rows, scalar_t> row_vec_type;
+
     Matrix()
     {}
 
@@ -28,9 +308,16 @@ namespace spt
       reset(values);
     }
 
-    virtual
-    ~Matrix()
-    {}
+    /** The identity matrix. */
+    static Matrix
+    identity()
+    {
+      Matrix out;
+      for ( unsigned int i ( 0 ); i < _T_rows; i++ )
+	for ( unsigned int j ( 0 ); j < _T_columns; j++ )
+	  out._M_data[i][j] = ( i == j ) ? 1 : 0;
+      return out;
+    }
 
     void
     zero()
@@ -52,9 +339,14 @@ namespace spt
     }
 
     scalar_t
-    trace()
+    trace() const
     {
-      return -1;
+      requireSquare();
+
+      scalar_t out ( 0 );
+      for ( unsigned int i ( 0 ); i < _T_rows; i++ )
+	out += _M_data[i][i];
+      return out;
     }
 
     /** Creates the minor of a matrix by dropping the ith row and the jth
@@ -65,24 +357,24 @@ namespace spt
      * @param dropColumn	The column number to drop.
      */
 
-    virtual void
+    void
     setMinorMatrix(MatrixMinor& dest,
 		   const unsigned int dropRow,
-		   const unsigned int dropColumn)
+		   const unsigned int dropColumn) const
     {
       unsigned int i_dest, i_src, j_dest, j_src;
       for ( i_dest = 0, i_src = 0;
 	    i_dest < _T_rows - 1 && i_src < _T_rows;
 	    i_dest++, i_src++ )
 	{
-	  if ( i_src == dropColumn )
+	  if ( i_src == dropRow )
 	    i_src++;
 
 	  for ( j_dest = 0, j_src = 0;
-		j_dest < _T_rows - 1 && j_src < _T_rows;
+		j_dest < _T_columns - 1 && j_src < _T_columns;
 		j_dest++, j_src++ )
 	    {	  
-	      if ( j_src == dropRow )
+	      if ( j_src == dropColumn )
 		j_src++;
 	      
 	      dest.set(i_dest, j_dest, _M_data[i_src][j_src]);
@@ -91,7 +383,7 @@ namespace spt
     }
 
     scalar_t
-    get(unsigned int row, unsigned int column)
+    get(unsigned int row, unsigned int column) const
     {
       return _M_data[row][column];
     }
@@ -102,58 +394,260 @@ namespace spt
       _M_data[row][column] = value;
     }
 
-    scalar_t
-    determinant()
+    /** Factor the matrix, in place, into lower and upper triangular
+     * matrices: P M = L U, with partial pivoting.  On return the matrix
+     * holds U on and above the diagonal, and L (whose diagonal elements
+     * are all 1) below it.
+     *
+     * @param pivots	Receives the row interchanges: row @c i was
+     *			swapped with row <code>pivots[i]</code> at step @c i.
+     *
+     * @return The sign of the permutation P (1 or -1), or 0 if the
+     * matrix is singular, in which case it is only partly factored.
+     */
+    int
+    decomposeLU(unsigned int pivots[_T_rows])
     {
-      scalar_t out(0);
+      requireSquare();
 
-      if ( _T_rows != _T_columns )
-	throw std::logic_error("The determinant is not defined for non-square matrices.");
-      
-      else
+      int sign ( 1 );
+      for ( unsigned int k ( 0 ); k < _T_rows; k++ )
 	{
-	  int j;
-	  MatrixMinor minor;
-	  for ( j = 0; j < _T_columns; j++ )
+	  unsigned int p ( k );
+	  scalar_t max ( S_ABS(_M_data[k][k]) );
+	  for ( unsigned int i ( k + 1 ); i < _T_rows; i++ )
+	    if ( S_ABS(_M_data[i][k]) > max )
+	      {
+		p = i;
+		max = S_ABS(_M_data[i][k]);
+	      }
+
+	  pivots[k] = p;
+	  if ( ! ( max > 0 ) )	/* zero or NaN */
+	    return 0;
+
+	  if ( p != k )
 	    {
-	      setMinorMatrix(minor, 0, j);
-	      out +=
-		((j % 2) ? 1 : -1)
-		* _M_data[0][j]
-		* minor.determinant();
+	      for ( unsigned int j ( 0 ); j < _T_columns; j++ )
+		std::swap(_M_data[k][j], _M_data[p][j]);
+	      sign = -sign;
+	    }
+
+	  for ( unsigned int i ( k + 1 ); i < _T_rows; i++ )
+	    {
+	      scalar_t l ( _M_data[i][k] /= _M_data[k][k] );
+	      for ( unsigned int j ( k + 1 ); j < _T_columns; j++ )
+		_M_data[i][j] -= l * _M_data[k][j];
 	    }
 	}
+      return sign;
+    }
 
+    /** Compute the determinant: in closed form for 2x2 to 4x4
+     *	matrices, by LU decomposition of a copy for others.
+     */
+    scalar_t
+    determinant() const
+    {
+      requireSquare();
+      return determinant(typename closed_form::available());
+    }
+
+    /** Solve <code>M x = b</code>.
+     *
+     * @param b		Right-hand side.
+     * @param x		Receives the solution; may be @p b.
+     *
+     * @throw std::domain_error if the matrix is singular.
+     */
+    void
+    solve(const scalar_t b[_T_rows], scalar_t x[_T_rows]) const
+    {
+      Matrix lu ( *this );
+      unsigned int pivots[_T_rows];
+      if ( ! lu.decomposeLU(pivots) )
+	throw std::domain_error("Cannot solve a system with a singular matrix.");
+
+      if ( x != b )
+	for ( unsigned int i ( 0 ); i < _T_rows; i++ )
+	  x[i] = b[i];
+      lu.substituteLU(pivots, x, 1);
+    }
+
+    /** Invert the matrix in place.
+     *
+     * @return @c false, leaving the matrix unchanged, if it is singular.
+     */
+    bool
+    invert()
+    {
+      requireSquare();
+      return invert(typename closed_form::available());
+    }
+
+    /** Compute the inverse.
+     *
+     * @throw std::domain_error if the matrix is singular.
+     */
+    Matrix
+    inverse() const
+    {
+      Matrix out ( *this );
+      if ( ! out.invert() )
+	throw std::domain_error("Cannot invert a singular matrix.");
+      return out;
+    }
+
+    /** Matrix product. */
+    template < unsigned int _K >
+    Matrix<_T_rows, _K>
+    operator * (const Matrix<_T_columns, _K>& b) const
+    {
+      Matrix<_T_rows, _K> out;
+      for ( unsigned int i ( 0 ); i < _T_rows; i++ )
+	{
+	  /* Row i of the product is a combination of the rows of b. */
+	  for ( unsigned int j ( 0 ); j < _K; j++ )
+	    out._M_data[i][j] = _M_data[i][0] * b._M_data[0][j];
+	  for ( unsigned int k ( 1 ); k < _T_columns; k++ )
+	    for ( unsigned int j ( 0 ); j < _K; j++ )
+	      out._M_data[i][j] += _M_data[i][k] * b._M_data[k][j];
+	}
       return out;
     }
 
-    /** Transpose a square matrix.
+    /** Product with column vector @p v. */
+    template < typename _MagCache >
+    Vec<_T_rows, scalar_t, _MagCache>
+    operator * (const Vec<_T_columns, scalar_t, _MagCache>& v) const
+    {
+      scalar_t out[_T_rows];
+      const scalar_t* x ( v.val() );
+      for ( unsigned int i ( 0 ); i < _T_rows; i++ )
+	{
+	  out[i] = _M_data[i][0] * x[0];
+	  for ( unsigned int j ( 1 ); j < _T_columns; j++ )
+	    out[i] += _M_data[i][j] * x[j];
+	}
+      return Vec<_T_rows, scalar_t, _MagCache>(static_cast<const scalar_t*>(out));
+    }
+
+    /** Apply the affine transform held in the top three rows of a 4x4
+     *	matrix (rotation and scale in the left three columns, translation
+     *	in the fourth) to point @p p.  The bottom row is ignored.
+     */
+    template < typename _MagCache >
+    Vec<3, scalar_t, _MagCache>
+    transformPoint(const Vec<3, scalar_t, _MagCache>& p) const
+    {
+      static_assert(_T_rows == 4 && _T_columns == 4, "transformPoint needs a 4x4 matrix");
+      scalar_t out[3];
+      const scalar_t* x ( p.val() );
+      for ( unsigned int i ( 0 ); i < 3; i++ )
+	out[i] = _M_data[i][0] * x[0] + _M_data[i][1] * x[1] + _M_data[i][2] * x[2] + _M_data[i][3];
+      return Vec<3, scalar_t, _MagCache>(static_cast<const scalar_t*>(out));
+    }
+
+    /**@name Batch transforms
      *
-     * @returns	The transposed matrix.
+     * Multiply every vector of an array by the matrix.  The
+     * structure-of-arrays versions run vectorized loops over blocks of
+     * points, each output component a sum of scaled input components;
+     * @p in and @p out may be the same array.
+     *@{
      */
-    Matrix<_T_rows, _T_columns>
-    transpose()
+    void
+    transform(const VecArray<_T_columns, scalar_t>& in, VecArray<_T_rows, scalar_t>& out) const
     {
-      if ( _T_rows != _T_columns )
-	throw std::logic_error("Only square matrices can be transposed.");
+      const scalar_t* x[_T_columns];
+      scalar_t* y[_T_rows];
+
+      out.resize(in.size());
+      for ( unsigned int j ( 0 ); j < _T_columns; j++ )
+	x[j] = in.component(j);
+      for ( unsigned int i ( 0 ); i < _T_rows; i++ )
+	y[i] = out.component(i);
+
+      transformComponents<_T_rows, _T_columns>(x, y, in.size(), false);
+    }
+
+    /** Apply transformPoint to each point of @p in. */
+    void
+    transformPoints(const VecArray<3, scalar_t>& in, VecArray<3, scalar_t>& out) const
+    {
+      static_assert(_T_rows == 4 && _T_columns == 4, "transformPoints needs a 4x4 matrix");
+      out.resize(in.size());
+
+      const scalar_t* x[3] = { in.component(0), in.component(1), in.component(2) };
+      scalar_t* y[3] = { out.component(0), out.component(1), out.component(2) };
+      transformComponents<3, 3>(x, y, in.size(), true);
+    }
 
-      Matrix<_T_rows, _T_columns> out;
+    /** Multiply @p n vectors at @p in, storing the results at @p out
+     *	(which may be @p in when the matrix is square).
+     */
+    template < typename _MagCache >
+    void
+    transform(const Vec<_T_columns, scalar_t, _MagCache>* in, Vec<_T_rows, scalar_t, _MagCache>* out,
+	      size_t n) const
+    {
+      for ( size_t p ( 0 ); p < n; p++ )
+	out[p] = *this * in[p];
+    }
+
+    /** Apply transformPoint to @p n points at @p in, storing the
+     *	results at @p out (which may be @p in).
+     */
+    template < typename _MagCache >
+    void
+    transformPoints(const Vec<3, scalar_t, _MagCache>* in, Vec<3, scalar_t, _MagCache>* out,
+		    size_t n) const
+    {
+      for ( size_t p ( 0 ); p < n; p++ )
+	out[p] = transformPoint(in[p]);
+    }
+    /**@}*/
+
+    /** Transpose the matrix.
+     *
+     * @returns	The transposed matrix.
+     */
+    Matrix<_T_columns, _T_rows>
+    transpose() const
+    {
+      Matrix<_T_columns, _T_rows> out;
       unsigned int i, j;
 
-      for ( i = 0; i < _T_rows; i++ )
-	for ( j = i; j < _T_columns; j++ )
-	  {
-	    out._M_data[i][j] =  _M_data[j][i];
-	    out._M_data[j][i] =  _M_data[i][j];
-	  }
+      if ( _T_rows <= matrix_detail::transpose_tile<scalar_t>::size
+	   && _T_columns <= matrix_detail::transpose_tile<scalar_t>::size )
+	{
+	  for ( i = 0; i < _T_rows; i++ )
+	    for ( j = 0; j < _T_columns; j++ )
+	      out._M_data[j][i] = _M_data[i][j];
+	}
+      else
+	matrix_detail::transpose_block(&_M_data[0][0], _T_columns, &out._M_data[0][0], _T_rows,
+				       _T_rows, _T_columns);
 
       return out;
     }
 
+    /** Transpose a square matrix in place.
+     *
+     * @returns	A reference to the matrix.
+     */
+    Matrix&
+    transposeInPlace()
+    {
+      static_assert(_T_rows == _T_columns, "only square matrices can be transposed in place");
+      matrix_detail::transpose_square(&_M_data[0][0], _T_columns, _T_rows);
+      return *this;
+    }
+
     void
-    print()
+    print() const
     {
-      int i, j;
+      unsigned int i, j;
 
       /* printf("{\n"); */
       for ( i = 0; i < _T_rows; i++ )
@@ -180,22 +674,129 @@ namespace spt
       /* printf("};\n"); */
     }
 
+  private:
+    typedef matrix_detail::closed_form<_T_rows, _T_columns> closed_form;
+
+    scalar_t
+    determinant(std::true_type) const
+    {
+      return closed_form::determinant(_M_data);
+    }
+
+    scalar_t
+    determinant(std::false_type) const
+    {
+      Matrix lu ( *this );
+      unsigned int pivots[_T_rows];
+      scalar_t out ( static_cast<scalar_t>(lu.decomposeLU(pivots)) );
+
+      for ( unsigned int i ( 0 ); i < _T_rows && S_NONZERO(out); i++ )
+	out *= lu._M_data[i][i];
+      return out;
+    }
+
+    bool
+    invert(std::true_type)
+    {
+      return closed_form::invert(Matrix(*this)._M_data, _M_data);
+    }
+
+    bool
+    invert(std::false_type)
+    {
+      Matrix lu ( *this );
+      unsigned int pivots[_T_rows];
+      if ( ! lu.decomposeLU(pivots) )
+	return false;
+
+      for ( unsigned int i ( 0 ); i < _T_rows; i++ )
+	for ( unsigned int j ( 0 ); j < _T_columns; j++ )
+	  _M_data[i][j] = ( i == j ) ? 1 : 0;
+      lu.substituteLU(pivots, &_M_data[0][0], _T_columns);
+      return true;
+    }
+
+    /** <code>y[i][p] = sum over j of M[i][j] x[j][p]</code>, for the
+     *	top-left @p _R x @p _C block of the matrix, plus <code>M[i][_C]</code>
+     *	if @p translate is set.  The sums for a block of points go to a
+     *	local buffer, which (unlike the output) can't alias the input or
+     *	the matrix, before being copied out.
+     */
+    template < unsigned int _R, unsigned int _C >
+    void
+    transformComponents(const scalar_t* const x[_C], scalar_t* const y[_R], size_t n, bool translate) const
+    {
+      const size_t block ( 256 );
+      scalar_t r[_R][block];
+
+      for ( size_t start ( 0 ); start < n; start += block )
+	{
+	  size_t m ( n - start < block ? n - start : block );
+	  for ( unsigned int i ( 0 ); i < _R; i++ )
+	    {
+	      const scalar_t t ( translate ? _M_data[i][_C] : 0 );
+	      scalar_t mi[_C];
+	      const scalar_t* xs[_C];
+	      for ( unsigned int j ( 0 ); j < _C; j++ )
+		{
+		  mi[j] = _M_data[i][j];
+		  xs[j] = x[j] + start;
+		}
+	      for ( size_t p ( 0 ); p < m; p++ )
+		{
+		  scalar_t sum ( t );
+		  for ( unsigned int j ( 0 ); j < _C; j++ )
+		    sum += mi[j] * xs[j][p];
+		  r[i][p] = sum;
+		}
+	    }
+	  for ( unsigned int i ( 0 ); i < _R; i++ )
+	    {
+	      scalar_t* yi ( y[i] + start );
+	      for ( size_t p ( 0 ); p < m; p++ )
+		yi[p] = r[i][p];
+	    }
+	}
+    }
+
   protected:
-    scalar_t _M_data[_T_rows][_T_columns];
-  };
+    void
+    requireSquare() const
+    {
+      if ( _T_rows != _T_columns )
+	throw std::logic_error("The operation is defined for square matrices only.");
+    }
 
-  
-  scalar_t
-  Matrix<2,2>::determinant()
-  {
-    return ( _M_data[0][0] * _M_data[1][1] ) - ( _M_data[0][1] * _M_data[1][0] );
-  }
+    /** Solve <code>L U X = P B</code> in place, for this matrix as
+     *	factored by decomposeLU and a @c _T_rows x @p n matrix @c B
+     *	stored row by row at @p b.
+     */
+    void
+    substituteLU(const unsigned int pivots[_T_rows], scalar_t* b, unsigned int n) const
+    {
+      for ( unsigned int k ( 0 ); k < _T_rows; k++ )
+	if ( pivots[k] != k )
+	  for ( unsigned int j ( 0 ); j < n; j++ )
+	    std::swap(b[k * n + j], b[pivots[k] * n + j]);
+
+      for ( unsigned int i ( 1 ); i < _T_rows; i++ )
+	for ( unsigned int k ( 0 ); k < i; k++ )
+	  for ( unsigned int j ( 0 ); j < n; j++ )
+	    b[i * n + j] -= _M_data[i][k] * b[k * n + j];
+
+      for ( unsigned int i ( _T_rows ); i-- > 0; )
+	{
+	  for ( unsigned int k ( i + 1 ); k < _T_rows; k++ )
+	    for ( unsigned int j ( 0 ); j < n; j++ )
+	      b[i * n + j] -= _M_data[i][k] * b[k * n + j];
+	  for ( unsigned int j ( 0 ); j < n; j++ )
+	    b[i * n + j] /= _M_data[i][i];
+	}
+    }
+
+    alignas(16) scalar_t _M_data[_T_rows][_T_columns];
+  };
 
-  virtual void
-  Matrix<1,1>::setMinorMatrix()
-  {
-    return;
-  }
 
 }
 
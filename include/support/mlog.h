@@ -2,6 +2,7 @@
 #define SUPPORT_MLOG_H	1
 
 #include <stdarg.h>
+#include <stddef.h>
 #include <support/support-config.h>
 
 /** @defgroup mlog MLog: Lightweight Logging Utility
@@ -101,6 +102,14 @@ extern "C"
    */
   int mlogv(const unsigned long spec, const char* fmt, va_list ap);
 
+  /** Variadic back-end for MLog that also reports how much output it
+   * produced.
+   *
+   * @param written If non-@c NULL, receives the number of bytes
+   * written for this message, including any prefix and newline.
+   */
+  int mlogvn(const unsigned long spec, const char* fmt, va_list ap, size_t* written);
+
   /** Get the current global logging level.
    */
   mlog_loglevel_t
@@ -43,7 +43,23 @@ extern "C"
       /** If set, a context will not be enabled through implicit
        *	state-inheritance.
        */
-      SPT_CONTEXT_NO_IMPLICIT_STATE = 1 << 4
+      SPT_CONTEXT_NO_IMPLICIT_STATE = 1 << 4,
+
+      /** If set, only a random sample of the messages logged to an
+       * active context will be written.
+       * @see spt_context_set_sample_rate
+       */
+      SPT_CONTEXT_SAMPLED = 1 << 5,
+
+      /** If set, callbacks set on ancestors of a context are not
+       * invoked for it (or for its subcontexts).
+       */
+      SPT_CONTEXT_NO_CALLBACK_INHERITANCE = 1 << 6,
+
+      /** Activation state most recently reported to state-change
+       * callbacks.
+       */
+      SPT_CONTEXT_NOTIFIED_STATE = 1 << 7
     };
 
   /** Log context data structure.
@@ -77,11 +93,30 @@ extern "C"
     spt_context_handler_t* output_handler;
 #endif
 
+#ifdef SPT_CONTEXT_ENABLE_CALLBACKS
+    /** Event callbacks for this context and its subcontexts. */
+    const spt_context_callbacks_t* callbacks;
+
+    /** User data passed to @c callbacks. */
+    void* callbacks_user_data;
+#endif
+
     /** State flags.
      * @see spt_context_flags
      */
     unsigned long int flags;
 
+    /** Sampling threshold: when SPT_CONTEXT_SAMPLED is set, a message
+     * is logged only if the next per-thread random number is below
+     * this value.
+     */
+    uint32_t sample_threshold;
+
+#ifdef SPT_CONTEXT_ENABLE_STATISTICS
+    /** Log-volume counters.  Access only with atomic operations. */
+    spt_context_stats_t stats;
+#endif
+
     /**@name Context relations
      *@{
      */
@@ -122,6 +157,12 @@ extern "C"
      */
     unsigned long int flags;
 
+    /** Sampling rate to assign to matching contexts, if
+     * SPT_CONTEXT_SAMPLED is set in @c mask.
+     * @see spt_context_set_sample_rate
+     */
+    double sample_rate;
+
     /** Copy of the single_spec input string.
      */
     char* input;
@@ -139,6 +180,102 @@ extern "C"
     struct __spt_context_parse_spec* next;
   };
 
+  /** Kinds of name-element pattern recognized by a compiled parse
+   * spec.
+   * @internal
+   */
+  enum spt_context_pattern_kind
+    {
+      /** Matches a single name element exactly. */
+      SPT_CONTEXT_PATTERN_LITERAL,
+
+      /** <code>*</code>: matches any single name element. */
+      SPT_CONTEXT_PATTERN_ANY,
+
+      /** Matches a single name element using fnmatch(3). */
+      SPT_CONTEXT_PATTERN_GLOB,
+
+      /** <code>**</code>: matches zero or more name elements. */
+      SPT_CONTEXT_PATTERN_ANY_SEQUENCE
+    };
+
+  /** Matcher state.  Each element of a parse spec's name array gets
+   * one state, plus one accepting state per parse spec.
+   * @internal
+   */
+  struct __spt_context_spec_state
+  {
+    /** Pattern kind (one of spt_context_pattern_kind). */
+    unsigned char kind;
+
+    /** Pattern string for the transition out of this state, or @c
+     * NULL for accepting states.
+     */
+    const char* pattern;
+
+    /** Parse spec to which this state belongs. */
+    const struct __spt_context_parse_spec* spec;
+  };
+
+  /** Literal-name transition out of a matcher state.
+   * @internal
+   */
+  struct __spt_context_spec_edge
+  {
+    /** Name element that triggers the transition. */
+    const char* name;
+
+    /** State from which the transition leaves. */
+    size_t state;
+  };
+
+  /** @ingroup context_spec
+   *
+   * Compiled form of a parse-spec list: a non-deterministic automaton
+   * over context-name elements, simulated with one bit per state.
+   */
+  struct __spt_context_spec_matcher
+  {
+#ifdef SPT_ENABLE_CONSISTENCY_CHECKS
+    uint32_t magic;    /**< Magic number */
+#endif
+
+    /** Total number of states. */
+    size_t num_states;
+
+    /** Number of words in each state set. */
+    size_t num_words;
+
+    /** Per-state data, indexed by state number. */
+    struct __spt_context_spec_state* states;
+
+    /** Number of entries in @c literals. */
+    size_t num_literals;
+
+    /** Literal transitions, sorted by name so that all transitions
+     * for a given context name can be found with a single binary
+     * search.
+     */
+    struct __spt_context_spec_edge* literals;
+
+    /** Set of initial states (with any <code>**</code> prefixes
+     * already followed).  These are active at every context, which
+     * is what makes parse specs match name suffixes.
+     */
+    unsigned long int* start;
+
+    /** Set of accepting states. */
+    unsigned long int* accept;
+
+    /** Number of entries in @c wild. */
+    size_t num_wild;
+
+    /** States whose outgoing pattern is not a literal, in ascending
+     * order.
+     */
+    size_t* wild;
+  };
+
   /** Determine if a context is activated.
    *
    * @param cxt Pointer to the context to examine
@@ -148,6 +285,87 @@ extern "C"
    */
 #define spt_context_active(cxt) ( SPT_IS_CONTEXT(cxt) ? spt_context_state(cxt->flags) : 0 )
 
+#ifdef SPT_CONTEXT_ENABLE_OUTPUT_HANDLERS
+  /** Format a message and pass it to an output handler.
+   *
+   * @internal
+   *
+   * @param written If non-@c NULL, receives the length of the line
+   * passed to the handler.
+   *
+   * @return As for mlog, or &lt; 0 on error.
+   */
+  int
+  spt_context_handler_vlog(spt_context_handler_t* handler,
+			   const struct __spt_context* context,
+			   const unsigned long spec,
+			   const char* fmt,
+			   va_list ap,
+			   size_t* written);
+#endif
+
+#ifdef SPT_CONTEXT_ENABLE_CALLBACKS
+  /** Dispatch state-change callbacks for contexts under @p root whose
+   * state has changed, unless a batch of updates is in progress.
+   *
+   * @internal
+   */
+  void
+  spt_context_dispatch_state_changes(struct __spt_context* root);
+#else
+#define spt_context_dispatch_state_changes(root) ((void) (root))
+#endif
+
+  /** Per-thread state for the sampling random-number generator; zero
+   * until the thread is seeded.
+   * @internal
+   */
+  extern __thread uint32_t spt_context_sample_state;
+
+  /** Seed the calling thread's sampling generator from the address of
+   * its state and the time, so that threads draw different sequences.
+   *
+   * @internal
+   *
+   * @return The new state.
+   */
+  uint32_t
+  spt_context_sample_seed(void);
+
+  /** Advance the per-thread sampling generator (xorshift32).  The
+   * calling thread's state must have been seeded; spt_context_sampled
+   * takes care of that, which keeps this function small enough to
+   * inline.
+   *
+   * @internal
+   *
+   * @return The next pseudo-random number.
+   */
+  static __inline__ uint32_t
+  spt_context_sample_next(void)
+  {
+    uint32_t x = spt_context_sample_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    spt_context_sample_state = x;
+    return x;
+  }
+
+  /** Decide whether a message logged to an active context should be
+   * written.  Contexts without a sampling rate always pass, without
+   * touching the generator.
+   *
+   * @param cxt Pointer to an active context.
+   *
+   * @return Non-zero if the message should be logged.
+   */
+#define spt_context_sampled(cxt)					\
+  ( ! ( (cxt)->flags & SPT_CONTEXT_SAMPLED )				\
+    || ( ( __builtin_expect(spt_context_sample_state == 0, 0)		\
+	   ? (void) spt_context_sample_seed() : (void) 0 ),		\
+	 spt_context_sample_next() < (cxt)->sample_threshold ) )
+
   /** Extract the activation state of a context from its flags variable.
    *
    * @internal
@@ -185,6 +403,11 @@ extern "C"
      */
     #define SPT_CONTEXT_PARSE_SPEC_MAGIC ( ( 'S' << 24 ) + ( 'P' << 16 ) + ( 'E' << 8 ) + 'C' )
 
+    /** Magic number for compiled parse-spec matchers.
+     * @internal
+     */
+    #define SPT_CONTEXT_SPEC_MATCHER_MAGIC ( ( 'S' << 24 ) + ( 'M' << 16 ) + ( 'A' << 8 ) + 'T' )
+
     /** Check if the argument is a well-initialized log context.
      * @internal
      */
@@ -197,10 +420,17 @@ extern "C"
     #define SPT_IS_CONTEXT_PARSE_SPEC(pspec)				\
       ( pspec && ((spt_context_parse_spec_t*) pspec)->magic == SPT_CONTEXT_PARSE_SPEC_MAGIC )
 
+    /** Check if the argument is a well-initialized spec matcher.
+     * @internal
+     */
+    #define SPT_IS_CONTEXT_SPEC_MATCHER(m)				\
+      ( m && ((spt_context_spec_matcher_t*) m)->magic == SPT_CONTEXT_SPEC_MATCHER_MAGIC )
+
     #define SPT_CONTEXT_HAS_CHILDREN(cxt) ( SPT_IS_CONTEXT(cxt) && cxt->first_child != NULL )
   #else
     #define SPT_IS_CONTEXT(cxt) (cxt)
     #define SPT_IS_CONTEXT_PARSE_SPEC(pspec) (pspec)
+    #define SPT_IS_CONTEXT_SPEC_MATCHER(m) (m)
     #define SPT_CONTEXT_HAS_CHILDREN(cxt) (cxt->first_child != NULL )
   #endif
 
@@ -8,16 +8,20 @@
 #define support_spt_context_callbacks_h 1
 
 #include <support/support-config.h>
+#include <stdint.h>
+
+#ifdef SPT_CONTEXT_ENABLE_CALLBACKS
 
 #ifdef __cplusplus
 extern "C"
 {
 #endif
 
-#ifdef SPT_CONTEXT_ENABLE_CALLBACKS
+  struct __spt_context;
+
   /** Callback container structure for log contexts.  This provides a
    * concise way to specify and store the collection of callbacks for
-   * one or more contexts.
+   * one or more contexts.  Any member may be @c NULL.
    *
    * @note Like a context's state, its callbacks are also inherited by
    *   its children; however, unlike its state, explicitly setting a
@@ -29,6 +33,9 @@ extern "C"
    * spt_context_callbacks_set_inheritance(cxt, SPT_CONTEXT_CALLBACKS_NO_INHERITANCE);
    *   @endcode
    *
+   * Callbacks are never invoked from the logging path; cmlog costs the
+   * same with or without them.
+   *
    * @ingroup context
    */
   typedef struct __spt_context_callbacks
@@ -47,6 +54,28 @@ extern "C"
     void (*pre_destroy)(struct __spt_context* context, void* user_data);
     /**@}*/
 
+    /** @name State changes
+     *@{
+     */
+    /** Pointer-to-function called when a context's effective
+     * (explicit or inherited) activation state changes.
+     *
+     * Notifications are dispatched once a reconfiguration -- a call
+     * to spt_context_enable, spt_context_disable, spt_context_reset,
+     * spt_context_apply_parse_specs and friends, or a whole
+     * spt_context_begin_update / spt_context_end_update block -- has
+     * finished, and only for contexts whose state differs from the
+     * state last reported.  A context switched off and back on within
+     * one reconfiguration is therefore not reported at all.
+     *
+     * @param context The context whose state changed.
+     *
+     * @param active New state: @c 1 if the context is now active, @c 0
+     * otherwise.
+     */
+    void (*state_changed)(struct __spt_context* context, uint8_t active, void* user_data);
+    /**@}*/
+
     /** @name Hierarchy changes
      *@{
      */
@@ -59,13 +88,80 @@ extern "C"
 
 
     /** Pointer-to-function called when a new child has been added. */
-    void (*post_child_add)(struct __spt_context* this_context, struct __spt_context* child);
+    void (*post_child_add)(struct __spt_context* this_context, struct __spt_context* child, void* user_data);
 
 
     /** Pointer-to-function called before a child is removed. */
-    void (*pre_child_remove)(struct __spt_context* this_context, struct __spt_context* child);
+    void (*pre_child_remove)(struct __spt_context* this_context, struct __spt_context* child, void* user_data);
   /**@}*/
   } spt_context_callbacks_t;
+
+  /** Arguments to spt_context_callbacks_set_inheritance.
+   * @ingroup context
+   */
+  enum spt_context_callbacks_inheritance
+    {
+      /** Invoke callbacks set on ancestors, too (the default). */
+      SPT_CONTEXT_CALLBACKS_INHERITANCE,
+
+      /** Ignore callbacks set on ancestors. */
+      SPT_CONTEXT_CALLBACKS_NO_INHERITANCE
+    };
+
+  /** Set the callbacks for a context and, by inheritance, its
+   * subcontexts.
+   *
+   * @param context The context to modify.
+   *
+   * @param callbacks Callbacks to invoke, or @c NULL to remove the
+   * context's own callbacks.  The structure is not copied, and must
+   * outlive the context.
+   *
+   * @param user_data Passed as the final argument to each callback.
+   *
+   * @ingroup context
+   */
+  void
+  spt_context_set_callbacks(struct __spt_context* context,
+			    const spt_context_callbacks_t* callbacks,
+			    void* user_data);
+
+  /** Control whether a context (and so its subcontexts) inherits
+   * callbacks from its ancestors.
+   *
+   * @param context The context to modify.
+   *
+   * @param inheritance One of spt_context_callbacks_inheritance.
+   *
+   * @ingroup context
+   */
+  void
+  spt_context_callbacks_set_inheritance(struct __spt_context* context,
+					enum spt_context_callbacks_inheritance inheritance);
+
+  /** Begin a batch of reconfigurations.  State-change callbacks are
+   * deferred until the matching spt_context_end_update.  Batches may
+   * be nested.
+   *
+   * @ingroup context
+   */
+  void
+  spt_context_begin_update(void);
+
+  /** End a batch of reconfigurations, and dispatch state-change
+   * callbacks for every context under @p root whose state has changed.
+   *
+   * @param root Context hierarchy affected by the batch.
+   *
+   * @ingroup context
+   */
+  void
+  spt_context_end_update(struct __spt_context* root);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif  /* defined(SPT_CONTEXT_ENABLE_CALLBACKS) */
 
 #endif	/* support_spt_context_callbacks_h */
@@ -10,6 +10,10 @@
 
 #ifdef SPT_CONTEXT_ENABLE_OUTPUT_HANDLERS
 
+#include <pthread.h>
+#include <stdint.h>
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -19,6 +23,22 @@ extern "C"
    *  @ingroup context
    *
    * @brief Modular output handling for log contexts.
+   *
+   * A context without an output handler of its own uses the handler
+   * of its nearest ancestor that has one; if there is none, messages
+   * go to mlog as usual.  This makes it easy to send all of a
+   * subsystem's messages to a dedicated file:
+   *
+   * @code
+   * spt_context_handler_t* h = spt_context_handler_open("net.log", 0, 1000);
+   * spt_context_set_handler(net_context, h);
+   * ...
+   * spt_context_handler_destroy(h);
+   * @endcode
+   *
+   * Handlers are owned by the caller; destroying a context does not
+   * destroy its handler, and a handler must outlive every context that
+   * uses it.
    * @{
    */
   /** Opaque interface to the output handler objects for spt_context.
@@ -43,6 +63,8 @@ extern "C"
    *   - Check if the context is active.  If the context is not
    *     active, the function will not be called.
    *
+   * @param handler The handler through which the data is being
+   * written.
    *
    * @param context A reference to the context in (for) which the
    * handler function has been called.
@@ -54,22 +76,41 @@ extern "C"
    * @return Number of bytes written, or &lt; 0 if an error was
    * encountered.
    */
-  typedef int (*spt_context_write_func_t)(const spt_context_t* context,
-					  const char* data,
-					  const ssize_t length);
+  typedef ssize_t (*spt_context_write_func_t)(spt_context_handler_t* handler,
+					      const spt_context_t* context,
+					      const char* data,
+					      const size_t length);
 
 
-  /** Log message format function prototype.
+  /** Log message format function prototype.  Formats a single log
+   * line, in the manner of snprintf(3).
    *
    * @requirements
    * Any implementations of this should
    *   - Be completely thread-safe
+   *   - Never write more than @p dest_size bytes (including the
+   *     terminating NUL) to @p dest.
+   *
+   * @param context Context in which the message was logged.
+   *
+   * @param level Log level of the message.
+   *
+   * @param message The (already printf-expanded) message text.
    *
+   * @param dest Destination buffer.
+   *
+   * @param dest_size Size of @p dest, in bytes.
+   *
+   * @return Length of the complete formatted line, excluding the
+   * terminating NUL, or &lt; 0 on error.  If this is not less than
+   * @p dest_size, the function will be called again with a larger
+   * buffer.
    */
   typedef int (*spt_context_format_func_t)(const spt_context_t* context,
 					   const spt_loglevel_t level,
 					   const char* message,
-					   void* output_dest);
+					   char* dest,
+					   const size_t dest_size);
   /**@}*/
 
 
@@ -81,7 +122,154 @@ extern "C"
 
     spt_context_write_func_t write;
     spt_context_format_func_t format;
+
+    /** Arbitrary data for use by custom write/format functions. */
+    void* user_data;
+
+    /**@name Buffered file-descriptor output
+     *@{
+     */
+    /** Destination file descriptor, or -1. */
+    int fd;
+
+    /** If non-zero, @c fd is closed when the handler is destroyed. */
+    int owns_fd;
+
+    /** Write buffer. */
+    char* buffer;
+
+    /** Capacity of @c buffer, in bytes. */
+    size_t buffer_size;
+
+    /** Number of bytes currently held in @c buffer. */
+    size_t buffer_used;
+
+    /** Maximum age of buffered data, in nanoseconds; zero flushes
+     *  only when the buffer fills.
+     */
+    uint64_t flush_interval;
+
+    /** CLOCK_MONOTONIC time of the last flush, in nanoseconds. */
+    uint64_t last_flush;
+
+    /** Serializes access to the buffer and the flush-thread state. */
+    pthread_mutex_t lock;
+
+    /** Wakes the flush thread when data is buffered or it should stop. */
+    pthread_cond_t flush_wake;
+
+    /** Thread that writes out data older than @c flush_interval. */
+    pthread_t flush_thread;
+
+    /** Non-zero if @c flush_thread was started. */
+    int flush_thread_running;
+
+    /** Set to make @c flush_thread exit. */
+    int flush_stop;
+    /**@}*/
   };
+
+  /** Default size of a handler's write buffer. */
+#define SPT_CONTEXT_HANDLER_DEFAULT_BUFFER_SIZE 65536
+
+  /**@name Handler management
+   *@{
+   */
+  /** Create a custom output handler.
+   *
+   * @param write Function used to write formatted lines.
+   *
+   * @param format Function used to format lines, or @c NULL to use
+   * spt_context_default_format.
+   *
+   * @param user_data Value to store in the handler's @c user_data
+   * member.
+   *
+   * @return A new handler, or @c NULL on error.
+   */
+  spt_context_handler_t*
+  spt_context_handler_create(spt_context_write_func_t write,
+			     spt_context_format_func_t format,
+			     void* user_data);
+
+  /** Create a handler that buffers output for a file descriptor.
+   * Buffered data is written when the buffer fills, at most
+   * @p flush_interval_ms milliseconds after the last flush, and when
+   * the handler is flushed or destroyed.
+   *
+   * With a non-zero @p flush_interval_ms the handler starts a thread
+   * that writes out buffered data once it is due, so messages reach
+   * @p fd even if nothing else is logged.  If the thread can't be
+   * started, due data is only written when the next message arrives.
+   *
+   * @param fd File descriptor to write to.
+   *
+   * @param buffer_size Size of the write buffer, or zero to use
+   * SPT_CONTEXT_HANDLER_DEFAULT_BUFFER_SIZE.
+   *
+   * @param flush_interval_ms Maximum age of buffered data, or zero to
+   * flush only when the buffer fills.
+   *
+   * @param take_ownership If non-zero, @p fd will be closed when the
+   * handler is destroyed.
+   *
+   * @return A new handler, or @c NULL on error.
+   */
+  spt_context_handler_t*
+  spt_context_handler_create_fd(int fd, size_t buffer_size,
+				unsigned int flush_interval_ms,
+				int take_ownership);
+
+  /** Open (for appending) a file and create a buffered handler for
+   * it.
+   *
+   * @see spt_context_handler_create_fd
+   */
+  spt_context_handler_t*
+  spt_context_handler_open(const char* path, size_t buffer_size,
+			   unsigned int flush_interval_ms);
+
+  /** Write out any data buffered by a handler.
+   *
+   * @return @c 0 on success, or &lt; 0 if an error was encountered.
+   */
+  int
+  spt_context_handler_flush(spt_context_handler_t* handler);
+
+  /** Flush and destroy a handler.  No context may use the handler
+   * after this call.
+   */
+  void
+  spt_context_handler_destroy(spt_context_handler_t* handler);
+
+  /** Set the output handler for a context and (unless they have their
+   * own) its subcontexts.
+   *
+   * @param context The context to modify.
+   *
+   * @param handler New handler, or @c NULL to inherit the parent's
+   * handler again.
+   */
+  void
+  spt_context_set_handler(spt_context_t* context, spt_context_handler_t* handler);
+
+  /** Find the output handler in effect for a context.
+   *
+   * @return The handler set on @p context or its nearest ancestor,
+   * or @c NULL if messages go to mlog.
+   */
+  spt_context_handler_t*
+  spt_context_get_handler(const spt_context_t* context);
+
+  /** Default line format: <code>[L] [context.name] message\\n</code>,
+   * where @c L is the first letter of the log level.
+   */
+  int
+  spt_context_default_format(const spt_context_t* context,
+			     const spt_loglevel_t level,
+			     const char* message,
+			     char* dest,
+			     const size_t dest_size);
   /**@}*/
   /**@}*/
 
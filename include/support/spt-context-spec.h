@@ -26,15 +26,19 @@ extern "C"
    * @verbatim 
 spec			= single_spec *("," single_spec)
 
-single-spec		= [channel-identifier] state-flag context-identifier
+single-spec		= [channel-identifier] state-flag context-identifier [ "/" sample-rate ]
 
 state-flag		= "+" / "-"
 
 channel-identifier	= "fatal" / ( "err" / "error" ) / ( "warn" / "warning" ) / "debug" / "info"
 
-context-identifier	= context-name *("." context-name)
+context-identifier	= name-pattern *("." name-pattern)
 
-context-name		= <any CHAR excluding "." and ",">
+name-pattern		= "**" / context-name
+
+context-name		= <any CHAR excluding ".", "," and "/">
+
+sample-rate		= <positive number, as accepted by strtod(3)>
 @endverbatim
    *
    * For example, one would enable a context named @c context_name
@@ -43,6 +47,29 @@ context-name		= <any CHAR excluding "." and ",">
    * To enable a certain (single) child context with a non-unique
    * name: <code>+parent_name.child_name</code>
    *
+   * A context-identifier matches any context whose full name
+   * <em>ends</em> with the given name elements.  Within a
+   * name-pattern, the fnmatch(3) wildcards <code>*</code>,
+   * <code>?</code> and <code>[...]</code> match against a single
+   * name element, while a name-pattern of <code>**</code> matches
+   * zero or more whole name elements.  For example,
+   * <code>+net.*.rx</code> enables @c rx in any direct child of @c
+   * net, and <code>-net.**.debug</code> disables every @c debug
+   * context anywhere below @c net.
+   *
+   * A sample-rate may follow a "+" spec to log only some of the
+   * messages sent to the matching contexts: <code>+net.rx/100</code>
+   * keeps about one message in a hundred, and
+   * <code>+net.rx/0.25</code> keeps about a quarter of them (see
+   * spt_context_set_sample_rate).  A "+" spec without a sample-rate
+   * turns sampling off.
+   *
+   * Parse-spec lists are compiled into a small matching automaton
+   * (see spt_context_compile_parse_specs), so applying any number of
+   * specs to a context hierarchy takes a single traversal of that
+   * hierarchy.  When several specs match the same context, the last
+   * one in the list wins.
+   *
    *@{
    */
 
@@ -52,6 +79,11 @@ context-name		= <any CHAR excluding "." and ",">
    */
   typedef struct __spt_context_parse_spec spt_context_parse_spec_t;
 
+  /** Compiled, reusable form of a list of parse specifications.
+   * @ingroup context_spec
+   */
+  typedef struct __spt_context_spec_matcher spt_context_spec_matcher_t;
+
   /** Use a string value to enable or disable multiple contexts.
    * Parses the passed string, and searches for similarly-named
    * contexts under the given root context.
@@ -67,7 +99,8 @@ context-name		= <any CHAR excluding "." and ",">
   void
   spt_context_parse_specs_append(spt_context_parse_spec_t* to, spt_context_parse_spec_t* what);
 
-  /** Free the memory used by a parse specification.
+  /** Free the memory used by a parse specification, and by any
+   * parse specifications that follow it in its list.
    *
    * @param pspec A pointer to the parse specification object to free.
    */
@@ -84,9 +117,14 @@ context-name		= <any CHAR excluding "." and ",">
   spt_context_parse_spec_destroy_list(spt_context_parse_spec_t* pspec_list);
 
 
-  /** Apply matching parse specifications to a context.  Each parse
-   * specification in the list will be tested, and if it matches the
-   * context, it will be applied to the context.
+  /** Apply matching parse specifications to a context and all of its
+   * subcontexts.  Each parse specification in the list will be
+   * tested, and if it matches a context, it will be applied to that
+   * context.
+   *
+   * This is a convenience wrapper around
+   * spt_context_compile_parse_specs and spt_context_apply_spec_matcher;
+   * use those directly to apply the same list more than once.
    *
    * @param context The context to apply the parse specifications to.
    *
@@ -97,6 +135,37 @@ context-name		= <any CHAR excluding "." and ",">
   spt_context_apply_parse_specs(spt_context_t* context,
 				spt_context_parse_spec_t* pspec_list);
 
+  /** Compile a list of parse specifications into a matcher.
+   *
+   * @param pspec_list A list of parse specifications.  The list must
+   * not be destroyed before the returned matcher.
+   *
+   * @return A new matcher, or @c NULL if @p pspec_list is empty or
+   * memory could not be allocated.
+   */
+  spt_context_spec_matcher_t*
+  spt_context_compile_parse_specs(const spt_context_parse_spec_t* pspec_list);
+
+  /** Apply a compiled parse-spec list to a context and all of its
+   * subcontexts, in a single pre-order traversal.  Names of the
+   * ancestors of @p context are taken into account when matching.
+   *
+   * @param context Root of the context hierarchy to update.
+   *
+   * @param matcher Matcher returned by spt_context_compile_parse_specs.
+   */
+  void
+  spt_context_apply_spec_matcher(spt_context_t* context,
+				 const spt_context_spec_matcher_t* matcher);
+
+  /** Free the memory used by a compiled parse-spec list.
+   *
+   * @param matcher A matcher returned by
+   * spt_context_compile_parse_specs.
+   */
+  void
+  spt_context_spec_matcher_destroy(spt_context_spec_matcher_t* matcher);
+
   /**@}*/
 
 #ifdef __cplusplus
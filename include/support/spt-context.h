@@ -8,6 +8,7 @@
 
 #include <unistd.h>		/* for ssize_t */
 #include <stdint.h>
+#include <stdio.h>
 
 #include <support/support-config.h>
 #include <support/mlog.h>
@@ -37,6 +38,34 @@ extern "C"
   typedef struct __spt_context spt_context_t;
 
   typedef mlog_loglevel_t spt_loglevel_t;
+
+#ifdef SPT_CONTEXT_ENABLE_STATISTICS
+  /** Number of log levels for which statistics are kept. */
+#define SPT_CONTEXT_STATS_LEVELS ( MLOG_MAX_LOGLEVEL + 1 )
+
+  /** Log-volume counters for a context, indexed by log level.
+   *
+   * @see spt_context_get_stats
+   */
+  typedef struct __spt_context_stats
+  {
+    /** Number of messages written. */
+    uint64_t messages[SPT_CONTEXT_STATS_LEVELS];
+
+    /** Number of bytes written, including prefixes and newlines. */
+    uint64_t bytes[SPT_CONTEXT_STATS_LEVELS];
+  } spt_context_stats_t;
+
+  /** Output formats for spt_context_dump_stats. */
+  typedef enum
+    {
+      /** Fixed-width text table. */
+      SPT_CONTEXT_STATS_TABLE,
+
+      /** JSON array of objects. */
+      SPT_CONTEXT_STATS_JSON
+    } spt_context_stats_format_t;
+#endif
   /**@}*/
 /**@}*/
 
@@ -47,6 +76,9 @@ extern "C"
 #ifdef SPT_CONTEXT_ENABLE_OUTPUT_HANDLERS
 #include <support/spt-context-handlers.h>
 #endif
+#ifdef SPT_CONTEXT_ENABLE_CALLBACKS
+#include <support/spt-context-callbacks.h>
+#endif
 
 #include <support/private/spt-context.h>
 #include <support/spt-context-spec.h>
@@ -233,14 +265,96 @@ extern "C"
    */
   void
   spt_context_reset(spt_context_t* context);
+
+  /** Log only a random sample of the messages sent to a context.
+   * Unlike activation state, the sampling rate is not inherited by
+   * child contexts.
+   *
+   * @param context The context to modify.
+   *
+   * @param rate Either the fraction of messages to keep, if less
+   * than one, or @em N to keep (on average) one message in @em N.
+   * A rate of exactly @c 1.0 disables sampling, and a rate less than
+   * or equal to zero drops every message.
+   */
+  void
+  spt_context_set_sample_rate(spt_context_t* context, double rate);
+
+  /** Get the fraction of messages logged to a context that will be
+   * written while it is active.
+   *
+   * @param context The context to examine.
+   *
+   * @return A value in <code>[0, 1]</code>.
+   */
+  double
+  spt_context_get_sample_rate(const spt_context_t* context);
   /**@}*/
 
+#ifdef SPT_CONTEXT_ENABLE_STATISTICS
+  /** @name Statistics
+   *
+   * Every context counts the messages, and bytes, that are written to
+   * it at each log level.  Counters are updated with relaxed atomic
+   * operations, so they are cheap to maintain and safe to read while
+   * other threads log, but a snapshot taken during logging is not
+   * guaranteed to be consistent across counters.
+   *
+   * @{
+   */
+
+  /** Take a snapshot of a context's counters.
+   *
+   * @param context The context to examine.
+   *
+   * @param stats Destination for the snapshot.
+   */
+  void
+  spt_context_get_stats(const spt_context_t* context, spt_context_stats_t* stats);
+
+  /** Zero a context's counters.
+   *
+   * @param context The context to reset.
+   */
+  void
+  spt_context_reset_stats(spt_context_t* context);
+
+  /** Zero the counters of a context and of all of its subcontexts.
+   *
+   * @param context Root of the hierarchy to reset.
+   *
+   * @sa spt_context_reset_stats
+   */
+  void
+  spt_context_reset_stats_recursive(spt_context_t* context);
+
+  /** Write the counters of a context and all of its subcontexts,
+   * noisiest (by bytes written) first.
+   *
+   * @param context Root of the hierarchy to dump.
+   *
+   * @param out Stream to write to.
+   *
+   * @param format Output format.
+   *
+   * @return Number of contexts written, or &lt; 0 on error.
+   */
+  int
+  spt_context_dump_stats(const spt_context_t* context, FILE* out,
+			 spt_context_stats_format_t format);
+  /**@}*/
+#endif
+
   /** @name Logging
    *
    * Yeah, we do that too.
    *@{
    */
   /** Interface macro for logging messages in a given context.
+   *
+   * If the context is inactive, or has a sampling rate set and the
+   * message is not sampled, the remaining arguments are not
+   * evaluated.
    *
    * @param cxt The context in which to log.
    *
@@ -249,7 +363,7 @@ extern "C"
    * @see cmlog_real
    * @see mlog
    */
-#define cmlog(cxt, ...) if ( spt_context_active(cxt) ) cmlog_real(cxt, __VA_ARGS__)
+#define cmlog(cxt, ...) if ( spt_context_active(cxt) && spt_context_sampled(cxt) ) cmlog_real(cxt, __VA_ARGS__)
 
   /** Alias for cmlog */
 #define spt_logv cmlog
@@ -0,0 +1,20 @@
+#include <cstdlib>
+#include <new>
+#include <support/Arena.hh>
+
+namespace spt
+{
+  void
+  Arena::new_chunk(size_t minSize)
+  {
+    size_t size ( sizeof(Chunk) + ( minSize > m_chunkSize ? minSize : m_chunkSize ) );
+    Chunk* c ( static_cast<Chunk*>(malloc(size)) );
+    if ( ! c )
+      throw std::bad_alloc();
+    c->prev = m_chunk;
+    c->size = size;
+    m_chunk = c;
+    m_next = reinterpret_cast<char*>(c + 1);
+    m_end = reinterpret_cast<char*>(c) + size;
+  }
+}
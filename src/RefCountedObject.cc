@@ -7,7 +7,7 @@ namespace spt
   {
   }
 
-  RefCountedObject::~RefCountedObject() throw ( std::runtime_error )
+  RefCountedObject::~RefCountedObject() noexcept(false)
   {
     if ( refCount > 0 )
       throw std::runtime_error("In RefCountedObject::~RefCountedObject(): destructor called with refCount > 0");
@@ -0,0 +1,149 @@
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+#include <support/String.hh>
+#include <support/readFileIntoString.hh>
+
+namespace spt
+{
+  void*
+  string_data_allocate(size_t size, size_t align)
+  {
+    Arena* a ( string_arena() );
+    return a ? a->allocate(size, align) : ::operator new(size);
+  }
+
+  void
+  string_data_free(void* p, bool inArena)
+  {
+    if ( ! inArena )
+      ::operator delete(p);
+  }
+
+  uint64_t
+  hash_bytes(const void* data, size_t length, uint64_t seed) noexcept
+  {
+    using namespace hash_detail;
+    const unsigned char* p ( static_cast<const unsigned char*>(data) );
+    uint64_t a, b;
+
+    seed ^= mix(seed ^ p0, p1);
+    if ( length <= 16 )
+      {
+	if ( length >= 4 )
+	  {
+	    /* Two (possibly overlapping) 4-byte reads from each end. */
+	    size_t mid ( ( length >> 3 ) << 2 );
+	    a = ( read32(p) << 32 ) | read32(p + mid);
+	    b = ( read32(p + length - 4) << 32 ) | read32(p + length - 4 - mid);
+	  }
+	else if ( length > 0 )
+	  {
+	    a = ( static_cast<uint64_t>(p[0]) << 16 ) | ( static_cast<uint64_t>(p[length >> 1]) << 8 ) | p[length - 1];
+	    b = 0;
+	  }
+	else
+	  a = b = 0;
+      }
+    else
+      {
+	size_t i ( length );
+	if ( i > 48 )
+	  {
+	    uint64_t s1 ( seed ), s2 ( seed );
+	    do
+	      {
+		seed = mix(read64(p) ^ p1, read64(p + 8) ^ seed);
+		s1 = mix(read64(p + 16) ^ p2, read64(p + 24) ^ s1);
+		s2 = mix(read64(p + 32) ^ p3, read64(p + 40) ^ s2);
+		p += 48;
+		i -= 48;
+	      }
+	    while ( i > 48 );
+	    seed ^= s1 ^ s2;
+	  }
+	while ( i > 16 )
+	  {
+	    seed = mix(read64(p) ^ p1, read64(p + 8) ^ seed);
+	    p += 16;
+	    i -= 16;
+	  }
+	/* The last 16 bytes, overlapping what came before if need be. */
+	a = read64(p + i - 16);
+	b = read64(p + i - 8);
+      }
+
+    a ^= p1;
+    b ^= seed;
+    return mix(p1 ^ length, mix(a, b) ^ p0);
+  }
+  /** StringData::SizedFreeFunction for mapped files. */
+  static void
+  unmap_file(void* data, size_t length)
+  {
+    munmap(data, length);
+  }
+
+  String
+  String::map_file(const char* path)
+  {
+    int fd ( strcmp(path, "-") ? open(path, O_RDONLY | O_CLOEXEC) : STDIN_FILENO );
+    if ( fd < 0 )
+      throw std::system_error(errno, std::generic_category(), path);
+
+    struct stat fileStat;
+    if ( fstat(fd, &fileStat) < 0 )
+      {
+	int err ( errno );
+	if ( fd != STDIN_FILENO )
+	  close(fd);
+	throw std::system_error(err, std::generic_category(), path);
+      }
+
+    if ( ! S_ISREG(fileStat.st_mode) )
+      {
+	/* Pipes, terminals and the like can't be mapped. */
+	if ( fd != STDIN_FILENO )
+	  close(fd);
+	errno = 0;
+	std::pair<char*,size_t> contents ( readFileIntoString(path) );
+	if ( ! contents.first && errno != 0 )
+	  throw std::system_error(errno, std::generic_category(), path);
+	if ( contents.second == 0 )
+	  {
+	    free(contents.first);
+	    return String();
+	  }
+	return take_ownership(contents.first, contents.second);
+      }
+
+    size_t length ( static_cast<size_t>(fileStat.st_size) );
+    void* p ( length > 0 ? mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0) : NULL );
+    int err ( errno );
+    if ( fd != STDIN_FILENO )
+      close(fd);			/* the mapping keeps its own reference */
+
+    if ( length == 0 )
+      return String();
+    else if ( p == MAP_FAILED )
+      throw std::system_error(err, std::generic_category(), path);
+
+    data_type* sd;
+    try
+      {
+	sd = new data_type(static_cast<element_type*>(p), length, true);
+      }
+    catch ( ... )
+      {
+	munmap(p, length);
+	throw;
+      }
+    sd->sizedFreeFunction = &unmap_file;
+    return String(data_type::reference_type(sd));
+  }
+}
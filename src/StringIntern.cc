@@ -0,0 +1,126 @@
+#include <cstdlib>
+#include <cstring>
+#include <support/StringIntern.hh>
+
+namespace spt
+{
+  /** Initial number of slots in each shard. */
+  static const size_t INITIAL_SLOTS = 64;
+
+  /** log2(StringInternTable::num_shards). */
+  static const unsigned int SHARD_BITS = 5;
+  static_assert(StringInternTable::num_shards == 1U << SHARD_BITS, "SHARD_BITS does not match num_shards");
+
+  StringInternTable::Shard::Shard()
+    : slots ( INITIAL_SLOTS ),
+      count ( 0 )
+  {
+  }
+
+  StringInternTable::Shard::~Shard()
+  {
+  }
+
+  StringInternTable::StringInternTable(Storage storage)
+    : m_storage ( storage )
+  {
+  }
+
+  StringInternTable::~StringInternTable()
+  {
+    /* Another table may later be allocated at this address; surviving
+       Strings must not look canonical there. */
+    for ( Shard& shard : m_shards )
+      for ( Entry& e : shard.slots )
+	if ( e.data )
+	  e.data->internTable = NULL;
+  }
+
+  void
+  StringInternTable::grow(Shard& shard)
+  {
+    std::vector<Entry> old ( shard.slots.size() * 2 );
+    old.swap(shard.slots);
+
+    size_t mask ( shard.slots.size() - 1 );
+    for ( Entry& e : old )
+      if ( e.data )
+	{
+	  size_t i ( e.hash & mask );
+	  while ( shard.slots[i].data )
+	    i = ( i + 1 ) & mask;
+	  shard.slots[i].hash = e.hash;
+	  shard.slots[i].data.swap(e.data);
+	}
+  }
+
+  String
+  StringInternTable::intern(const String::element_type* s, String::size_type length)
+  {
+    if ( ! s || length == 0 )
+      return String();
+
+    size_t hash ( hash_chars(s, length) );
+    /* Low bits pick the slot; use the top bits for the shard. */
+    Shard& shard ( m_shards[( hash >> ( sizeof(size_t) * 8 - SHARD_BITS ) ) & ( num_shards - 1 )] );
+    std::lock_guard<std::mutex> guard ( shard.lock );
+
+    size_t mask ( shard.slots.size() - 1 );
+    size_t i ( hash & mask );
+    for ( ; shard.slots[i].data; i = ( i + 1 ) & mask )
+      {
+	const Entry& e ( shard.slots[i] );
+	if ( e.hash == hash && e.data->capacity == length
+	     && 0 == memcmp(e.data->data, s, length) )
+	  return String(e.data);
+      }
+
+    /* Not found: i is the first free slot in the probe sequence.
+       Canonical values outlive any request-scoped string arena. */
+    StringArenaScope heapScope ( NULL );
+    String::data_type* sd;
+    if ( m_storage == ARENA )
+      sd = new String::data_type(shard.arena.copy(s, length), length, false);
+    else
+      {
+	char* copy ( static_cast<char*>(malloc(length + 1)) );
+	if ( ! copy )
+	  throw std::bad_alloc();
+	memcpy(copy, s, length);
+	copy[length] = '\0';
+	sd = new String::data_type(copy, length, true);
+      }
+    sd->internTable = this;
+    sd->cachedHash = hash;
+
+    shard.slots[i].hash = hash;
+    shard.slots[i].data = sd;
+    String out ( shard.slots[i].data );
+
+    /* Keep the load factor at or below one half. */
+    if ( ++shard.count * 2 > shard.slots.size() )
+      grow(shard);
+
+    return out;
+  }
+
+  size_t
+  StringInternTable::size() const
+  {
+    size_t n ( 0 );
+    for ( const Shard& shard : m_shards )
+      {
+	std::lock_guard<std::mutex> guard ( shard.lock );
+	n += shard.count;
+      }
+    return n;
+  }
+
+  StringInternTable&
+  StringInternTable::global()
+  {
+    /* Deliberately leaked; see the declaration. */
+    static StringInternTable* table ( new StringInternTable(ARENA) );
+    return *table;
+  }
+}
@@ -0,0 +1,420 @@
+#include <cstdint>
+#include <cstring>
+#include <support/StringSearch.hh>
+
+#if defined(__x86_64__)
+#  define SPT_SEARCH_X86 1
+#  include <immintrin.h>
+#endif
+
+namespace spt
+{
+  namespace
+  {
+    /** Function table for one instruction-set level. */
+    struct SearchKernels
+    {
+      StringSearchISA isa;
+      const char* (*find_byte)(const char*, size_t, char);
+      const char* (*rfind_byte)(const char*, size_t, char);
+      size_t (*count_byte)(const char*, size_t, char);
+      const char* (*find_first_of)(const char*, size_t, const char*, size_t, bool);
+      const char* (*find_last_of)(const char*, size_t, const char*, size_t, bool);
+      const char* (*find_substring)(const char*, size_t, const char*, size_t);
+    };
+
+    /** Byte-set membership bitmap. */
+    struct ByteSet
+    {
+      uint64_t bits[4];
+
+      ByteSet(const char* set, size_t setLength)
+	: bits { 0, 0, 0, 0 }
+      {
+	for ( size_t i ( 0 ); i < setLength; ++i )
+	  {
+	    unsigned char c ( static_cast<unsigned char>(set[i]) );
+	    bits[c >> 6] |= UINT64_C(1) << ( c & 63 );
+	  }
+      }
+
+      inline bool
+      contains(char ch) const
+      {
+	unsigned char c ( static_cast<unsigned char>(ch) );
+	return bits[c >> 6] & ( UINT64_C(1) << ( c & 63 ) );
+      }
+    };
+
+    /* ****************************************************************
+     * Scalar kernels.  These also handle the tails left by the vector
+     * kernels.
+     */
+
+    const char*
+    scalar_find_byte(const char* s, size_t n, char c)
+    {
+      for ( const char* end ( s + n ); s < end; ++s )
+	if ( *s == c )
+	  return s;
+      return NULL;
+    }
+
+    const char*
+    scalar_rfind_byte(const char* s, size_t n, char c)
+    {
+      for ( const char* p ( s + n ); p > s; )
+	if ( *--p == c )
+	  return p;
+      return NULL;
+    }
+
+    size_t
+    scalar_count_byte(const char* s, size_t n, char c)
+    {
+      size_t count ( 0 );
+      for ( const char* end ( s + n ); s < end; ++s )
+	count += *s == c;
+      return count;
+    }
+
+    const char*
+    scalar_find_first_of(const char* s, size_t n, const char* set, size_t setLength, bool negate)
+    {
+      ByteSet bs ( set, setLength );
+      for ( const char* end ( s + n ); s < end; ++s )
+	if ( bs.contains(*s) != negate )
+	  return s;
+      return NULL;
+    }
+
+    const char*
+    scalar_find_last_of(const char* s, size_t n, const char* set, size_t setLength, bool negate)
+    {
+      ByteSet bs ( set, setLength );
+      for ( const char* p ( s + n ); p > s; )
+	if ( bs.contains(*--p) != negate )
+	  return p;
+      return NULL;
+    }
+
+    const char*
+    scalar_find_substring(const char* s, size_t n, const char* needle, size_t m)
+    {
+      if ( m == 0 )
+	return s;
+      if ( m > n )
+	return NULL;
+
+      const char* last ( s + n - m );
+      for ( const char* p ( s ); p <= last; ++p )
+	{
+	  p = scalar_find_byte(p, static_cast<size_t>(last - p) + 1, needle[0]);
+	  if ( ! p )
+	    break;
+	  if ( 0 == memcmp(p + 1, needle + 1, m - 1) )
+	    return p;
+	}
+      return NULL;
+    }
+
+    const SearchKernels scalar_kernels =
+      {
+	STRING_SEARCH_SCALAR,
+	&scalar_find_byte,
+	&scalar_rfind_byte,
+	&scalar_count_byte,
+	&scalar_find_first_of,
+	&scalar_find_last_of,
+	&scalar_find_substring
+      };
+
+#ifdef SPT_SEARCH_X86
+    /* ****************************************************************
+     * Vector kernels.  Each is written once, against a small wrapper
+     * around the vector type, and instantiated for SSE2 and AVX2.
+     */
+
+    /** Largest set searched with one vector compare per member;
+     *	larger sets use the scalar bitmap.
+     */
+    const size_t MAX_VECTOR_SET = 16;
+
+#define SPT_DEFINE_VECTOR_KERNELS(ISA, TARGET, VEC, WIDTH, LOAD, SET1, CMPEQ, AND, OR, MOVEMASK, ZERO, SUB, SAD, ADD64, EXTRACT_SUM) \
+									\
+    /** Movemask value with every lane set. */			\
+    const uint32_t ISA##_all_lanes = WIDTH == 32 ? 0xFFFFFFFFU : ( 1U << WIDTH ) - 1; \
+									\
+    __attribute__ (( target(TARGET) )) const char*			\
+    ISA##_find_byte(const char* s, size_t n, char c)			\
+    {									\
+      const VEC v ( SET1(c) );						\
+      size_t i ( 0 );							\
+      for ( ; i + 2 * WIDTH <= n; i += 2 * WIDTH )			\
+	{								\
+	  VEC a ( CMPEQ(LOAD(s + i), v) ), b ( CMPEQ(LOAD(s + i + WIDTH), v) ); \
+	  if ( MOVEMASK(OR(a, b)) )					\
+	    {								\
+	      uint64_t m ( static_cast<uint32_t>(MOVEMASK(a)) | ( static_cast<uint64_t>(static_cast<uint32_t>(MOVEMASK(b))) << WIDTH ) ); \
+	      return s + i + __builtin_ctzll(m);			\
+	    }								\
+	}								\
+      for ( ; i + WIDTH <= n; i += WIDTH )				\
+	{								\
+	  uint32_t m ( static_cast<uint32_t>(MOVEMASK(CMPEQ(LOAD(s + i), v))) ); \
+	  if ( m )							\
+	    return s + i + __builtin_ctz(m);				\
+	}								\
+      return scalar_find_byte(s + i, n - i, c);				\
+    }									\
+									\
+    __attribute__ (( target(TARGET) )) const char*			\
+    ISA##_rfind_byte(const char* s, size_t n, char c)			\
+    {									\
+      const VEC v ( SET1(c) );						\
+      size_t i ( n );							\
+      for ( ; i >= WIDTH; i -= WIDTH )					\
+	{								\
+	  uint32_t m ( static_cast<uint32_t>(MOVEMASK(CMPEQ(LOAD(s + i - WIDTH), v))) ); \
+	  if ( m )							\
+	    return s + i - WIDTH + ( 31 - __builtin_clz(m) );		\
+	}								\
+      return scalar_rfind_byte(s, i, c);				\
+    }									\
+									\
+    __attribute__ (( target(TARGET) )) size_t				\
+    ISA##_count_byte(const char* s, size_t n, char c)			\
+    {									\
+      const VEC v ( SET1(c) );						\
+      VEC total ( ZERO() );						\
+      size_t i ( 0 );							\
+      while ( i + WIDTH <= n )						\
+	{								\
+	  /* Matches are -1 per byte; subtracting counts them in up to	\
+	     255 iterations before the byte counters could wrap. */	\
+	  VEC counts ( ZERO() );					\
+	  for ( size_t k ( 0 ); k < 255 && i + WIDTH <= n; ++k, i += WIDTH ) \
+	    counts = SUB(counts, CMPEQ(LOAD(s + i), v));		\
+	  total = ADD64(total, SAD(counts, ZERO()));			\
+	}								\
+      return static_cast<size_t>(EXTRACT_SUM(total)) + scalar_count_byte(s + i, n - i, c); \
+    }									\
+									\
+    /** Mask of lanes in the block at @p p that are in the set. */	\
+    __attribute__ (( target(TARGET) )) static inline uint32_t		\
+    ISA##_set_mask(const char* p, const VEC* members, size_t setLength) \
+    {									\
+      VEC block ( LOAD(p) ), hits ( ZERO() );				\
+      for ( size_t k ( 0 ); k < setLength; ++k )			\
+	hits = OR(hits, CMPEQ(block, members[k]));			\
+      return static_cast<uint32_t>(MOVEMASK(hits));			\
+    }									\
+									\
+    __attribute__ (( target(TARGET) )) const char*			\
+    ISA##_find_first_of(const char* s, size_t n, const char* set, size_t setLength, bool negate) \
+    {									\
+      if ( setLength > MAX_VECTOR_SET )					\
+	return scalar_find_first_of(s, n, set, setLength, negate);	\
+      VEC members[MAX_VECTOR_SET];					\
+      for ( size_t k ( 0 ); k < setLength; ++k )			\
+	members[k] = SET1(set[k]);					\
+      size_t i ( 0 );							\
+      for ( ; i + WIDTH <= n; i += WIDTH )				\
+	{								\
+	  uint32_t m ( ISA##_set_mask(s + i, members, setLength) );	\
+	  if ( negate )							\
+	    m = ~m & ISA##_all_lanes;					\
+	  if ( m )							\
+	    return s + i + __builtin_ctz(m);				\
+	}								\
+      return scalar_find_first_of(s + i, n - i, set, setLength, negate); \
+    }									\
+									\
+    __attribute__ (( target(TARGET) )) const char*			\
+    ISA##_find_last_of(const char* s, size_t n, const char* set, size_t setLength, bool negate) \
+    {									\
+      if ( setLength > MAX_VECTOR_SET )					\
+	return scalar_find_last_of(s, n, set, setLength, negate);	\
+      VEC members[MAX_VECTOR_SET];					\
+      for ( size_t k ( 0 ); k < setLength; ++k )			\
+	members[k] = SET1(set[k]);					\
+      size_t i ( n );							\
+      for ( ; i >= WIDTH; i -= WIDTH )					\
+	{								\
+	  uint32_t m ( ISA##_set_mask(s + i - WIDTH, members, setLength) ); \
+	  if ( negate )							\
+	    m = ~m & ISA##_all_lanes;					\
+	  if ( m )							\
+	    return s + i - WIDTH + ( 31 - __builtin_clz(m) );		\
+	}								\
+      return scalar_find_last_of(s, i, set, setLength, negate);		\
+    }									\
+									\
+    /* Compare the first and last needle bytes at every position in	\
+       a block at once, and only memcmp where both match. */		\
+    __attribute__ (( target(TARGET) )) const char*			\
+    ISA##_find_substring(const char* s, size_t n, const char* needle, size_t m) \
+    {									\
+      if ( m < 2 )							\
+	return m == 0 ? s : ISA##_find_byte(s, n, needle[0]);		\
+      if ( m > n )							\
+	return NULL;							\
+									\
+      const VEC first ( SET1(needle[0]) ), last ( SET1(needle[m - 1]) ); \
+      size_t i ( 0 );							\
+      for ( ; i + m - 1 + WIDTH <= n; i += WIDTH )			\
+	{								\
+	  uint32_t mask ( static_cast<uint32_t>(MOVEMASK(AND(CMPEQ(LOAD(s + i), first), \
+							     CMPEQ(LOAD(s + i + m - 1), last)))) ); \
+	  while ( mask )						\
+	    {								\
+	      unsigned int bit ( static_cast<unsigned int>(__builtin_ctz(mask)) ); \
+	      if ( 0 == memcmp(s + i + bit + 1, needle + 1, m - 2) )	\
+		return s + i + bit;					\
+	      mask &= mask - 1;						\
+	    }								\
+	}								\
+      return scalar_find_substring(s + i, n - i, needle, m);		\
+    }									\
+									\
+    const SearchKernels ISA##_kernels =					\
+      {									\
+	STRING_SEARCH_##ISA,						\
+	&ISA##_find_byte,						\
+	&ISA##_rfind_byte,						\
+	&ISA##_count_byte,						\
+	&ISA##_find_first_of,						\
+	&ISA##_find_last_of,						\
+	&ISA##_find_substring						\
+      };
+
+    __attribute__ (( target("sse2") )) static inline __m128i
+    sse2_load(const char* p)
+    {
+      return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    }
+
+    __attribute__ (( target("sse2") )) static inline int64_t
+    sse2_sum(__m128i v)
+    {
+      return _mm_cvtsi128_si64(v) + _mm_cvtsi128_si64(_mm_unpackhi_epi64(v, v));
+    }
+
+    __attribute__ (( target("avx2") )) static inline __m256i
+    avx2_load(const char* p)
+    {
+      return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    }
+
+    __attribute__ (( target("avx2") )) static inline int64_t
+    avx2_sum(__m256i v)
+    {
+      return _mm256_extract_epi64(v, 0) + _mm256_extract_epi64(v, 1)
+	+ _mm256_extract_epi64(v, 2) + _mm256_extract_epi64(v, 3);
+    }
+
+    SPT_DEFINE_VECTOR_KERNELS(SSE2, "sse2", __m128i, 16, sse2_load, _mm_set1_epi8,
+			      _mm_cmpeq_epi8, _mm_and_si128, _mm_or_si128, _mm_movemask_epi8,
+			      _mm_setzero_si128, _mm_sub_epi8, _mm_sad_epu8, _mm_add_epi64, sse2_sum)
+
+    SPT_DEFINE_VECTOR_KERNELS(AVX2, "avx2", __m256i, 32, avx2_load, _mm256_set1_epi8,
+			      _mm256_cmpeq_epi8, _mm256_and_si256, _mm256_or_si256, _mm256_movemask_epi8,
+			      _mm256_setzero_si256, _mm256_sub_epi8, _mm256_sad_epu8, _mm256_add_epi64, avx2_sum)
+
+#undef SPT_DEFINE_VECTOR_KERNELS
+#endif	/* SPT_SEARCH_X86 */
+
+    /** Kernels for @p isa, or @c NULL if this machine lacks it. */
+    const SearchKernels*
+    kernels_for(StringSearchISA isa)
+    {
+      switch ( isa )
+	{
+	case STRING_SEARCH_SCALAR:
+	  return &scalar_kernels;
+#ifdef SPT_SEARCH_X86
+	case STRING_SEARCH_SSE2:
+	  return __builtin_cpu_supports("sse2") ? &SSE2_kernels : NULL;
+	case STRING_SEARCH_AVX2:
+	  return __builtin_cpu_supports("avx2") ? &AVX2_kernels : NULL;
+#else
+	default:
+	  break;
+#endif
+	}
+      return NULL;
+    }
+
+    const SearchKernels* active_kernels = NULL;
+
+    /** Get the selected kernels, choosing the best available on first
+     *	use.  Racing initializations all store the same value.
+     */
+    inline const SearchKernels&
+    kernels()
+    {
+      const SearchKernels* k ( __atomic_load_n(&active_kernels, __ATOMIC_ACQUIRE) );
+      if ( ! k )
+	{
+	  __builtin_cpu_init();
+	  if ( ! ( k = kernels_for(STRING_SEARCH_AVX2) )
+	       && ! ( k = kernels_for(STRING_SEARCH_SSE2) ) )
+	    k = &scalar_kernels;
+	  __atomic_store_n(&active_kernels, k, __ATOMIC_RELEASE);
+	}
+      return *k;
+    }
+  }
+
+  const char*
+  find_byte(const char* s, size_t n, char c)
+  {
+    return kernels().find_byte(s, n, c);
+  }
+
+  const char*
+  rfind_byte(const char* s, size_t n, char c)
+  {
+    return kernels().rfind_byte(s, n, c);
+  }
+
+  size_t
+  count_byte(const char* s, size_t n, char c)
+  {
+    return kernels().count_byte(s, n, c);
+  }
+
+  const char*
+  find_first_of(const char* s, size_t n, const char* set, size_t setLength, bool negate)
+  {
+    return kernels().find_first_of(s, n, set, setLength, negate);
+  }
+
+  const char*
+  find_last_of(const char* s, size_t n, const char* set, size_t setLength, bool negate)
+  {
+    return kernels().find_last_of(s, n, set, setLength, negate);
+  }
+
+  const char*
+  find_substring(const char* s, size_t n, const char* needle, size_t m)
+  {
+    return kernels().find_substring(s, n, needle, m);
+  }
+
+  StringSearchISA
+  string_search_isa()
+  {
+    return kernels().isa;
+  }
+
+  bool
+  string_search_set_isa(StringSearchISA isa)
+  {
+    __builtin_cpu_init();
+    const SearchKernels* k ( kernels_for(isa) );
+    if ( k )
+      __atomic_store_n(&active_kernels, k, __ATOMIC_RELEASE);
+    return k != NULL;
+  }
+}
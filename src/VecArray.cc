@@ -0,0 +1,52 @@
+/* Built with -fno-math-errno; see VecArray.hh.  */
+#include <cmath>
+#include <support/VecArray.hh>
+
+namespace spt
+{
+  namespace vec_array_detail
+  {
+    template < typename _T >
+    static inline void
+    sqrt_loop(_T* x, size_t n)
+    {
+      for ( size_t i ( 0 ); i < n; ++i )
+	x[i] = std::sqrt(x[i]);
+    }
+
+    template < typename _T >
+    static inline void
+    inverse_sqrt_loop(_T* x, size_t n, _T slop)
+    {
+      for ( size_t i ( 0 ); i < n; ++i )
+	{
+	  _T mag ( std::sqrt(x[i]) );
+	  x[i] = mag < slop ? static_cast<_T>(1) : static_cast<_T>(1) / mag;
+	}
+    }
+
+    void
+    sqrt_n(float* x, size_t n)
+    {
+      sqrt_loop(x, n);
+    }
+
+    void
+    sqrt_n(double* x, size_t n)
+    {
+      sqrt_loop(x, n);
+    }
+
+    void
+    inverse_sqrt_n(float* x, size_t n, float slop)
+    {
+      inverse_sqrt_loop(x, n, slop);
+    }
+
+    void
+    inverse_sqrt_n(double* x, size_t n, double slop)
+    {
+      inverse_sqrt_loop(x, n, slop);
+    }
+  }
+}
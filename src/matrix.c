@@ -9,8 +9,40 @@
 
 #include <support/matrix.h>
 
+#if defined SPT_MATRIX_THREADS && defined MATRIX_CONTIGUOUS
+#  define MATRIX_PARALLEL
+#  include <pthread.h>
+#  include <unistd.h>		/* for sysconf() */
+#endif
+
 #define return_if_fail(expr,retval) if(!(expr)) return retval;
 
+#ifdef MATRIX_CONTIGUOUS
+/** Row stride for a matrix with @p cols columns: rows of at least
+ * MATRIX_ALIGNMENT bytes are padded to a multiple of it.
+ */
+static unsigned int
+matrix_stride(const unsigned int cols)
+{
+  const unsigned int per_line = MATRIX_ALIGNMENT / sizeof(scalar_t);
+
+  if ( cols < per_line )
+    return cols;
+  return ( cols + per_line - 1 ) / per_line * per_line;
+}
+
+/** Allocate @p n scalars aligned to MATRIX_ALIGNMENT.
+ */
+static scalar_t*
+matrix_alloc_values(const size_t n)
+{
+  void *p = NULL;
+  if ( posix_memalign(&p, MATRIX_ALIGNMENT, ( n ? n : 1 ) * sizeof(scalar_t)) != 0 )
+    return NULL;
+  return (scalar_t *) p;
+}
+#endif
+
 void
 _print_matrix(Matrix *m, char *label)
 {
@@ -51,7 +83,9 @@ matrix_alloc()
 Matrix*
 matrix_new(const unsigned int rows, const unsigned int cols)
 {
+#ifndef MATRIX_CONTIGUOUS
   unsigned int i;
+#endif
 
   Matrix *out = matrix_alloc();
   assert(out != NULL);
@@ -60,7 +94,12 @@ matrix_new(const unsigned int rows, const unsigned int cols)
   out->rows = rows;
   out->cols = cols;
 
-#ifdef MATRIX_BY_ROW
+#ifdef MATRIX_CONTIGUOUS
+  out->stride = matrix_stride(cols);
+  out->values = matrix_alloc_values((size_t) rows * out->stride);
+  assert(out->values != NULL);
+  memset(out->values, 0, sizeof(scalar_t) * rows * out->stride);
+#elif defined MATRIX_BY_ROW
   out->data = (scalar_t **) malloc(sizeof(scalar_t *) * rows);
 
   for (i=0; i < rows; i++)
@@ -92,7 +131,10 @@ matrix_clear(Matrix *m)
 {
   unsigned int i;
 
-#ifdef MATRIX_BY_ROW
+#ifdef MATRIX_CONTIGUOUS
+  for(i=0; i < m->rows; i++)
+    memset(matrix_row(m, i), 0, (sizeof(scalar_t) * m->cols));
+#elif defined MATRIX_BY_ROW
   for(i=0; i < m->rows; i++)
     {
       memset(m->data[i], 0, (sizeof(scalar_t) * m->cols));
@@ -116,7 +158,7 @@ matrix_clear(Matrix *m)
  * @return a pointer to a duplicate of m
  */
 Matrix*
-matrix_dupe(Matrix *m)
+matrix_copy(Matrix *m)
 {
   unsigned int i, j;
   Matrix *out;
@@ -133,7 +175,7 @@ matrix_dupe(Matrix *m)
 
 
 /** Free a matrix and the data it holds.
- *  Freeing a minor matrix will not free its data.
+ *  Freeing a minor matrix or a view will not free its data.
  *
  * @param m the matrix to be freed
  */
@@ -154,6 +196,12 @@ matrix_free(Matrix *m)
  */
 Matrix* matrix_free_data(Matrix* m)
 {
+#ifdef MATRIX_CONTIGUOUS
+  if(!(m->flags & IS_CHILD))
+    free(m->values);
+
+  m->values = NULL;
+#else
   unsigned int i
 #ifdef MATRIX_BY_VALUE
     ,j
@@ -181,6 +229,7 @@ Matrix* matrix_free_data(Matrix* m)
   free(m->data);
 
   m->data = NULL;
+#endif
 
   return m;
 }
@@ -271,7 +320,7 @@ Matrix *matrix_minor(Matrix *m, const unsigned int row, const unsigned int col)
   unsigned int io, im, jo, jm;
   assert(row < m->rows && col < m->cols);
 
-#ifdef MATRIX_BY_ROW		/* We'll need to just copy everything */
+#ifndef MATRIX_BY_VALUE		/* We'll need to just copy everything */
   out = matrix_new(m->rows - 1, m->cols - 1);
 #else  /* MATRIX_BY_VALUE */
   out = (Matrix *) malloc(sizeof(Matrix));
@@ -282,16 +331,16 @@ Matrix *matrix_minor(Matrix *m, const unsigned int row, const unsigned int col)
 #endif
 
   for(io=im=0; (io < out->rows) && (im < m->rows); io++, im++) {
-    /* Skip column 'col' */
-    if(im == col)
+    /* Skip row 'row' */
+    if(im == row)
       im++;
 
     for(jo=jm=0; (jo < out->cols) && (jm < m->cols); jo++, jm++) {
-      /* Skip row 'row' */
-      if(jm == row)
+      /* Skip column 'col' */
+      if(jm == col)
 	jm++;
 
-#ifdef MATRIX_BY_ROW
+#ifndef MATRIX_BY_VALUE
       matrix_set(out, io, jo, matrix_get(m, im, jm));
 #else  /* MATRIX_BY_VALUE */
       matrix_set_ptr(out, io, jo, matrix_get_ptr(m, im, jm));
@@ -303,6 +352,191 @@ Matrix *matrix_minor(Matrix *m, const unsigned int row, const unsigned int col)
 }
 
 
+#ifdef MATRIX_CONTIGUOUS
+/** Creates a view of a block of a matrix.  The view shares the
+ * matrix's data: changes to either show in the other.  Free it with
+ * matrix_free, which leaves the data alone; the view must not outlive
+ * the matrix.
+ *
+ * @param m a pointer to a matrix
+ * @param row the first row of the block
+ * @param col the first column of the block
+ * @param rows rows in the block
+ * @param cols columns in the block
+ *
+ * @return the view
+ */
+Matrix*
+matrix_view(Matrix *m, const unsigned int row, const unsigned int col,
+	    const unsigned int rows, const unsigned int cols)
+{
+  Matrix *out;
+  assert(row + rows <= m->rows && col + cols <= m->cols);
+
+  out = matrix_alloc();
+  assert(out != NULL);
+
+  out->flags = IS_CHILD;
+  out->rows = rows;
+  out->cols = cols;
+  out->stride = m->stride;
+  out->values = matrix_row(m, row) + col;
+
+  return out;
+}
+#endif
+
+
+#ifndef MATRIX_BY_VALUE
+/* LU decomposition
+ *
+ * Determinants, inverses and solutions of linear systems all go through
+ * the factorization P A = L U, computed with partial pivoting in O(n^3)
+ * operations.  The work is done a whole row at a time, which the
+ * compiler can vectorize.
+ */
+
+/** y += a x, for rows of @p n elements. */
+static void
+row_axpy(scalar_t *restrict y, const scalar_t *restrict x, const scalar_t a,
+	 const unsigned int n)
+{
+  unsigned int j;
+  for ( j = 0; j < n; j++ )
+    y[j] += a * x[j];
+}
+
+static void
+swap_rows(Matrix *m, const unsigned int r1, const unsigned int r2)
+{
+  unsigned int j;
+  scalar_t t, *a = matrix_row(m, r1), *b = matrix_row(m, r2);
+
+  for ( j = 0; j < m->cols; j++ )
+    {
+      t = a[j];
+      a[j] = b[j];
+      b[j] = t;
+    }
+}
+
+/** Factor a square matrix, in place, into lower and upper triangular
+ * matrices: P M = L U.  On return M holds U on and above the diagonal,
+ * and L (whose diagonal elements are all 1) below it.
+ *
+ * @param m a pointer to a square matrix
+ * @param pivots NULL, or an array of m->rows elements to receive the row
+ *        interchanges: row i was swapped with row pivots[i] at step i
+ *
+ * @return the sign of the permutation P (1 or -1), or 0 if m is singular,
+ *         in which case m and pivots are only partly factored
+ */
+int
+matrix_lu_decompose(Matrix *m, unsigned int *pivots)
+{
+  const unsigned int n = m->rows;
+  unsigned int i, k, p;
+  scalar_t max, l, *rk, *ri;
+  int sign = 1;
+
+  assert(MATRIX_IS_SQUARE(m));
+
+  for ( k = 0; k < n; k++ )
+    {
+      p = k;
+      max = S_ABS(matrix_get(m, k, k));
+      for ( i = k + 1; i < n; i++ )
+	if ( S_ABS(matrix_get(m, i, k)) > max )
+	  {
+	    p = i;
+	    max = S_ABS(matrix_get(m, i, k));
+	  }
+
+      if ( pivots )
+	pivots[k] = p;
+      if ( ! ( max > 0 ) )	/* zero or NaN */
+	return 0;
+
+      if ( p != k )
+	{
+	  swap_rows(m, k, p);
+	  sign = -sign;
+	}
+
+      rk = matrix_row(m, k);
+      for ( i = k + 1; i < n; i++ )
+	{
+	  ri = matrix_row(m, i);
+	  l = ri[k] /= rk[k];
+	  row_axpy(ri + k + 1, rk + k + 1, -l, n - k - 1);
+	}
+    }
+
+  return sign;
+}
+
+/** Solve L U X = P B, in place, for the factors computed by
+ * matrix_lu_decompose.
+ *
+ * @param lu a factored matrix
+ * @param pivots the row interchanges recorded while factoring lu
+ * @param b a matrix with lu->rows rows, which is replaced with X
+ */
+void
+matrix_lu_solve(Matrix *lu, const unsigned int *pivots, Matrix *b)
+{
+  const unsigned int n = lu->rows;
+  unsigned int i, k;
+  scalar_t *bi, u;
+
+  assert(MATRIX_IS_SQUARE(lu) && b->rows == n);
+
+  for ( k = 0; k < n; k++ )
+    if ( pivots[k] != k )
+      swap_rows(b, k, pivots[k]);
+
+  /* L Y = P B */
+  for ( i = 1; i < n; i++ )
+    {
+      bi = matrix_row(b, i);
+      for ( k = 0; k < i; k++ )
+	row_axpy(bi, matrix_row(b, k), -matrix_get(lu, i, k), b->cols);
+    }
+
+  /* U X = Y */
+  for ( i = n; i-- > 0; )
+    {
+      bi = matrix_row(b, i);
+      for ( k = i + 1; k < n; k++ )
+	row_axpy(bi, matrix_row(b, k), -matrix_get(lu, i, k), b->cols);
+
+      u = matrix_get(lu, i, i);
+      for ( k = 0; k < b->cols; k++ )
+	bi[k] /= u;
+    }
+}
+
+/** Computes the determinant of a matrix, destroying it in the process.
+ *
+ * @param m a pointer to a square matrix, which is left holding its LU
+ *        factors
+ *
+ * @return the determinant of m
+ */
+scalar_t
+matrix_det_in_place(Matrix *m)
+{
+  unsigned int i;
+  scalar_t det = (scalar_t) matrix_lu_decompose(m, NULL);
+
+  for ( i = 0; i < m->rows && S_NONZERO(det); i++ )
+    det *= matrix_get(m, i, i);
+
+  return det;
+}
+#endif	/* ! MATRIX_BY_VALUE */
+
+
 /** Computes the determinant of a matrix
  *
  * @param m a Matrix pointer
@@ -310,36 +544,646 @@ Matrix *matrix_minor(Matrix *m, const unsigned int row, const unsigned int col)
  * @return the determinant of m
  */
 scalar_t matrix_det(Matrix *m) {
+#ifdef MATRIX_BY_VALUE
   Matrix *minor;
   unsigned int j;
   scalar_t rdet, sign;
+#else
+  Matrix *lu;
+  scalar_t det;
+#endif
 
   assert(MATRIX_IS_SQUARE(m));
 
+  if(m->cols == 1)
+    return matrix_get(m,0,0);
 
   if(m->cols == 2) {
     return ((matrix_get(m,0,0) * matrix_get(m,1,1))
 	    - (matrix_get(m,0,1) * matrix_get(m,1,0)));
   }
+  else if(m->cols == 3) {
+    return (matrix_get(m,0,0) * (matrix_get(m,1,1) * matrix_get(m,2,2) - matrix_get(m,1,2) * matrix_get(m,2,1))
+	    - matrix_get(m,0,1) * (matrix_get(m,1,0) * matrix_get(m,2,2) - matrix_get(m,1,2) * matrix_get(m,2,0))
+	    + matrix_get(m,0,2) * (matrix_get(m,1,0) * matrix_get(m,2,1) - matrix_get(m,1,1) * matrix_get(m,2,0)));
+  }
   else {
+#ifdef MATRIX_BY_VALUE
     rdet = 0;
     for(j=0; j < m->cols; j++) {
       minor = matrix_minor(m, 0, j);
 
-      sign = (j%2) ? S_LITERAL(1.0) : S_LITERAL(-1.0);
+      sign = (j%2) ? S_LITERAL(-1.0) : S_LITERAL(1.0);
       rdet += sign * matrix_get(m, 0, j) * matrix_det(minor);
 
       matrix_free(minor);
     }
 
     return rdet;
+#else
+    lu = matrix_copy(m);
+    det = matrix_det_in_place(lu);
+    matrix_free(lu);
+
+    return det;
+#endif
   }
 
   return 0;
 }
 
 
-/** Multiplies two matrices. Stores the result in dest.
+#ifndef MATRIX_BY_VALUE
+/** Inverts a matrix.  Stores the result in dest.
+ *
+ * @param m a pointer to a square matrix
+ * @param dest pointer to a matrix in which to store the result (which may be m itself),
+ *        or NULL to allocate a new one
+ *
+ * @return dest, or a pointer to a new Matrix if dest is NULL; NULL if m is singular
+ */
+Matrix*
+matrix_inverse(Matrix *m, Matrix *dest)
+{
+  Matrix *lu, *out;
+  unsigned int *pivots;
+
+  assert(MATRIX_IS_SQUARE(m));
+  if(dest)
+    assert(MATRIX_CONGRUENT(m, dest));
+
+  lu = matrix_copy(m);
+  pivots = (unsigned int *) malloc(sizeof(unsigned int) * ( m->rows ? m->rows : 1 ));
+  assert(pivots != NULL);
+
+  out = NULL;
+  if ( matrix_lu_decompose(lu, pivots) )
+    {
+      out = dest ? dest : matrix_new(m->rows, m->cols);
+      matrix_set_identity(out);
+      matrix_lu_solve(lu, pivots, out);
+    }
+
+  free(pivots);
+  matrix_free(lu);
+
+  return out;
+}
+
+/** Solves the linear system a x = b, destroying a.  Each column of b is
+ * one right-hand side.
+ *
+ * @param a a pointer to a square matrix, which is left holding its LU factors
+ * @param b a pointer to a matrix with as many rows as a, which is replaced
+ *        with the solution
+ *
+ * @return b, or NULL if a is singular (leaving b unchanged)
+ */
+Matrix*
+matrix_solve_in_place(Matrix *a, Matrix *b)
+{
+  unsigned int *pivots;
+  Matrix *out = NULL;
+
+  assert(MATRIX_IS_SQUARE(a) && a->rows == b->rows);
+
+  pivots = (unsigned int *) malloc(sizeof(unsigned int) * ( a->rows ? a->rows : 1 ));
+  assert(pivots != NULL);
+
+  if ( matrix_lu_decompose(a, pivots) )
+    {
+      matrix_lu_solve(a, pivots, b);
+      out = b;
+    }
+
+  free(pivots);
+  return out;
+}
+
+/** Solves the linear system a x = b.  Each column of b is one
+ * right-hand side.
+ *
+ * @param a a pointer to a square matrix
+ * @param b a pointer to a matrix with as many rows as a
+ * @param dest pointer to a matrix in which to store x (which may be b itself),
+ *        or NULL to allocate a new one
+ *
+ * @return dest, or a pointer to a new Matrix if dest is NULL; NULL if a is singular
+ */
+Matrix*
+matrix_solve(Matrix *a, Matrix *b, Matrix *dest)
+{
+  unsigned int i;
+  Matrix *lu, *x;
+
+  if(dest)
+    assert(MATRIX_CONGRUENT(b, dest));
+
+  lu = matrix_copy(a);
+  x = dest ? dest : matrix_new(b->rows, b->cols);
+  if ( x != b )
+    for ( i = 0; i < b->rows; i++ )
+      memcpy(matrix_row(x, i), matrix_row(b, i), sizeof(scalar_t) * b->cols);
+
+  if ( ! matrix_solve_in_place(lu, x) )
+    {
+      if ( ! dest )
+	matrix_free(x);
+      x = NULL;
+    }
+
+  matrix_free(lu);
+  return x;
+}
+#endif	/* ! MATRIX_BY_VALUE */
+
+
+/* Parallel execution
+ *
+ * Large operations are split into `parts' (bands of rows or columns),
+ * which a pool of worker threads and the calling thread take one at a
+ * time until none are left.  The workers sleep on a condition variable
+ * between operations.
+ */
+
+/** Run part @p part of the @p parts parts of an operation. */
+typedef void (*matrix_task_fn)(void *arg, const unsigned int part, const unsigned int parts);
+
+/* The settings may be changed while other threads run operations, so
+   they are only accessed atomically.  An operation that is already
+   running keeps the settings it started with. */
+static unsigned int matrix_threads = 0;
+static size_t matrix_parallel_threshold = MATRIX_PARALLEL_THRESHOLD;
+
+#ifdef MATRIX_PARALLEL
+static struct
+{
+  pthread_mutex_t run_lock;	/* held while an operation uses the pool */
+  pthread_mutex_t lock;		/* protects everything below */
+  pthread_cond_t wake;		/* work is available, or stop is set */
+  pthread_cond_t done;		/* pending has reached zero */
+
+  pthread_t *workers;
+  unsigned int n_workers;
+  unsigned int size;		/* workers asked for by the last resize */
+  int stop;
+
+  matrix_task_fn fn;
+  void *arg;
+  unsigned int parts;		/* parts in the current operation */
+  unsigned int next_part;	/* next part for a thread to take */
+  unsigned int pending;		/* parts not yet finished */
+} pool = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+	   PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER,
+	   NULL, 0, 0, 0, NULL, NULL, 0, 0, 0 };
+
+/** Run parts of the current operation until none are left to take.
+ * Called, and returns, with pool.lock held.
+ */
+static void
+pool_run_parts(void)
+{
+  const matrix_task_fn fn = pool.fn;
+  void *arg = pool.arg;
+  const unsigned int parts = pool.parts;
+  unsigned int part;
+
+  while ( pool.next_part < parts )
+    {
+      part = pool.next_part++;
+      pthread_mutex_unlock(&pool.lock);
+      fn(arg, part, parts);
+      pthread_mutex_lock(&pool.lock);
+
+      if ( --pool.pending == 0 )
+	pthread_cond_signal(&pool.done);
+    }
+}
+
+static void*
+pool_worker(void *unused)
+{
+  (void) unused;
+
+  pthread_mutex_lock(&pool.lock);
+  for ( ;; )
+    {
+      while ( ! pool.stop && pool.next_part >= pool.parts )
+	pthread_cond_wait(&pool.wake, &pool.lock);
+      if ( pool.stop )
+	break;
+      pool_run_parts();
+    }
+  pthread_mutex_unlock(&pool.lock);
+
+  return NULL;
+}
+
+/** Start or stop workers so that there are @p n of them.  Called with
+ * pool.run_lock held.  If threads can't be created the pool makes do
+ * with fewer, and doesn't try again until a different size is wanted.
+ */
+static void
+pool_resize(const unsigned int n)
+{
+  unsigned int i;
+
+  pool.size = n;
+
+  if ( pool.n_workers > 0 )
+    {
+      pthread_mutex_lock(&pool.lock);
+      pool.stop = 1;
+      pthread_cond_broadcast(&pool.wake);
+      pthread_mutex_unlock(&pool.lock);
+
+      for ( i = 0; i < pool.n_workers; i++ )
+	pthread_join(pool.workers[i], NULL);
+
+      pool.stop = 0;
+      pool.n_workers = 0;
+    }
+  free(pool.workers);
+  pool.workers = NULL;
+
+  if ( n == 0 || ! ( pool.workers = (pthread_t *) malloc(sizeof(pthread_t) * n) ) )
+    return;
+  while ( pool.n_workers < n
+	  && pthread_create(&pool.workers[pool.n_workers], NULL, pool_worker, NULL) == 0 )
+    pool.n_workers++;
+}
+#endif	/* MATRIX_PARALLEL */
+
+/** Set the number of threads to split large operations between.
+ *
+ * @param n number of threads, including the calling one; 0 for one per
+ *        online processor
+ */
+void
+matrix_set_threads(const unsigned int n)
+{
+  __atomic_store_n(&matrix_threads, n, __ATOMIC_RELAXED);
+#ifdef MATRIX_PARALLEL
+  /* Stop the workers now if they're no longer wanted; otherwise the pool
+     is resized by the next operation. */
+  if ( n == 1 )
+    {
+      pthread_mutex_lock(&pool.run_lock);
+      pool_resize(0);
+      pthread_mutex_unlock(&pool.run_lock);
+    }
+#endif
+}
+
+/** Get the number of threads large operations are split between.
+ *
+ * @return the number of threads, including the calling one
+ */
+unsigned int
+matrix_get_threads(void)
+{
+#ifdef MATRIX_PARALLEL
+  const unsigned int threads = __atomic_load_n(&matrix_threads, __ATOMIC_RELAXED);
+  long n;
+
+  if ( threads > 0 )
+    return threads;
+
+  n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 1 ? (unsigned int) n : 1;
+#else
+  return 1;
+#endif
+}
+
+/** Set the amount of work above which operations run in parallel.
+ *
+ * @param work number of scalar operations (see matrix.h)
+ */
+void
+matrix_set_parallel_threshold(const size_t work)
+{
+  __atomic_store_n(&matrix_parallel_threshold, work, __ATOMIC_RELAXED);
+}
+
+size_t
+matrix_get_parallel_threshold(void)
+{
+  return __atomic_load_n(&matrix_parallel_threshold, __ATOMIC_RELAXED);
+}
+
+/** Number of parts to split an operation into.
+ *
+ * @param work scalar operations in the whole operation
+ * @param units number of indivisible pieces (e.g. bands of rows) the
+ *        operation can be split into
+ *
+ * @return 1 if the operation should run serially
+ */
+static unsigned int
+matrix_parallel_parts(const double work, const unsigned int units)
+{
+  unsigned int threads;
+
+  if ( work < (double) matrix_get_parallel_threshold() )
+    return 1;
+
+  threads = matrix_get_threads();
+  return units < threads ? ( units ? units : 1 ) : threads;
+}
+
+/** Run an operation split into @p parts parts, in parallel if @p parts is
+ * more than one and the pool is free.  The pool keeps one worker per
+ * thread from matrix_get_threads, besides the calling one, whatever the
+ * number of parts; workers with no part to take go back to sleep.
+ */
+static void
+matrix_run(const matrix_task_fn fn, void *arg, const unsigned int parts)
+{
+#ifdef MATRIX_PARALLEL
+  if ( parts > 1 && pthread_mutex_trylock(&pool.run_lock) == 0 )
+    {
+      const unsigned int threads = matrix_get_threads();
+
+      if ( pool.size != threads - 1 )
+	pool_resize(threads - 1);
+
+      if ( pool.n_workers > 0 )
+	{
+	  pthread_mutex_lock(&pool.lock);
+	  pool.fn = fn;
+	  pool.arg = arg;
+	  pool.parts = pool.pending = parts;
+	  pool.next_part = 0;
+	  pthread_cond_broadcast(&pool.wake);
+
+	  pool_run_parts();
+	  while ( pool.pending > 0 )
+	    pthread_cond_wait(&pool.done, &pool.lock);
+
+	  pool.parts = pool.next_part = 0;
+	  pthread_mutex_unlock(&pool.lock);
+	  pthread_mutex_unlock(&pool.run_lock);
+	  return;
+	}
+      pthread_mutex_unlock(&pool.run_lock);
+    }
+#endif
+
+  /* Serially, in one part. */
+  (void) parts;
+  fn(arg, 0, 1);
+}
+
+/** Get the range of elements [*begin, *end) that part @p part of @p
+ * parts covers, in an operation over @p n elements split on multiples
+ * of @p granule.
+ */
+static void
+matrix_part_range(const unsigned int n, const unsigned int granule,
+		  const unsigned int part, const unsigned int parts,
+		  unsigned int *begin, unsigned int *end)
+{
+  const unsigned int units = ( n + granule - 1 ) / granule;
+  const unsigned int per_part = ( units + parts - 1 ) / parts * granule;
+
+  *begin = part * per_part < n ? part * per_part : n;
+  *end = n - *begin > per_part ? *begin + per_part : n;
+}
+
+
+#ifdef MATRIX_CONTIGUOUS
+/* Matrix multiplication
+ *
+ * Large products are computed the way optimized BLAS libraries do it
+ * (Goto and van de Geijn, "Anatomy of high-performance matrix
+ * multiplication").  A GEMM_KC-deep panel of B is copied ("packed")
+ * into GEMM_NR-column slivers, and a GEMM_MC-row block of A into
+ * GEMM_MR-row slivers, each laid out in the order the kernel reads it.
+ * The kernel then multiplies one sliver of A by one of B, keeping the
+ * GEMM_MR x GEMM_NR tile of C in vector registers for the whole depth
+ * of the panel.  The block sizes keep a sliver of B in L1, the block of
+ * A in L2, and the panel of B in L3.
+ */
+
+#if defined __GNUC__ && ( defined S_TYPE_FLOAT || defined S_TYPE_DOUBLE )
+#  ifdef __AVX__
+#    define GEMM_VEC_BYTES 32
+#    define GEMM_MR 6
+#  else
+#    define GEMM_VEC_BYTES 16
+#    define GEMM_MR 4
+#  endif
+typedef scalar_t gemm_vec_t __attribute__(( vector_size(GEMM_VEC_BYTES) ));
+#  define GEMM_VL ( GEMM_VEC_BYTES / sizeof(scalar_t) )
+#else
+typedef scalar_t gemm_vec_t;
+#  define GEMM_VL 1
+#  define GEMM_MR 4
+#endif
+
+#define GEMM_NR ( 2 * GEMM_VL )
+#define GEMM_KC 256
+#define GEMM_MC ( 24 * GEMM_MR )
+#define GEMM_NC 2048
+
+/* Products with fewer multiply-adds than this skip the packing. */
+#define GEMM_SMALL ( 32 * 32 * 32 )
+
+#define GEMM_MIN(a, b) ( (a) < (b) ? (a) : (b) )
+
+/** Pack rows @p i0 to @p i0 + @p mc - 1, columns @p p0 to @p p0 + @p kc
+ * - 1 of @p a into GEMM_MR-row slivers, zero-padding the last one.
+ */
+static void
+gemm_pack_a(const Matrix *a, const unsigned int i0, const unsigned int p0,
+	    const unsigned int mc, const unsigned int kc, scalar_t *restrict out)
+{
+  unsigned int ir, i, p;
+
+  for ( ir = 0; ir < mc; ir += GEMM_MR )
+    for ( p = 0; p < kc; p++ )
+      for ( i = 0; i < GEMM_MR; i++ )
+	*out++ = ( ir + i < mc ) ? matrix_get(a, i0 + ir + i, p0 + p) : 0;
+}
+
+/** Pack rows @p p0 to @p p0 + @p kc - 1, columns @p j0 to @p j0 + @p nc
+ * - 1 of @p b into GEMM_NR-column slivers, zero-padding the last one.
+ */
+static void
+gemm_pack_b(const Matrix *b, const unsigned int p0, const unsigned int j0,
+	    const unsigned int kc, const unsigned int nc, scalar_t *restrict out)
+{
+  unsigned int jr, j, p, nr;
+  const scalar_t *row;
+
+  for ( jr = 0; jr < nc; jr += GEMM_NR )
+    {
+      nr = GEMM_MIN(GEMM_NR, nc - jr);
+      for ( p = 0; p < kc; p++, out += GEMM_NR )
+	{
+	  row = matrix_row(b, p0 + p) + j0 + jr;
+	  for ( j = 0; j < nr; j++ )
+	    out[j] = row[j];
+	  for ( ; j < GEMM_NR; j++ )
+	    out[j] = 0;
+	}
+    }
+}
+
+/** Multiply packed slivers @p a and @p b, of depth @p kc, into the
+ * @p mr x @p nr tile at @p c, adding to it if @p accumulate is set.
+ */
+static void
+gemm_kernel(const unsigned int kc, const scalar_t *restrict a, const scalar_t *restrict b,
+	    scalar_t *restrict c, const size_t ldc,
+	    const unsigned int mr, const unsigned int nr, const int accumulate)
+{
+  gemm_vec_t acc[GEMM_MR][2], c0, c1, b0, b1;
+  const scalar_t *tile;
+  unsigned int i, j, p;
+
+  memset(acc, 0, sizeof(acc));
+
+  for ( p = 0; p < kc; p++, a += GEMM_MR, b += GEMM_NR )
+    {
+      b0 = *(const gemm_vec_t *) b;
+      b1 = *(const gemm_vec_t *) ( b + GEMM_VL );
+      for ( i = 0; i < GEMM_MR; i++ )
+	{
+	  acc[i][0] += a[i] * b0;
+	  acc[i][1] += a[i] * b1;
+	}
+    }
+
+  if ( mr == GEMM_MR && nr == GEMM_NR )
+    {
+      for ( i = 0; i < GEMM_MR; i++, c += ldc )
+	{
+	  if ( accumulate )
+	    {
+	      memcpy(&c0, c, sizeof(c0));
+	      memcpy(&c1, c + GEMM_VL, sizeof(c1));
+	      acc[i][0] += c0;
+	      acc[i][1] += c1;
+	    }
+	  memcpy(c, &acc[i][0], sizeof(acc[i][0]));
+	  memcpy(c + GEMM_VL, &acc[i][1], sizeof(acc[i][1]));
+	}
+    }
+  else
+    {
+      /* Partial tile at the bottom or right edge of C. */
+      tile = (const scalar_t *) acc;
+      for ( i = 0; i < mr; i++, c += ldc, tile += GEMM_NR )
+	for ( j = 0; j < nr; j++ )
+	  c[j] = ( accumulate ? c[j] : 0 ) + tile[j];
+    }
+}
+
+/** Compute @p c = @p a @p b with packed, blocked loops.
+ */
+static void
+gemm_blocked(const Matrix *a, const Matrix *b, Matrix *c)
+{
+  const unsigned int m = a->rows, n = b->cols, k = a->cols;
+  unsigned int jc, pc, ic, jr, ir, nc, kc, mc;
+  scalar_t *ap, *bp;
+
+  ap = matrix_alloc_values((size_t) GEMM_MC * GEMM_KC);
+  bp = matrix_alloc_values((size_t) GEMM_KC * GEMM_NC);
+  assert(ap != NULL && bp != NULL);
+
+  for ( jc = 0; jc < n; jc += GEMM_NC )
+    {
+      nc = GEMM_MIN(GEMM_NC, n - jc);
+      for ( pc = 0; pc < k; pc += GEMM_KC )
+	{
+	  kc = GEMM_MIN(GEMM_KC, k - pc);
+	  gemm_pack_b(b, pc, jc, kc, nc, bp);
+
+	  for ( ic = 0; ic < m; ic += GEMM_MC )
+	    {
+	      mc = GEMM_MIN(GEMM_MC, m - ic);
+	      gemm_pack_a(a, ic, pc, mc, kc, ap);
+
+	      for ( jr = 0; jr < nc; jr += GEMM_NR )
+		for ( ir = 0; ir < mc; ir += GEMM_MR )
+		  gemm_kernel(kc, ap + (size_t) ir * kc, bp + (size_t) jr * kc,
+			      matrix_row(c, ic + ir) + jc + jr, c->stride,
+			      GEMM_MIN(GEMM_MR, mc - ir), GEMM_MIN(GEMM_NR, nc - jr),
+			      pc > 0);
+	    }
+	}
+    }
+
+  free(ap);
+  free(bp);
+}
+
+/** Compute @p c = @p a @p b for small matrices: each row of C is a sum
+ * of rows of B, which the compiler can vectorize.
+ */
+static void
+gemm_small(const Matrix *a, const Matrix *b, Matrix *c)
+{
+  unsigned int i, j, p;
+  const scalar_t *brow;
+  scalar_t *crow, s;
+
+  for ( i = 0; i < c->rows; i++ )
+    {
+      crow = matrix_row(c, i);
+      memset(crow, 0, sizeof(scalar_t) * c->cols);
+      for ( p = 0; p < a->cols; p++ )
+	{
+	  s = matrix_get(a, i, p);
+	  brow = matrix_row(b, p);
+	  for ( j = 0; j < c->cols; j++ )
+	    crow[j] += s * brow[j];
+	}
+    }
+}
+
+/* A product split between threads: each part multiplies a band of rows
+   of A into the same rows of C, or B's columns into C's. */
+struct gemm_task
+{
+  const Matrix *a, *b;
+  Matrix *c;
+  int by_rows;
+};
+
+static void
+gemm_task_part(void *arg, const unsigned int part, const unsigned int parts)
+{
+  const struct gemm_task *t = (const struct gemm_task *) arg;
+  Matrix a = *t->a, b = *t->b, c = *t->c;
+  unsigned int begin, end;
+
+  if ( t->by_rows )
+    {
+      matrix_part_range(c.rows, GEMM_MR, part, parts, &begin, &end);
+      a.values = matrix_row(t->a, begin);
+      c.values = matrix_row(t->c, begin);
+      a.rows = c.rows = end - begin;
+    }
+  else
+    {
+      matrix_part_range(c.cols, GEMM_NR, part, parts, &begin, &end);
+      b.values += begin;
+      c.values += begin;
+      b.cols = c.cols = end - begin;
+    }
+
+  if ( c.rows > 0 && c.cols > 0 )
+    gemm_blocked(&a, &b, &c);
+}
+#endif	/* MATRIX_CONTIGUOUS */
+
+
+/** Multiplies two matrices. Stores the result in dest, which must not be
+ * a or b.
  *
  * @param a a Matrix pointer
  * @param b a Matrix pointer
@@ -350,8 +1194,13 @@ scalar_t matrix_det(Matrix *m) {
 Matrix*
 matrix_mult(Matrix *a, Matrix *b, Matrix *dest)
 {
+#ifdef MATRIX_CONTIGUOUS
+  struct gemm_task task;
+  double work;
+#else
   unsigned int i, j, k;
   scalar_t s;
+#endif
 
   assert(a->cols == b->rows);
 
@@ -360,6 +1209,25 @@ matrix_mult(Matrix *a, Matrix *b, Matrix *dest)
   else
     assert(dest->rows == a->rows && dest->cols == b->cols) ;
 
+#ifdef MATRIX_CONTIGUOUS
+  assert(dest != a && dest != b);
+
+  work = (double) a->rows * b->cols * a->cols;
+  if ( work < GEMM_SMALL || a->cols == 0 )
+    gemm_small(a, b, dest);
+  else
+    {
+      /* Split the longer side of C between threads. */
+      task.a = a;
+      task.b = b;
+      task.c = dest;
+      task.by_rows = a->rows >= b->cols;
+      matrix_run(gemm_task_part, &task,
+		 matrix_parallel_parts(work, (unsigned int) ( task.by_rows
+							      ? ( dest->rows + GEMM_MR - 1 ) / GEMM_MR
+							      : ( dest->cols + GEMM_NR - 1 ) / GEMM_NR )));
+    }
+#else
   for(i=0; i < dest->rows; i++) {
     for(j=0; j < dest->cols; j++) {
       s = 0;
@@ -369,11 +1237,177 @@ matrix_mult(Matrix *a, Matrix *b, Matrix *dest)
       matrix_set(dest, i, j, s);
     }
   }
+#endif
 
   return dest;
 }
 
 
+/* Matrix addition and transposition, split between threads by bands of
+   rows of the result. */
+struct matrix_task
+{
+  Matrix *a, *b, *dest;
+};
+
+static void
+matrix_add_part(void *arg, const unsigned int part, const unsigned int parts)
+{
+  const struct matrix_task *t = (const struct matrix_task *) arg;
+  Matrix *a = t->a, *b = t->b, *dest = t->dest;
+  unsigned int i, j, begin, end;
+
+  matrix_part_range(dest->rows, 1, part, parts, &begin, &end);
+  for(i=begin; i < end; i++) {
+    for(j=0; j < dest->cols; j++) {
+      matrix_set(dest, i, j, matrix_get(a,i,j) + matrix_get(b,i,j));
+    }
+  }
+}
+
+#ifdef MATRIX_CONTIGUOUS
+/* Transposition
+ *
+ * Walking the source by rows writes the destination by columns, and on
+ * large matrices nearly every write misses the cache.  Instead the
+ * blocks are halved recursively, along their longer side, until they fit
+ * in TRANSPOSE_TILE x TRANSPOSE_TILE tiles, whose rows and columns all
+ * stay in L1 while they are copied.  The recursion keeps each block's
+ * source and destination in cache at every level of the hierarchy,
+ * whatever its sizes ("cache-oblivious"; Frigo et al., 1999).
+ */
+
+/* A cache line of scalars. */
+#define TRANSPOSE_TILE ( MATRIX_ALIGNMENT / sizeof(scalar_t) )
+
+/** Half of @p n (which is more than TRANSPOSE_TILE), rounded up to a
+ * whole number of tiles.
+ */
+static unsigned int
+transpose_split(const unsigned int n)
+{
+  return (unsigned int) ( ( n / 2 + TRANSPOSE_TILE - 1 ) / TRANSPOSE_TILE * TRANSPOSE_TILE );
+}
+
+/** Copy the transpose of the @p rows x @p cols block at @p src, with
+ * row stride @p ss, to @p dst, with row stride @p ds.
+ */
+static void
+transpose_block(const scalar_t *restrict src, const size_t ss,
+		scalar_t *restrict dst, const size_t ds,
+		const unsigned int rows, const unsigned int cols)
+{
+  unsigned int i, j, h;
+
+  if ( rows <= TRANSPOSE_TILE && cols <= TRANSPOSE_TILE )
+    {
+      for ( j = 0; j < cols; j++, dst += ds )
+	for ( i = 0; i < rows; i++ )
+	  dst[i] = src[i * ss + j];
+    }
+  else if ( rows >= cols )
+    {
+      h = transpose_split(rows);
+      transpose_block(src, ss, dst, ds, h, cols);
+      transpose_block(src + h * ss, ss, dst + h, ds, rows - h, cols);
+    }
+  else
+    {
+      h = transpose_split(cols);
+      transpose_block(src, ss, dst, ds, rows, h);
+      transpose_block(src + h, ss, dst + h * ds, ds, rows, cols - h);
+    }
+}
+
+/** Swap each element (i, j) of the @p rows x @p cols block at @p a with
+ * element (j, i) of the block at @p b, both with row stride @p stride.
+ */
+static void
+transpose_swap(scalar_t *restrict a, scalar_t *restrict b, const size_t stride,
+	       const unsigned int rows, const unsigned int cols)
+{
+  unsigned int i, j, h;
+  scalar_t t;
+
+  if ( rows <= TRANSPOSE_TILE && cols <= TRANSPOSE_TILE )
+    {
+      for ( i = 0; i < rows; i++ )
+	for ( j = 0; j < cols; j++ )
+	  {
+	    t = a[i * stride + j];
+	    a[i * stride + j] = b[j * stride + i];
+	    b[j * stride + i] = t;
+	  }
+    }
+  else if ( rows >= cols )
+    {
+      h = transpose_split(rows);
+      transpose_swap(a, b, stride, h, cols);
+      transpose_swap(a + h * stride, b + h, stride, rows - h, cols);
+    }
+  else
+    {
+      h = transpose_split(cols);
+      transpose_swap(a, b, stride, rows, h);
+      transpose_swap(a + h, b + h * stride, stride, rows, cols - h);
+    }
+}
+
+/** Transpose the @p n x @p n block at @p a, with row stride @p stride, in
+ * place: transpose the two diagonal blocks, and swap the two others.
+ */
+static void
+transpose_square(scalar_t *a, const size_t stride, const unsigned int n)
+{
+  unsigned int i, j, h;
+  scalar_t t;
+
+  if ( n <= TRANSPOSE_TILE )
+    {
+      for ( i = 1; i < n; i++ )
+	for ( j = 0; j < i; j++ )
+	  {
+	    t = a[i * stride + j];
+	    a[i * stride + j] = a[j * stride + i];
+	    a[j * stride + i] = t;
+	  }
+    }
+  else
+    {
+      h = transpose_split(n);
+      transpose_square(a, stride, h);
+      transpose_square(a + h * stride + h, stride, n - h);
+      transpose_swap(a + h, a + h * stride, stride, h, n - h);
+    }
+}
+#endif	/* MATRIX_CONTIGUOUS */
+
+#ifndef MATRIX_BY_VALUE
+static void
+matrix_transpose_part(void *arg, const unsigned int part, const unsigned int parts)
+{
+  const struct matrix_task *t = (const struct matrix_task *) arg;
+  Matrix *m = t->a, *dest = t->dest;
+  unsigned int begin, end;
+#ifndef MATRIX_CONTIGUOUS
+  unsigned int i, j;
+#endif
+
+  matrix_part_range(dest->rows, 1, part, parts, &begin, &end);
+#ifdef MATRIX_CONTIGUOUS
+  transpose_block(m->values + begin, m->stride, matrix_row(dest, begin), dest->stride,
+		  m->rows, end - begin);
+#else
+  for(i=0; i < m->rows; i++) {
+    for(j=begin; j < end; j++) {
+      matrix_set(dest, j, i, matrix_get(m, i, j));
+    }
+  }
+#endif
+}
+#endif
+
+
 /** Adds two matrices. Stores the result in dest.
  *
  * @param a a Matrix pointer
@@ -385,45 +1419,92 @@ matrix_mult(Matrix *a, Matrix *b, Matrix *dest)
 Matrix*
 matrix_add(Matrix *a, Matrix *b, Matrix *dest)
 {
-  unsigned int i, j;
+  struct matrix_task task;
 
   assert(MATRIX_CONGRUENT(a, b));
 
   if(!dest)
     dest = matrix_new(a->rows, a->cols);
+  else
+    assert(MATRIX_CONGRUENT(a, dest));
 
-  for(i=0; i < dest->rows; i++) {
-    for(j=0; j < dest->cols; j++) {
-      matrix_set(dest, i, j, matrix_get(a,i,j) + matrix_get(b,i,j));
+  task.a = a;
+  task.b = b;
+  task.dest = dest;
+  matrix_run(matrix_add_part, &task,
+	     matrix_parallel_parts((double) dest->rows * dest->cols, dest->rows));
+
+  return dest;
+}
+
+
+#ifndef MATRIX_BY_VALUE
+/** Transposes a square matrix in place.
+ *
+ * @param m a pointer to a square matrix
+ *
+ * @return m
+ */
+Matrix*
+matrix_transpose_in_place(Matrix *m)
+{
+#ifndef MATRIX_CONTIGUOUS
+  unsigned int i, j;
+  scalar_t t;
+#endif
+
+  assert(MATRIX_IS_SQUARE(m));
+
+#ifdef MATRIX_CONTIGUOUS
+  transpose_square(m->values, m->stride, m->rows);
+#else
+  for(i=1; i < m->rows; i++) {
+    for(j=0; j < i; j++) {
+      t = matrix_get(m, i, j);
+      matrix_set(m, i, j, matrix_get(m, j, i));
+      matrix_set(m, j, i, t);
     }
   }
+#endif
 
-  return dest;
+  return m;
 }
+#endif
 
 
 /** Transposes a matrix.
  *
  * @param m a pointer to the matrix to be transposed
- * @param dest a pointer to the location to store the result, or NULL
+ * @param dest a pointer to the location to store the result, or NULL;
+ *        if m is square, dest may be m itself
  *
  * @return dest, or a pointer to a new Matrix containing the result\
  *         if dest is NULL
  */
 Matrix* matrix_transpose(Matrix *m, Matrix *dest)
 {
+#ifndef MATRIX_BY_VALUE
+  struct matrix_task task;
+#else
   unsigned int i, j;
-#ifdef MATRIX_BY_VALUE
   scalar_t *a, *b;
 #endif
 
   if(dest)
     assert(dest->rows == m->cols && dest->cols == m->rows);
 
-#ifdef MATRIX_BY_ROW
+#ifndef MATRIX_BY_VALUE
+  if(dest == m)
+    return matrix_transpose_in_place(m);
   if(!dest)
     dest = matrix_new(m->cols, m->rows);
 
+  task.a = m;
+  task.b = NULL;
+  task.dest = dest;
+  matrix_run(matrix_transpose_part, &task,
+	     matrix_parallel_parts((double) dest->rows * dest->cols, dest->rows));
+
 #else  /* MATRIX_BY_VALUE */
 
   if(!dest) {
@@ -435,21 +1516,17 @@ Matrix* matrix_transpose(Matrix *m, Matrix *dest)
     dest->flags = 0 | IS_CHILD;
     dest->data = (scalar_t **) malloc(sizeof(scalar_t *) * (dest->rows) * (dest->cols));
   }
-#endif
 
   for(i=0; i < m->rows; i++) {
     for(j=0; j < m->cols; j++) {
-#ifdef MATRIX_BY_ROW
-      matrix_set(dest, j, i, matrix_get(m, i, j));
-#else  /* MATRIX_BY_VALUE */
       a = matrix_get_ptr(m, i, j);
       b = matrix_get_ptr(m, j, i);
 
       matrix_set_ptr(dest, i, j, b);
       matrix_set_ptr(dest, j, i, a);
-#endif
     }
   }
+#endif
 
   return dest;
 }
@@ -38,8 +38,18 @@ mlog(const unsigned long spec, const char* fmt, ...)
 
 int
 mlogv(const unsigned long spec, const char* fmt, va_list ap)
+{
+  return mlogvn(spec, fmt, ap, NULL);
+}
+
+/* Add the return value of a stdio output call to a byte counter. */
+#define COUNTED(n, expr) do { int __r = (expr); if ( __r > 0 ) n += (size_t) __r; } while ( 0 )
+
+int
+mlogvn(const unsigned long spec, const char* fmt, va_list ap, size_t* written)
 {
   mlog_loglevel_t lvl = LEVEL(spec);
+  size_t n = 0;
   mlog_flags_t flags = FLAGS(spec);
 
   static char lhnl = 1;
@@ -66,15 +76,15 @@ mlogv(const unsigned long spec, const char* fmt, va_list ap)
       if ( lvl != last_loglevel )
 	{
 	  if ( !lhnl )
-	    fprintf(stderr,"\n");
+	    COUNTED(n, fprintf(stderr,"\n"));
 
-	  fprintf(stderr, "[%c]", prefix[lvl]);
+	  COUNTED(n, fprintf(stderr, "[%c]", prefix[lvl]));
 	}
       else
-	fprintf(stderr, "   ");
-      fprintf(stderr, " %s%s",
-	      flags & F_PROGNAME ? va_arg(ap, char*) : mt,
-	      flags & F_PROGNAME ? pns : mt);
+	COUNTED(n, fprintf(stderr, "   "));
+      COUNTED(n, fprintf(stderr, " %s%s",
+			 flags & F_PROGNAME ? va_arg(ap, char*) : mt,
+			 flags & F_PROGNAME ? pns : mt));
     }
   else
     {
@@ -84,24 +94,26 @@ mlogv(const unsigned long spec, const char* fmt, va_list ap)
 
   if ( flags & F_MODNAME )
     {
-      fprintf(stderr, "%s: ", va_arg(ap, char*));
+      COUNTED(n, fprintf(stderr, "%s: ", va_arg(ap, char*)));
     }
 /* #ifdef DEBUG */
 /*   fprintf(stderr, "s%:%d: in function %s: ", fn, line, func); */
 /* #endif */
 
-  vfprintf(stderr, fmt, ap);
+  COUNTED(n, vfprintf(stderr, fmt, ap));
 
   if ( flags & F_ERRNO )
-    fprintf(stderr, ": %s", strerror(errno));
+    COUNTED(n, fprintf(stderr, ": %s", strerror(errno)));
 
-  if ( ! (flags & F_NONEWLINE) )
-    fputc('\n', stderr);
+  if ( ! (flags & F_NONEWLINE) && fputc('\n', stderr) != EOF )
+    n++;
   lhnl = (char) ! (flags & F_NONEWLINE);
 
   va_end(ap);
 
   last_loglevel = lvl;
+  if ( written )
+    *written = n;
   return mloglevel;
 }
 
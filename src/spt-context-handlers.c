@@ -0,0 +1,409 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <support/spt-context.h>
+
+#ifdef SPT_ENABLE_CONSISTENCY_CHECKS
+#include <assert.h>
+#define SPT_CONTEXT_HANDLER_MAGIC ( ( 'H' << 24 ) + ( 'N' << 16 ) + ( 'D' << 8 ) + 'L' )
+#define SPT_IS_CONTEXT_HANDLER(h) ( h && (h)->magic == SPT_CONTEXT_HANDLER_MAGIC )
+#else
+#define SPT_IS_CONTEXT_HANDLER(h) (h)
+#endif
+
+/** Size of the on-stack buffers used to format messages; longer
+ *  messages fall back to the heap.
+ */
+#define LINE_STACK_SIZE 512
+
+/** Current CLOCK_MONOTONIC time, in nanoseconds.
+ * @internal
+ */
+static uint64_t
+handler_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+/** Write an entire buffer to a file descriptor, retrying on short
+ *  writes and EINTR.
+ * @internal
+ */
+static int
+handler_write_fully(int fd, const char* data, size_t length)
+{
+  while ( length > 0 )
+    {
+      ssize_t n = write(fd, data, length);
+      if ( n < 0 )
+	{
+	  if ( errno == EINTR )
+	    continue;
+	  return -1;
+	}
+      data += n;
+      length -= (size_t) n;
+    }
+  return 0;
+}
+
+/** Write out a handler's buffer.  The caller must hold the handler's
+ *  lock.
+ * @internal
+ */
+static int
+handler_flush_locked(spt_context_handler_t* handler)
+{
+  int r = 0;
+  if ( handler->buffer_used > 0 )
+    r = handler_write_fully(handler->fd, handler->buffer, handler->buffer_used);
+  handler->buffer_used = 0;
+  handler->last_flush = handler_now();
+  return r;
+}
+
+/** Write function used by buffered file-descriptor handlers.
+ * @internal
+ */
+static ssize_t
+handler_buffered_write(spt_context_handler_t* handler,
+		       const spt_context_t* context __attribute__ (( unused )),
+		       const char* data,
+		       const size_t length)
+{
+  int r = 0;
+  pthread_mutex_lock(&handler->lock);
+
+  if ( handler->buffer_used + length > handler->buffer_size )
+    r = handler_flush_locked(handler);
+
+  if ( r == 0 )
+    {
+      if ( length > handler->buffer_size )
+	/* Too big to buffer; the buffer is empty now, so order is kept. */
+	r = handler_write_fully(handler->fd, data, length);
+      else
+	{
+	  if ( handler->buffer_used == 0 && handler->flush_thread_running )
+	    pthread_cond_signal(&handler->flush_wake);
+	  memcpy(handler->buffer + handler->buffer_used, data, length);
+	  handler->buffer_used += length;
+
+	  if ( handler->buffer_used == handler->buffer_size
+	       || ( handler->flush_interval
+		    && handler_now() - handler->last_flush >= handler->flush_interval ) )
+	    r = handler_flush_locked(handler);
+	}
+    }
+
+  pthread_mutex_unlock(&handler->lock);
+  return r < 0 ? -1 : (ssize_t) length;
+}
+
+/** Body of a buffered handler's flush thread: sleep until the buffered
+ *  data is due, then write it out.
+ * @internal
+ */
+static void*
+handler_flush_thread(void* arg)
+{
+  spt_context_handler_t* handler = (spt_context_handler_t*) arg;
+  uint64_t due;
+  struct timespec ts;
+
+  pthread_mutex_lock(&handler->lock);
+  while ( ! handler->flush_stop )
+    {
+      if ( handler->buffer_used == 0 )
+	{
+	  pthread_cond_wait(&handler->flush_wake, &handler->lock);
+	  continue;
+	}
+
+      due = handler->last_flush + handler->flush_interval;
+      if ( handler_now() >= due )
+	handler_flush_locked(handler);
+      else
+	{
+	  ts.tv_sec = (time_t) ( due / 1000000000ULL );
+	  ts.tv_nsec = (long) ( due % 1000000000ULL );
+	  pthread_cond_timedwait(&handler->flush_wake, &handler->lock, &ts);
+	}
+    }
+  pthread_mutex_unlock(&handler->lock);
+
+  return NULL;
+}
+
+/** Start a buffered handler's flush thread.  Its condition variable
+ *  times out on CLOCK_MONOTONIC, like handler_now.
+ * @internal
+ */
+static void
+handler_start_flush_thread(spt_context_handler_t* handler)
+{
+  pthread_condattr_t attr;
+
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&handler->flush_wake, &attr);
+  pthread_condattr_destroy(&attr);
+
+  if ( pthread_create(&handler->flush_thread, NULL, &handler_flush_thread, handler) == 0 )
+    handler->flush_thread_running = 1;
+  else
+    pthread_cond_destroy(&handler->flush_wake);
+}
+
+/* ****************************************************************
+ * Public API
+ */
+
+int
+spt_context_default_format(const spt_context_t* context,
+			   const spt_loglevel_t level,
+			   const char* message,
+			   char* dest,
+			   const size_t dest_size)
+{
+  static const char* prefix = "FEWIDT";
+  char lc = (unsigned int) level <= MLOG_MAX_LOGLEVEL ? prefix[level] : '?';
+
+  if ( context->flags & SPT_CONTEXT_HIDE_NAME || ! context->full_name )
+    return snprintf(dest, dest_size, "[%c] %s\n", lc, message);
+  else
+    return snprintf(dest, dest_size, "[%c] [%s] %s\n", lc, context->full_name, message);
+}
+
+spt_context_handler_t*
+spt_context_handler_create(spt_context_write_func_t write,
+			   spt_context_format_func_t format,
+			   void* user_data)
+{
+  spt_context_handler_t* handler;
+
+  if ( ! write )
+    return NULL;
+
+  if ( ! ( handler = (spt_context_handler_t*) malloc(sizeof(spt_context_handler_t)) ) )
+    {
+      perror("malloc");
+      return NULL;
+    }
+  memset(handler, 0, sizeof(spt_context_handler_t));
+
+#ifdef SPT_ENABLE_CONSISTENCY_CHECKS
+  handler->magic = SPT_CONTEXT_HANDLER_MAGIC;
+#endif
+  handler->write = write;
+  handler->format = format ? format : &spt_context_default_format;
+  handler->user_data = user_data;
+  handler->fd = -1;
+  pthread_mutex_init(&handler->lock, NULL);
+
+  return handler;
+}
+
+spt_context_handler_t*
+spt_context_handler_create_fd(int fd, size_t buffer_size,
+			      unsigned int flush_interval_ms,
+			      int take_ownership)
+{
+  spt_context_handler_t* handler;
+
+  if ( fd < 0 )
+    return NULL;
+  if ( buffer_size == 0 )
+    buffer_size = SPT_CONTEXT_HANDLER_DEFAULT_BUFFER_SIZE;
+
+  if ( ! ( handler = spt_context_handler_create(&handler_buffered_write, NULL, NULL) ) )
+    return NULL;
+
+  if ( ! ( handler->buffer = (char*) malloc(buffer_size) ) )
+    {
+      perror("malloc");
+      spt_context_handler_destroy(handler);
+      return NULL;
+    }
+
+  handler->fd = fd;
+  handler->owns_fd = take_ownership;
+  handler->buffer_size = buffer_size;
+  handler->flush_interval = (uint64_t) flush_interval_ms * 1000000ULL;
+  handler->last_flush = handler_now();
+  if ( handler->flush_interval )
+    handler_start_flush_thread(handler);
+
+  return handler;
+}
+
+spt_context_handler_t*
+spt_context_handler_open(const char* path, size_t buffer_size,
+			 unsigned int flush_interval_ms)
+{
+  spt_context_handler_t* handler;
+  int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+  if ( fd < 0 )
+    {
+      perror(path);
+      return NULL;
+    }
+
+  if ( ! ( handler = spt_context_handler_create_fd(fd, buffer_size, flush_interval_ms, 1) ) )
+    close(fd);
+
+  return handler;
+}
+
+int
+spt_context_handler_flush(spt_context_handler_t* handler)
+{
+  int r = 0;
+
+  if ( ! SPT_IS_CONTEXT_HANDLER(handler) )
+    return -1;
+
+  if ( handler->buffer )
+    {
+      pthread_mutex_lock(&handler->lock);
+      r = handler_flush_locked(handler);
+      pthread_mutex_unlock(&handler->lock);
+    }
+  return r;
+}
+
+void
+spt_context_handler_destroy(spt_context_handler_t* handler)
+{
+  if ( ! SPT_IS_CONTEXT_HANDLER(handler) )
+    return;
+
+  if ( handler->flush_thread_running )
+    {
+      pthread_mutex_lock(&handler->lock);
+      handler->flush_stop = 1;
+      pthread_cond_signal(&handler->flush_wake);
+      pthread_mutex_unlock(&handler->lock);
+
+      pthread_join(handler->flush_thread, NULL);
+      pthread_cond_destroy(&handler->flush_wake);
+    }
+
+  spt_context_handler_flush(handler);
+  if ( handler->owns_fd && handler->fd >= 0 )
+    close(handler->fd);
+
+  pthread_mutex_destroy(&handler->lock);
+  free(handler->buffer);
+#ifdef SPT_ENABLE_CONSISTENCY_CHECKS
+  handler->magic = 0;
+#endif
+  free(handler);
+}
+
+void
+spt_context_set_handler(spt_context_t* context, spt_context_handler_t* handler)
+{
+  if ( SPT_IS_CONTEXT(context) )
+    context->output_handler = handler;
+}
+
+spt_context_handler_t*
+spt_context_get_handler(const spt_context_t* context)
+{
+  for ( ; context != NULL; context = context->parent )
+    if ( context->output_handler )
+      return context->output_handler;
+  return NULL;
+}
+
+int
+spt_context_handler_vlog(spt_context_handler_t* handler,
+			 const spt_context_t* context,
+			 const unsigned long spec,
+			 const char* fmt,
+			 va_list ap,
+			 size_t* written)
+{
+  int saved_errno = errno;
+  mlog_loglevel_t lvl = (mlog_loglevel_t) ( spec & MLOG_LOGLEVEL_MASK );
+  char msg_stack[LINE_STACK_SIZE], line_stack[LINE_STACK_SIZE];
+  char *msg = msg_stack, *line = line_stack;
+  const char *progname = NULL, *modname = NULL;
+  int msg_len, line_len, r = -1;
+  size_t prefix_len = 0;
+  va_list aq;
+
+  /* Pull out the arguments mlog would consume before the format's. */
+  if ( spec & F_PROGNAME )
+    progname = va_arg(ap, const char*);
+  if ( spec & F_MODNAME )
+    modname = va_arg(ap, const char*);
+
+  if ( progname || modname )
+    prefix_len = (size_t) snprintf(msg_stack, sizeof(msg_stack), "%s%s%s%s",
+				   progname ? progname : "", progname ? ": " : "",
+				   modname ? modname : "", modname ? ": " : "");
+  if ( prefix_len >= sizeof(msg_stack) )
+    prefix_len = 0;		/* absurdly long names; drop them */
+
+  va_copy(aq, ap);
+  msg_len = vsnprintf(msg + prefix_len, sizeof(msg_stack) - prefix_len, fmt, aq);
+  va_end(aq);
+  if ( msg_len < 0 )
+    return -1;
+
+  if ( (size_t) msg_len >= sizeof(msg_stack) - prefix_len )
+    {
+      if ( ! ( msg = (char*) malloc(prefix_len + (size_t) msg_len + 1) ) )
+	return -1;
+      memcpy(msg, msg_stack, prefix_len);
+      vsnprintf(msg + prefix_len, (size_t) msg_len + 1, fmt, ap);
+    }
+
+  if ( spec & F_ERRNO )
+    {
+      /* Rare; just build a new message. */
+      char* with_errno = NULL;
+      if ( asprintf(&with_errno, "%s: %s", msg, strerror(saved_errno)) < 0 )
+	goto out;
+      if ( msg != msg_stack )
+	free(msg);
+      msg = with_errno;
+    }
+
+  line_len = handler->format(context, lvl, msg, line_stack, sizeof(line_stack));
+  if ( line_len < 0 )
+    goto out;
+  if ( (size_t) line_len >= sizeof(line_stack) )
+    {
+      if ( ! ( line = (char*) malloc((size_t) line_len + 1) ) )
+	goto out;
+      handler->format(context, lvl, msg, line, (size_t) line_len + 1);
+    }
+
+  if ( handler->write(handler, context, line, (size_t) line_len) >= 0 )
+    {
+      if ( written )
+	*written = (size_t) line_len;
+      r = mlog_get_level();
+    }
+
+ out:
+  if ( line != line_stack )
+    free(line);
+  if ( msg != msg_stack )
+    free(msg);
+  return r;
+}
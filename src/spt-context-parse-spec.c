@@ -5,59 +5,168 @@
 #include <stdint.h>
 #include <stddef.h>
 
+#include <fnmatch.h>
+
 #include <support/spt-context.h>
-#include <support/dllist.h>
 
 #ifdef SPT_ENABLE_CONSISTENCY_CHECKS
 #include <assert.h>
 #endif
 
-struct pspec_applydata
+#define STATE_BITS ( sizeof(unsigned long int) * 8 )
+#define STATE_WORD(s) ( (s) / STATE_BITS )
+#define STATE_MASK(s) ( 1UL << ( (s) % STATE_BITS ) )
+#define STATE_SET(set, s) ( (set)[STATE_WORD(s)] |= STATE_MASK(s) )
+#define STATE_TEST(set, s) ( (set)[STATE_WORD(s)] & STATE_MASK(s) )
+
+/* ****************************************************************
+ * Matcher simulation
+ */
+
+/** Find the index of the first literal edge whose name is not less
+ * than @p name.
+ *
+ * @internal
+ */
+static size_t
+_matcher_lower_bound(const spt_context_spec_matcher_t* m, const char* name)
+{
+  size_t lo = 0, hi = m->num_literals;
+  while ( lo < hi )
+    {
+      size_t mid = lo + ( hi - lo ) / 2;
+      if ( strcmp(m->literals[mid].name, name) < 0 )
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  return lo;
+}
+
+/** Advance the matcher by one name element.
+ *
+ * @param m Matcher to simulate.
+ *
+ * @param in State set reached by the parent context (or all-clear at
+ * the top of a hierarchy).  Start states are implicitly included.
+ *
+ * @param name Name element to consume.
+ *
+ * @param out Destination for the resulting state set.
+ *
+ * @internal
+ */
+static void
+_matcher_step(const spt_context_spec_matcher_t* m,
+	      const unsigned long int* in,
+	      const char* name,
+	      unsigned long int* out)
 {
-  dllist_t* pspec_list;
-  spt_context_t* context;
-};
+#define ACTIVE(s) ( STATE_TEST(in, s) || STATE_TEST(m->start, s) )
+  size_t i;
+  memset(out, 0, m->num_words * sizeof(unsigned long int));
+
+  /* Literal transitions: one binary search finds every state that
+     has a transition on this name. */
+  for ( i = _matcher_lower_bound(m, name);
+	i < m->num_literals && ! strcmp(m->literals[i].name, name);
+	++i )
+    if ( ACTIVE(m->literals[i].state) )
+      STATE_SET(out, m->literals[i].state + 1);
+
+  /* Wildcard transitions. */
+  for ( i = 0; i < m->num_wild; ++i )
+    {
+      size_t s = m->wild[i];
+      if ( ! ACTIVE(s) )
+	continue;
 
-/* Foreward declarations */
-static uint8_t
-_fe_context_apply_single_spec(spt_context_t* context, void* udata);
+      switch ( m->states[s].kind )
+	{
+	case SPT_CONTEXT_PATTERN_ANY:
+	  STATE_SET(out, s + 1);
+	  break;
+	case SPT_CONTEXT_PATTERN_GLOB:
+	  if ( ! fnmatch(m->states[s].pattern, name, 0) )
+	    STATE_SET(out, s + 1);
+	  break;
+	case SPT_CONTEXT_PATTERN_ANY_SEQUENCE:
+	  STATE_SET(out, s);
+	  break;
+	}
+    }
+#undef ACTIVE
 
-/* ****************************************************************
- * Utility functions
+  /* A "**" state may also match nothing at all.  `wild' is sorted, so
+     chains of "**" are followed in a single pass. */
+  for ( i = 0; i < m->num_wild; ++i )
+    {
+      size_t s = m->wild[i];
+      if ( m->states[s].kind == SPT_CONTEXT_PATTERN_ANY_SEQUENCE && STATE_TEST(out, s) )
+	STATE_SET(out, s + 1);
+    }
+}
+
+/** Apply every parse spec accepted at a context, refresh the
+ *  context's inherited state, and recurse into its children.
+ *
+ * @internal
  */
-/* _apply_pspec could be inline, but references static function _fe_context_apply_single_spec. */
-static int
-_apply_pspec(const spt_context_parse_spec_t* ps, spt_context_t* cxt)
+static void
+_matcher_apply(const spt_context_spec_matcher_t* m,
+	       spt_context_t* cxt,
+	       const unsigned long int* in)
 {
 #ifdef SPT_ENABLE_CONSISTENCY_CHECKS
   assert(SPT_IS_CONTEXT(cxt));
-  assert(SPT_IS_CONTEXT_PARSE_SPEC(ps));
 #endif
-  uint8_t apply_here = 1;
-  int i;
-  const spt_context_t* cc = cxt;
-  for ( i = (signed) ps->name_array_length - 1; i > -1 && cc != NULL; --i, cc = cc->parent )
+  unsigned long int* out = (unsigned long int*) alloca(m->num_words * sizeof(unsigned long int));
+  size_t w;
+
+  _matcher_step(m, in, cxt->name, out);
+
+  /* Accepting states are numbered in parse-spec order, so specs later
+     in the list override earlier ones. */
+  for ( w = 0; w < m->num_words; ++w )
     {
-      if ( strcmp(cc->name, ps->name_array[i]) )
+      unsigned long int hits = out[w] & m->accept[w];
+      while ( hits )
 	{
-	  /* fprintf(stderr, "not applying pspec %p to context %s\n", ps, cc->full_name); */
-	  apply_here = 0;
-	  break;
+	  size_t s = w * STATE_BITS + (size_t) __builtin_ctzl(hits);
+	  const spt_context_parse_spec_t* ps = m->states[s].spec;
+	  cxt->flags = (cxt->flags & ~(ps->mask)) | (ps->flags & ps->mask);
+	  if ( ps->mask & SPT_CONTEXT_SAMPLED )
+	    spt_context_set_sample_rate(cxt, ps->sample_rate);
+	  hits &= hits - 1;
 	}
-      /* fprintf(stderr, "pspec %p matched \"%s\" on \"%s\"\n", ps, cc->name, ps->name_array[i]); */
     }
-  if ( apply_here )
+
+  /* The parent has already been visited, so its state is final. */
+  if ( cxt->parent && ! (cxt->flags & SPT_CONTEXT_NO_IMPLICIT_STATE) )
     {
-      /* fprintf(stderr, "applying pspec %p to context %s\n", ps, cxt->full_name); */
-      cxt->flags = (cxt->flags & ~(ps->mask)) | (ps->flags & ps->mask);
-      if ( ps->flags & SPT_CONTEXT_EXPLICIT_STATE )
-      	spt_context_enable(cxt);
+      if ( spt_context_active(cxt->parent) )
+	cxt->flags |= SPT_CONTEXT_IMPLICIT_STATE;
       else
-      	spt_context_disable(cxt);
+	cxt->flags &= (unsigned) ~SPT_CONTEXT_IMPLICIT_STATE;
     }
-  spt_context_each_child(cxt, &_fe_context_apply_single_spec, (void*) ps);
 
-  return 1;
+  for ( spt_context_t* child = cxt->first_child; child != NULL; child = child->next_sibling )
+    _matcher_apply(m, child, out);
+}
+
+/** Ordering for literal edges: by name, then by state.
+ * @internal
+ */
+static int
+_edge_compare(const void* a, const void* b)
+{
+  const struct __spt_context_spec_edge
+    *ea = (const struct __spt_context_spec_edge*) a,
+    *eb = (const struct __spt_context_spec_edge*) b;
+  int r = strcmp(ea->name, eb->name);
+  if ( r )
+    return r;
+  return ea->state < eb->state ? -1 : ( ea->state > eb->state );
 }
 
 #define assign_and_advance(dest,type,size,source,size_counter)	\
@@ -74,10 +183,16 @@ _parse_single_spec(const char* _spec, const size_t _length)
 
   size_t num_elems = 1;
 
+  /* The context-identifier ends at the sample-rate separator, if any. */
+  const char* rate_sep = (const char*) memchr(_spec, '/', _length);
+  const size_t names_length = rate_sep ? (size_t) ( rate_sep - _spec ) : _length;
+  if ( names_length < 2 )
+    return NULL;
+
   /* Count the number of name elements. */
   {
     const char* search = _spec + 1;
-    while ( (search = strchr(search, '.')) != NULL )
+    while ( (search = (const char*) memchr(search, '.', names_length - (size_t) ( search - _spec ))) != NULL )
       {
 	num_elems++;
 	search++;
@@ -103,11 +218,25 @@ _parse_single_spec(const char* _spec, const size_t _length)
   ps->magic = SPT_CONTEXT_PARSE_SPEC_MAGIC;
 #endif
   ps->name_array_length = num_elems;
+  ps->sample_rate = 1.0;
+
+  if ( rate_sep )
+    {
+      char* rate_end = NULL;
+      ps->sample_rate = strtod(ps->input + names_length + 1, &rate_end);
+      if ( *(ps->input) != '+' || rate_end == ps->input + names_length + 1
+	   || *rate_end != '\0' || ! ( ps->sample_rate > 0.0 ) )
+	{
+	  free(ps);
+	  return NULL;
+	}
+      ps->input[names_length] = '\0';
+    }
 
   /* Loop through again and grab name element strings  */
   unsigned int i = 0;
   char* search = ps->input + 1;
-  while ( search < ps->input + _length )
+  while ( search < ps->input + names_length )
     {
       buf = search;
       search = strchrnul(buf, '.');
@@ -121,7 +250,9 @@ _parse_single_spec(const char* _spec, const size_t _length)
       ps->flags
 	= SPT_CONTEXT_POLICY	      /* explicit policy */
 	| SPT_CONTEXT_EXPLICIT_STATE /* set to enabled */;
-      ps->mask = ps->flags;
+      ps->mask
+	= ps->flags
+	| SPT_CONTEXT_SAMPLED	      /* (re)set the sampling rate */;
     }
   else if ( *(ps->input) == '-' )
     {
@@ -136,70 +267,160 @@ _parse_single_spec(const char* _spec, const size_t _length)
 }
 
 /* ****************************************************************
- * Callbacks
+ * Public API
  */
-static uint8_t
-_fe_context_apply_single_spec(spt_context_t* context, void* udata)
+
+void
+spt_context_apply_parse_specs(spt_context_t* context,
+			      spt_context_parse_spec_t* pspec_list)
 {
-  spt_context_parse_spec_t* ps = (spt_context_parse_spec_t*) udata;
-  _apply_pspec(ps, context);
-  return 1;
+  spt_context_spec_matcher_t* m = spt_context_compile_parse_specs(pspec_list);
+  if ( m )
+    {
+      spt_context_apply_spec_matcher(context, m);
+      spt_context_spec_matcher_destroy(m);
+    }
 }
 
-
-static int
-_fe_apply_pspecs(dllist_t* node, const void* udata)
+spt_context_spec_matcher_t*
+spt_context_compile_parse_specs(const spt_context_parse_spec_t* pspec_list)
 {
-  spt_context_parse_spec_t* ps = (spt_context_parse_spec_t*) node->data;
-  struct pspec_applydata* pad = (struct pspec_applydata*) udata;
-  spt_context_t* cxt = pad->context;
+  size_t num_states = 0, num_literals = 0, num_wild = 0;
+  const spt_context_parse_spec_t* ps;
 
-  if ( _apply_pspec(ps, cxt) )
+  for ( ps = pspec_list; ps != NULL; ps = ps->next )
     {
-      pad->pspec_list = dllist_unlink(pad->pspec_list, node);
+#ifdef SPT_ENABLE_CONSISTENCY_CHECKS
+      assert(SPT_IS_CONTEXT_PARSE_SPEC(ps));
+#endif
+      num_states += ps->name_array_length + 1;
+      for ( size_t i = 0; i < ps->name_array_length; ++i )
+	if ( strpbrk(ps->name_array[i], "*?[") )
+	  num_wild++;
+	else
+	  num_literals++;
     }
+  if ( ! num_states )
+    return NULL;
 
-  return 1;
-}
+  size_t num_words = ( num_states + STATE_BITS - 1 ) / STATE_BITS;
+  size_t n
+    = sizeof(spt_context_spec_matcher_t)
+    + num_states * sizeof(struct __spt_context_spec_state)
+    + num_literals * sizeof(struct __spt_context_spec_edge)
+    + 2 * num_words * sizeof(unsigned long int)
+    + num_wild * sizeof(size_t);
 
-/* ****************************************************************
- * Public API
- */
+  char* buf = (char*) malloc(n);
+  if ( ! buf )
+    return NULL;
+  memset(buf, 0, n);
 
-void
-spt_context_apply_parse_specs(spt_context_t* context,
-			      spt_context_parse_spec_t* pspec_list)
-{
-  size_t n = 0;
-  for ( spt_context_parse_spec_t* pspec = pspec_list; pspec != NULL; ++n )
-    pspec = pspec->next;
-
-  dllist_t*
-    nodes = (dllist_t*) alloca(sizeof(dllist_t) * n);
-  dllist_t*
-    cnode = nodes;
-  for ( spt_context_parse_spec_t* pspec = pspec_list; cnode < nodes + n; ++cnode )
-    {
+  spt_context_spec_matcher_t* m = NULL;
+  assign_and_advance(m, spt_context_spec_matcher_t, sizeof(spt_context_spec_matcher_t), buf, n);
+  assign_and_advance(m->states, struct __spt_context_spec_state, ( num_states * sizeof(struct __spt_context_spec_state) ), buf, n);
+  assign_and_advance(m->literals, struct __spt_context_spec_edge, ( num_literals * sizeof(struct __spt_context_spec_edge) ), buf, n);
+  assign_and_advance(m->start, unsigned long int, ( num_words * sizeof(unsigned long int) ), buf, n);
+  assign_and_advance(m->accept, unsigned long int, ( num_words * sizeof(unsigned long int) ), buf, n);
+  assign_and_advance(m->wild, size_t, ( num_wild * sizeof(size_t) ), buf, n);
 #ifdef SPT_ENABLE_CONSISTENCY_CHECKS
-      cnode->magic = DLLIST_MAGIC;
+  assert(n == 0);
+  m->magic = SPT_CONTEXT_SPEC_MATCHER_MAGIC;
 #endif
-      cnode->next = NULL;
-      cnode->prev = NULL;
-
-      cnode->data = pspec;
-      pspec = pspec->next;
-      if ( pspec )
+  m->num_states = num_states;
+  m->num_words = num_words;
+
+  /* Lay out each spec's states consecutively: state `base + i' has a
+     transition on name_array[i] to `base + i + 1', and `base + length'
+     accepts. */
+  size_t s = 0;
+  for ( ps = pspec_list; ps != NULL; ps = ps->next )
+    {
+      STATE_SET(m->start, s);
+      for ( size_t i = 0; i < ps->name_array_length; ++i, ++s )
 	{
-	  cnode->next = cnode + 1;
-	  (cnode+1)->prev = cnode;
+	  const char* pattern = ps->name_array[i];
+	  struct __spt_context_spec_state* st = m->states + s;
+	  st->pattern = pattern;
+	  st->spec = ps;
+
+	  if ( ! strcmp(pattern, "**") )
+	    st->kind = SPT_CONTEXT_PATTERN_ANY_SEQUENCE;
+	  else if ( ! strcmp(pattern, "*") )
+	    st->kind = SPT_CONTEXT_PATTERN_ANY;
+	  else if ( strpbrk(pattern, "*?[") )
+	    st->kind = SPT_CONTEXT_PATTERN_GLOB;
+	  else
+	    {
+	      st->kind = SPT_CONTEXT_PATTERN_LITERAL;
+	      m->literals[m->num_literals].name = pattern;
+	      m->literals[m->num_literals].state = s;
+	      m->num_literals++;
+	      continue;
+	    }
+	  m->wild[m->num_wild++] = s;
 	}
+      m->states[s].spec = ps;
+      STATE_SET(m->accept, s);
+      s++;
+    }
+
+  /* Follow "**" prefixes from the start states. */
+  for ( size_t i = 0; i < m->num_wild; ++i )
+    {
+      size_t w = m->wild[i];
+      if ( m->states[w].kind == SPT_CONTEXT_PATTERN_ANY_SEQUENCE && STATE_TEST(m->start, w) )
+	STATE_SET(m->start, w + 1);
     }
 
-  struct pspec_applydata pad;
-  pad.pspec_list = nodes;
-  pad.context = context;
+  qsort(m->literals, m->num_literals, sizeof(struct __spt_context_spec_edge), &_edge_compare);
 
-  dllist_foreach(nodes, &_fe_apply_pspecs, &pad);
+  return m;
+}
+
+void
+spt_context_apply_spec_matcher(spt_context_t* context,
+			       const spt_context_spec_matcher_t* matcher)
+{
+  if ( ! SPT_IS_CONTEXT(context) || ! SPT_IS_CONTEXT_SPEC_MATCHER(matcher) )
+    return;
+
+  /* Feed the names of any ancestors through the matcher first, so
+     that specs naming them can match below `context'. */
+  size_t depth = 0, i;
+  const spt_context_t* cc;
+  for ( cc = context->parent; cc != NULL; cc = cc->parent )
+    depth++;
+
+  const spt_context_t** chain = (const spt_context_t**) alloca(depth * sizeof(spt_context_t*));
+  for ( i = depth, cc = context->parent; cc != NULL; cc = cc->parent )
+    chain[--i] = cc;
+
+  size_t nbytes = matcher->num_words * sizeof(unsigned long int);
+  unsigned long int
+    *in = (unsigned long int*) alloca(nbytes),
+    *out = (unsigned long int*) alloca(nbytes);
+  memset(in, 0, nbytes);
+
+  for ( i = 0; i < depth; ++i )
+    {
+      unsigned long int* t;
+      _matcher_step(matcher, in, chain[i]->name, out);
+      t = in, in = out, out = t;
+    }
+
+  _matcher_apply(matcher, context, in);
+  spt_context_dispatch_state_changes(context);
+}
+
+void
+spt_context_spec_matcher_destroy(spt_context_spec_matcher_t* matcher)
+{
+#ifdef SPT_ENABLE_CONSISTENCY_CHECKS
+  if ( matcher )
+    matcher->magic = 0;
+#endif
+  free(matcher);
 }
 
 spt_context_parse_spec_t*
@@ -256,7 +477,12 @@ spt_context_parse_specs(const char* __ispec)
 void
 spt_context_parse_spec_destroy(spt_context_parse_spec_t* pspec)
 {
-  free(pspec);
+  while ( pspec )
+    {
+      spt_context_parse_spec_t* next = pspec->next;
+      free(pspec);
+      pspec = next;
+    }
 }
 
 
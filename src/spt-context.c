@@ -4,6 +4,7 @@
 #include <string.h>
 #include <stdint.h>
 #include <stddef.h>
+#include <time.h>
 
 #ifndef NDEBUG
 #include <assert.h>
@@ -22,12 +23,47 @@
 #define CMLOG_FORMAT_NONAME "%s"
 static unsigned long int context_id_base = 0;
 
+/* Zero until the thread first samples; see spt_context_sample_seed. */
+__thread uint32_t spt_context_sample_state = 0;
+
 #ifdef SPT_ENABLE_CONSISTENCY_CHECKS
 #include <assert.h>
 #endif
 
 #define LEVEL(cmlog_flags)	(cmlog_flags & MLOG_LOGLEVEL_MASK )
 
+#ifdef SPT_CONTEXT_ENABLE_CALLBACKS
+/** Number of contexts that have callbacks set.  While this is zero,
+ *  state-change dispatch is skipped entirely.
+ */
+static unsigned long int context_callbacks_count = 0;
+
+/** Nesting depth of spt_context_begin_update calls. */
+static unsigned int context_update_depth = 0;
+
+/** Invoke callback @p member on every callback set that applies to
+ *  @p cxt: its own, then those of its ancestors up to the first
+ *  context that does not inherit callbacks.  Each callback receives
+ *  the remaining macro arguments followed by its user data.
+ *
+ * @internal
+ */
+#define CONTEXT_INVOKE_CALLBACKS(cxt, member, ...)			\
+  do {									\
+    const spt_context_t* __cc;						\
+    if ( context_callbacks_count )					\
+      for ( __cc = (cxt); __cc != NULL; __cc = __cc->parent )		\
+	{								\
+	  if ( __cc->callbacks && __cc->callbacks->member )		\
+	    __cc->callbacks->member(__VA_ARGS__, __cc->callbacks_user_data); \
+	  if ( __cc->flags & SPT_CONTEXT_NO_CALLBACK_INHERITANCE )	\
+	    break;							\
+	}								\
+  } while ( 0 )
+#else
+#define CONTEXT_INVOKE_CALLBACKS(cxt, member, ...)
+#endif
+
 #ifdef SPT_CONTEXT_ENABLE_DESCRIPTION
 #define CONTEXT_ALLOC_SIZES(parent,name,description)			\
   size_t name_alloc_size = strlen(name) + 1;				\
@@ -86,7 +122,7 @@ spt_context_each_child(const spt_context_t* context,
  * @internal
  */
 __attribute__ (( __always_inline__ ))
-__inline__ void
+static __inline__ void
 context_append_child(spt_context_t* cxt, spt_context_t* child)
 {
   /* Do we need to initialize the first_child list pointer, or just
@@ -107,6 +143,12 @@ context_append_child(spt_context_t* cxt, spt_context_t* child)
   cxt->last_child = child;
   cxt->last_child->next_sibling = NULL;
   cxt->last_child->parent = cxt;
+
+#ifdef SPT_CONTEXT_ENABLE_CALLBACKS
+  for ( spt_context_t* sibling = cxt->first_child; sibling != child; sibling = sibling->next_sibling )
+    CONTEXT_INVOKE_CALLBACKS(sibling, post_sibling_add, sibling, child);
+  CONTEXT_INVOKE_CALLBACKS(cxt, post_child_add, cxt, child);
+#endif
 }
 
 /** Remove a context from its list of siblings.
@@ -116,7 +158,7 @@ context_append_child(spt_context_t* cxt, spt_context_t* child)
  * @internal
  */
 __attribute__ (( __always_inline__ ))
-__inline__ uint8_t
+static __inline__ uint8_t
 context_unlink_parent_and_siblings(spt_context_t* cxt)
 {
   if ( cxt->prev_sibling != NULL )
@@ -135,11 +177,18 @@ context_unlink_parent_and_siblings(spt_context_t* cxt)
  * @internal
  */
 __attribute__ (( __always_inline__ ))
-__inline__ uint8_t
+static __inline__ uint8_t
 context_remove_child(spt_context_t* cxt, spt_context_t* child)
 {
   assert( SPT_CONTEXT_HAS_CHILDREN(cxt) );
 
+#ifdef SPT_CONTEXT_ENABLE_CALLBACKS
+  CONTEXT_INVOKE_CALLBACKS(cxt, pre_child_remove, cxt, child);
+  for ( spt_context_t* sibling = cxt->first_child; sibling != NULL; sibling = sibling->next_sibling )
+    if ( sibling != child )
+      CONTEXT_INVOKE_CALLBACKS(sibling, pre_sibling_remove, sibling, child);
+#endif
+
   /* If it's the first or last child entry, we need to update this
    * context's {first|last}_child links.
    */
@@ -221,6 +270,10 @@ context_destroy_single(spt_context_t* context)
 {
   if ( SPT_IS_CONTEXT(context) )
     {
+#ifdef SPT_CONTEXT_ENABLE_CALLBACKS
+      if ( context->callbacks )
+	context_callbacks_count--;
+#endif
 #ifdef SPT_ENABLE_CONSISTENCY_CHECKS
       context->magic = 0;
 #endif	/* SPT_ENABLE_CONSISTENCY_CHECKS */
@@ -248,11 +301,7 @@ static uint8_t
 _fe_destroy_context_recursive(spt_context_t* context,
 			      void* udata __attribute__ (( unused )) )
 {
-  if ( SPT_CONTEXT_HAS_CHILDREN(context) )
-    spt_context_destroy_recursive(context);
-  else
-    context_destroy_single(context);
-
+  spt_context_destroy_recursive(context);
   return 1;
 }
 
@@ -268,6 +317,8 @@ _fe_unparent_context(spt_context_t* cxt,
   return 1;
 }
 
+static void context_reset(spt_context_t* context);
+
 /** Assign the value of pointer @p source to pointer @p dest; advance
  *  @p source by @p size bytes and decrement @p size_counter by @p
  *  size.
@@ -361,11 +412,19 @@ spt_context_create(spt_context_t* parent,
     {
       context_append_child(parent, cxt);
       assert(SPT_CONTEXT_HAS_CHILDREN(parent));
-      spt_context_reset(cxt);
+      context_reset(cxt);
     }
 
   cxt->full_name = context_build_full_name(cxt, fullname_alloc_size);
 
+#ifdef SPT_CONTEXT_ENABLE_CALLBACKS
+  /* A new context starts out in the state it was created with; there
+     is no transition to report. */
+  if ( spt_context_active(cxt) )
+    cxt->flags |= SPT_CONTEXT_NOTIFIED_STATE;
+  CONTEXT_INVOKE_CALLBACKS(cxt, post_create, cxt);
+#endif
+
   return cxt;
 }
 
@@ -375,6 +434,8 @@ spt_context_destroy(spt_context_t* context)
   if ( ! context )
     return;
 
+  CONTEXT_INVOKE_CALLBACKS(context, pre_destroy, context);
+
   /* Free list of child contexts */
   if ( SPT_CONTEXT_HAS_CHILDREN(context) )
     spt_context_each_child(context, &_fe_unparent_context, NULL);
@@ -396,6 +457,8 @@ spt_context_destroy_recursive(spt_context_t* context)
   if ( ! context )
     return;
 
+  CONTEXT_INVOKE_CALLBACKS(context, pre_destroy, context);
+
   if ( SPT_CONTEXT_HAS_CHILDREN(context) )
     {
       spt_context_each_child(context, &_fe_destroy_context_recursive, NULL);
@@ -476,8 +539,12 @@ context_inherit_state(spt_context_t* context)
 }
 
 
-void
-spt_context_enable(spt_context_t* context/*, const unsigned int recursive*/)
+/** Enable a context without dispatching state-change callbacks.
+ *
+ * @internal
+ */
+static void
+context_enable(spt_context_t* context)
 {
   context->flags |= SPT_CONTEXT_POLICY; /* set policy explicit */
   context->flags |= SPT_CONTEXT_EXPLICIT_STATE; /* enable */
@@ -487,9 +554,12 @@ spt_context_enable(spt_context_t* context/*, const unsigned int recursive*/)
     spt_context_each_child(context, &_fe_inherit_state, NULL);
 }
 
-
-void
-spt_context_disable(spt_context_t* context)
+/** Disable a context without dispatching state-change callbacks.
+ *
+ * @internal
+ */
+static void
+context_disable(spt_context_t* context)
 {
   context->flags |= SPT_CONTEXT_POLICY; /* set policy explicit */
   context->flags &= (unsigned) ~SPT_CONTEXT_EXPLICIT_STATE; /* disable */
@@ -499,9 +569,12 @@ spt_context_disable(spt_context_t* context)
     spt_context_each_child(context, &_fe_inherit_state, NULL);
 }
 
-
-void
-spt_context_reset(spt_context_t* context)
+/** Reset a context without dispatching state-change callbacks.
+ *
+ * @internal
+ */
+static void
+context_reset(spt_context_t* context)
 {
   /* Unset policy bit (set to implicit)   */
   context->flags &= (unsigned) ~SPT_CONTEXT_POLICY;
@@ -510,6 +583,389 @@ spt_context_reset(spt_context_t* context)
   context_inherit_state(context);
 }
 
+
+void
+spt_context_enable(spt_context_t* context/*, const unsigned int recursive*/)
+{
+  context_enable(context);
+  spt_context_dispatch_state_changes(context);
+}
+
+
+void
+spt_context_disable(spt_context_t* context)
+{
+  context_disable(context);
+  spt_context_dispatch_state_changes(context);
+}
+
+
+void
+spt_context_reset(spt_context_t* context)
+{
+  context_reset(context);
+  spt_context_dispatch_state_changes(context);
+}
+
+#ifdef SPT_CONTEXT_ENABLE_CALLBACKS
+/* ----------------------------------------------------------------
+ * Callbacks
+ */
+
+/** Report a context's state if it differs from the last one
+ *  reported, then recurse into its children.
+ *
+ * @internal
+ */
+static uint8_t
+_fe_dispatch_state_change(spt_context_t* context,
+			  void* udata __attribute__ (( unused )) )
+{
+  uint8_t active = spt_context_active(context) ? 1 : 0;
+
+  if ( active != ( ( context->flags & SPT_CONTEXT_NOTIFIED_STATE ) ? 1 : 0 ) )
+    {
+      context->flags ^= SPT_CONTEXT_NOTIFIED_STATE;
+      CONTEXT_INVOKE_CALLBACKS(context, state_changed, context, active);
+    }
+
+  if ( SPT_CONTEXT_HAS_CHILDREN(context) )
+    spt_context_each_child(context, &_fe_dispatch_state_change, NULL);
+  return 1;
+}
+
+/** Mark a context's current state as reported, without invoking any
+ *  callbacks, then recurse into its children.
+ *
+ * @internal
+ */
+static uint8_t
+_fe_sync_notified_state(spt_context_t* context,
+			void* udata __attribute__ (( unused )) )
+{
+  if ( spt_context_active(context) )
+    context->flags |= SPT_CONTEXT_NOTIFIED_STATE;
+  else
+    context->flags &= (unsigned) ~SPT_CONTEXT_NOTIFIED_STATE;
+
+  if ( SPT_CONTEXT_HAS_CHILDREN(context) )
+    spt_context_each_child(context, &_fe_sync_notified_state, NULL);
+  return 1;
+}
+
+void
+spt_context_dispatch_state_changes(spt_context_t* root)
+{
+  if ( ! context_callbacks_count || context_update_depth > 0 || ! root )
+    return;
+
+  _fe_dispatch_state_change(root, NULL);
+}
+
+void
+spt_context_set_callbacks(spt_context_t* context,
+			  const spt_context_callbacks_t* callbacks,
+			  void* user_data)
+{
+  if ( ! context->callbacks && callbacks )
+    context_callbacks_count++;
+  else if ( context->callbacks && ! callbacks )
+    context_callbacks_count--;
+
+  context->callbacks = callbacks;
+  context->callbacks_user_data = user_data;
+
+  /* Changes made while no callbacks were listening are not reported
+     retroactively. */
+  _fe_sync_notified_state(context, NULL);
+}
+
+void
+spt_context_callbacks_set_inheritance(spt_context_t* context,
+				      enum spt_context_callbacks_inheritance inheritance)
+{
+  if ( inheritance == SPT_CONTEXT_CALLBACKS_NO_INHERITANCE )
+    context->flags |= SPT_CONTEXT_NO_CALLBACK_INHERITANCE;
+  else
+    context->flags &= (unsigned) ~SPT_CONTEXT_NO_CALLBACK_INHERITANCE;
+}
+
+void
+spt_context_begin_update(void)
+{
+  context_update_depth++;
+}
+
+void
+spt_context_end_update(spt_context_t* root)
+{
+  assert(context_update_depth > 0);
+  if ( context_update_depth > 0 && --context_update_depth == 0 )
+    spt_context_dispatch_state_changes(root);
+}
+#endif	/* SPT_CONTEXT_ENABLE_CALLBACKS */
+
+uint32_t
+spt_context_sample_seed(void)
+{
+  struct timespec ts;
+  uint64_t x;
+
+  /* Each running thread has its own copy of the state, at its own
+     address; the clock tells apart threads that reuse an address. */
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  x = (uint64_t) (uintptr_t) &spt_context_sample_state
+    ^ ( (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec );
+
+  /* splitmix64 finalizer */
+  x = ( x ^ ( x >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+  x = ( x ^ ( x >> 27 ) ) * 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+
+  /* xorshift never leaves zero, so that can't be a seed. */
+  spt_context_sample_state = (uint32_t) x ? (uint32_t) x : 2463534242U;
+  return spt_context_sample_state;
+}
+
+void
+spt_context_set_sample_rate(spt_context_t* context, double rate)
+{
+  if ( rate > 1.0 )
+    rate = 1.0 / rate;
+
+  if ( ! ( rate > 0.0 ) )
+    {
+      /* Nothing is below a threshold of zero. */
+      context->flags |= SPT_CONTEXT_SAMPLED;
+      context->sample_threshold = 0;
+    }
+  else if ( rate >= 1.0 )
+    {
+      context->flags &= (unsigned) ~SPT_CONTEXT_SAMPLED;
+      context->sample_threshold = 0;
+    }
+  else
+    {
+      /* Round up so that tiny rates still let something through. */
+      double t = rate * 4294967296.0;
+      context->sample_threshold = t < 1.0 ? 1 : (uint32_t) t;
+      context->flags |= SPT_CONTEXT_SAMPLED;
+    }
+}
+
+double
+spt_context_get_sample_rate(const spt_context_t* context)
+{
+  if ( ! ( context->flags & SPT_CONTEXT_SAMPLED ) )
+    return 1.0;
+  return context->sample_threshold / 4294967296.0;
+}
+
+#ifdef SPT_CONTEXT_ENABLE_STATISTICS
+/* ----------------------------------------------------------------
+ * Statistics
+ */
+
+/** Record a written message in a context's counters.
+ *
+ * @internal
+ */
+static __inline__ void
+context_count_message(const spt_context_t* context, mlog_loglevel_t lvl, size_t bytes)
+{
+  /* Counters are logically mutable even through a const context. */
+  spt_context_stats_t* stats = (spt_context_stats_t*) &context->stats;
+  unsigned int i = (unsigned int) lvl < SPT_CONTEXT_STATS_LEVELS ? (unsigned int) lvl : SPT_CONTEXT_STATS_LEVELS - 1;
+
+  __atomic_fetch_add(&stats->messages[i], 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&stats->bytes[i], (uint64_t) bytes, __ATOMIC_RELAXED);
+}
+
+void
+spt_context_get_stats(const spt_context_t* context, spt_context_stats_t* stats)
+{
+  unsigned int i;
+  for ( i = 0; i < SPT_CONTEXT_STATS_LEVELS; i++ )
+    {
+      stats->messages[i] = __atomic_load_n(&context->stats.messages[i], __ATOMIC_RELAXED);
+      stats->bytes[i] = __atomic_load_n(&context->stats.bytes[i], __ATOMIC_RELAXED);
+    }
+}
+
+void
+spt_context_reset_stats(spt_context_t* context)
+{
+  unsigned int i;
+  for ( i = 0; i < SPT_CONTEXT_STATS_LEVELS; i++ )
+    {
+      __atomic_store_n(&context->stats.messages[i], 0, __ATOMIC_RELAXED);
+      __atomic_store_n(&context->stats.bytes[i], 0, __ATOMIC_RELAXED);
+    }
+}
+
+/** Helper for spt_context_reset_stats_recursive. */
+static uint8_t
+_fe_reset_stats(spt_context_t* context,
+		void* udata __attribute__ (( unused )) )
+{
+  spt_context_reset_stats_recursive(context);
+  return 1;
+}
+
+void
+spt_context_reset_stats_recursive(spt_context_t* context)
+{
+  spt_context_reset_stats(context);
+  spt_context_each_child(context, &_fe_reset_stats, NULL);
+}
+
+/** Snapshot of one context's counters, as collected for dumping.
+ * @internal
+ */
+struct stats_entry
+{
+  const spt_context_t* context;
+  spt_context_stats_t stats;
+  uint64_t messages;
+  uint64_t bytes;
+};
+
+/** Accumulator used while collecting stats_entry records.
+ * @internal
+ */
+struct stats_collector
+{
+  struct stats_entry* entries;
+  size_t count;
+};
+
+/** Snapshot a context and (recursively) its children into a
+ *  stats_collector.
+ */
+static uint8_t
+_fe_collect_stats(spt_context_t* context, void* udata)
+{
+  struct stats_collector* c = (struct stats_collector*) udata;
+  struct stats_entry* e = c->entries + c->count++;
+  unsigned int i;
+
+  e->context = context;
+  spt_context_get_stats(context, &e->stats);
+  e->messages = e->bytes = 0;
+  for ( i = 0; i < SPT_CONTEXT_STATS_LEVELS; i++ )
+    {
+      e->messages += e->stats.messages[i];
+      e->bytes += e->stats.bytes[i];
+    }
+
+  spt_context_each_child(context, &_fe_collect_stats, udata);
+  return 1;
+}
+
+/** Ordering for stats_entry records: most bytes, then most messages,
+ *  first.
+ */
+static int
+_stats_entry_compare(const void* a, const void* b)
+{
+  const struct stats_entry
+    *ea = (const struct stats_entry*) a,
+    *eb = (const struct stats_entry*) b;
+  if ( ea->bytes != eb->bytes )
+    return ea->bytes < eb->bytes ? 1 : -1;
+  if ( ea->messages != eb->messages )
+    return ea->messages < eb->messages ? 1 : -1;
+  return 0;
+}
+
+/** Write a string as a JSON string literal.
+ * @internal
+ */
+static void
+_write_json_string(FILE* out, const char* s)
+{
+  fputc('"', out);
+  for ( ; *s; ++s )
+    {
+      if ( *s == '"' || *s == '\\' )
+	fprintf(out, "\\%c", *s);
+      else if ( (unsigned char) *s < 0x20 )
+	fprintf(out, "\\u%04x", (unsigned int) (unsigned char) *s);
+      else
+	fputc(*s, out);
+    }
+  fputc('"', out);
+}
+
+int
+spt_context_dump_stats(const spt_context_t* context, FILE* out,
+		       spt_context_stats_format_t format)
+{
+  static const char* level_names[SPT_CONTEXT_STATS_LEVELS] =
+    { "fatal", "error", "warning", "info", "debug", "trace" };
+  struct stats_collector c;
+  size_t n, i;
+  unsigned int l;
+
+  if ( ! SPT_IS_CONTEXT(context) || ! out )
+    return -1;
+
+  n = spt_context_get_num_ancestors((spt_context_t*) context) + 1;
+  c.entries = (struct stats_entry*) malloc(n * sizeof(struct stats_entry));
+  if ( ! c.entries )
+    return -1;
+  c.count = 0;
+  _fe_collect_stats((spt_context_t*) context, &c);
+  assert(c.count == n);
+
+  qsort(c.entries, n, sizeof(struct stats_entry), &_stats_entry_compare);
+
+  if ( format == SPT_CONTEXT_STATS_JSON )
+    fputc('[', out);
+  else
+    {
+      fprintf(out, "%12s %14s", "messages", "bytes");
+      for ( l = 0; l < SPT_CONTEXT_STATS_LEVELS; l++ )
+	fprintf(out, " %10s", level_names[l]);
+      fprintf(out, "  context\n");
+    }
+
+  for ( i = 0; i < n; i++ )
+    {
+      const struct stats_entry* e = c.entries + i;
+      const char* name = e->context->full_name ? e->context->full_name : e->context->name;
+
+      if ( format == SPT_CONTEXT_STATS_JSON )
+	{
+	  fprintf(out, "%s\n  {\"context\": ", i ? "," : "");
+	  _write_json_string(out, name);
+	  fprintf(out, ", \"messages\": %llu, \"bytes\": %llu, \"levels\": {",
+		  (unsigned long long) e->messages, (unsigned long long) e->bytes);
+	  for ( l = 0; l < SPT_CONTEXT_STATS_LEVELS; l++ )
+	    fprintf(out, "%s\"%s\": {\"messages\": %llu, \"bytes\": %llu}",
+		    l ? ", " : "", level_names[l],
+		    (unsigned long long) e->stats.messages[l],
+		    (unsigned long long) e->stats.bytes[l]);
+	  fprintf(out, "}}");
+	}
+      else
+	{
+	  fprintf(out, "%12llu %14llu",
+		  (unsigned long long) e->messages, (unsigned long long) e->bytes);
+	  for ( l = 0; l < SPT_CONTEXT_STATS_LEVELS; l++ )
+	    fprintf(out, " %10llu", (unsigned long long) e->stats.messages[l]);
+	  fprintf(out, "  %s\n", name);
+	}
+    }
+
+  if ( format == SPT_CONTEXT_STATS_JSON )
+    fprintf(out, "%s]\n", n ? "\n" : "");
+
+  free(c.entries);
+  return (int) n;
+}
+#endif	/* SPT_CONTEXT_ENABLE_STATISTICS */
+
 #include <support/mlog.h>
 
 int
@@ -541,12 +997,33 @@ cmlog_real(const spt_context_t* context, const unsigned long spec, const char* f
 
   va_start(ap, fmt);
 
+#ifdef SPT_CONTEXT_ENABLE_OUTPUT_HANDLERS
+  spt_context_handler_t* handler = spt_context_get_handler(context);
+  if ( handler )
+    {
+      size_t hwritten = 0;
+      r = spt_context_handler_vlog(handler, context, spec, fmt, ap, &hwritten);
+      va_end(ap);
+#ifdef SPT_CONTEXT_ENABLE_STATISTICS
+      if ( r >= 0 )
+	context_count_message(context, lvl, hwritten);
+#endif
+      return r;
+    }
+#endif
+
   ncfmt = asprintf(&cfmt, CMLOG_FORMAT, context->full_name, fmt);
   if ( ncfmt < 0 )
     return -1;
 
 
+#ifdef SPT_CONTEXT_ENABLE_STATISTICS
+  size_t written = 0;
+  r = mlogvn(spec, cfmt, ap, &written);
+  context_count_message(context, lvl, written);
+#else
   r = mlogv(spec, cfmt, ap);
+#endif
   last_full_name = context->full_name;
   free(cfmt);
   return r;
@@ -1,9 +1,13 @@
+/* The consistency checks below must run in optimized builds, too. */
+#undef NDEBUG
 #define _GNU_SOURCE
 #include <mcheck.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <support/spt-context.h>
 #include <support/timeutil.h>
@@ -176,6 +180,301 @@ do_test(const char* spec)
   timeutil_end();
 }
 
+/** Check wildcard and glob matching in compiled parse specs. */
+static void
+test_glob_specs(void)
+{
+  spt_context_t *all, *net, *eth0, *eth0_rx, *eth0_tx, *lo, *lo_rx, *lo_debug, *debug;
+  all = spt_context_create(NULL, "all" CONTEXT_DESCRIPTION("Test hidden context"));
+  all->flags |= SPT_CONTEXT_HIDE_NAME;
+  net = spt_context_create(all, "net" CONTEXT_DESCRIPTION("net"));
+  eth0 = spt_context_create(net, "eth0" CONTEXT_DESCRIPTION("eth0"));
+  eth0_rx = spt_context_create(eth0, "rx" CONTEXT_DESCRIPTION("eth0 rx"));
+  eth0_tx = spt_context_create(eth0, "tx" CONTEXT_DESCRIPTION("eth0 tx"));
+  lo = spt_context_create(net, "lo" CONTEXT_DESCRIPTION("lo"));
+  lo_rx = spt_context_create(lo, "rx" CONTEXT_DESCRIPTION("lo rx"));
+  lo_debug = spt_context_create(lo, "debug" CONTEXT_DESCRIPTION("lo debug"));
+  debug = spt_context_create(all, "debug" CONTEXT_DESCRIPTION("debug"));
+
+  spt_context_parse_spec_t* pspec_list = spt_context_parse_specs("+net.*.rx,+e*.t?,+net.**.debug");
+  spt_context_spec_matcher_t* m = spt_context_compile_parse_specs(pspec_list);
+  assert(m != NULL);
+  spt_context_apply_spec_matcher(all, m);
+  assert(!spt_context_active(net));
+  assert(spt_context_active(eth0_rx));
+  assert(spt_context_active(eth0_tx));
+  assert(spt_context_active(lo_rx));
+  assert(spt_context_active(lo_debug));
+  assert(!spt_context_active(debug));
+
+  /* Later specs override earlier ones; "**" matches zero elements. */
+  spt_context_parse_spec_destroy(pspec_list);
+  spt_context_spec_matcher_destroy(m);
+  pspec_list = spt_context_parse_specs("+net,-**.debug,-**.lo.*,+lo.rx");
+  spt_context_apply_parse_specs(all, pspec_list);
+  assert(spt_context_active(eth0));
+  assert(spt_context_active(lo));
+  assert(spt_context_active(lo_rx));
+  assert(!spt_context_active(lo_debug));
+  assert(!spt_context_active(debug));
+
+  /* Ancestor names count when applying below the root. */
+  spt_context_parse_spec_destroy(pspec_list);
+  pspec_list = spt_context_parse_specs("-net.eth0");
+  spt_context_apply_parse_specs(eth0, pspec_list);
+  assert(!spt_context_active(eth0));
+  assert(spt_context_active(eth0_tx)); /* explicitly enabled above */
+
+  spt_context_parse_spec_destroy(pspec_list);
+  spt_context_destroy_recursive(all);
+}
+
+/** Sampled context that sample_first logs to. */
+static spt_context_t* sample_context;
+
+/** Store a new thread's generator state after its first sampling
+ *  decision.
+ */
+static void*
+sample_first(void* arg)
+{
+  (void) spt_context_sampled(sample_context);
+  *(uint32_t*) arg = spt_context_sample_state;
+  return NULL;
+}
+
+/** Check that sampled contexts log roughly the requested fraction of
+ *  messages, and skip argument evaluation for the rest.
+ */
+static void
+test_sampling(void)
+{
+  spt_context_t *all, *hot, *cold;
+  unsigned int evaluated = 0, i;
+  mlog_loglevel_t level = mlog_get_level();
+  pthread_t threads[2];
+  uint32_t firsts[2];
+
+  all = spt_context_create(NULL, "all" CONTEXT_DESCRIPTION("Test hidden context"));
+  hot = spt_context_create(all, "hot" CONTEXT_DESCRIPTION("Sampled context"));
+  cold = spt_context_create(all, "cold" CONTEXT_DESCRIPTION("Unsampled context"));
+
+  spt_context_parse_spec_t* pspec_list = spt_context_parse_specs("+hot/4,+cold,+bad/0,+bad/x");
+  assert(pspec_list != NULL && pspec_list->next != NULL && pspec_list->next->next == NULL);
+  spt_context_apply_parse_specs(all, pspec_list);
+  spt_context_parse_spec_destroy(pspec_list);
+  assert(spt_context_get_sample_rate(hot) > 0.24 && spt_context_get_sample_rate(hot) < 0.26);
+  assert(spt_context_get_sample_rate(cold) >= 1.0);
+
+  /* Keep the sampled messages themselves quiet. */
+  mlog_set_level(V_ERR);
+  for ( i = 0; i < 10000; i++ )
+    cmlog(hot, V_DEBUG, "%u", ++evaluated);
+  assert(evaluated > 2000 && evaluated < 3000);
+
+  evaluated = 0;
+  for ( i = 0; i < 10000; i++ )
+    cmlog(cold, V_DEBUG, "%u", ++evaluated);
+  assert(evaluated == 10000);
+
+  spt_context_set_sample_rate(hot, 0.0);
+  assert(spt_context_get_sample_rate(hot) <= 0.0);
+  evaluated = 0;
+  for ( i = 0; i < 10000; i++ )
+    cmlog(hot, V_DEBUG, "%u", ++evaluated);
+  assert(evaluated == 0);
+  mlog_set_level(level);
+
+  /* Threads draw their own sequences. */
+  sample_context = hot;
+  assert(pthread_create(&threads[0], NULL, sample_first, &firsts[0]) == 0);
+  assert(pthread_join(threads[0], NULL) == 0);
+  assert(pthread_create(&threads[1], NULL, sample_first, &firsts[1]) == 0);
+  assert(pthread_join(threads[1], NULL) == 0);
+  assert(firsts[0] != firsts[1]);
+
+  spt_context_destroy_recursive(all);
+}
+
+#ifdef SPT_CONTEXT_ENABLE_STATISTICS
+/** Check per-context message and byte counters. */
+static void
+test_stats(void)
+{
+  spt_context_t *all, *noisy, *quiet;
+  spt_context_stats_t stats;
+  unsigned int i;
+
+  all = spt_context_create(NULL, "all" CONTEXT_DESCRIPTION("Test hidden context"));
+  noisy = spt_context_create(all, "noisy" CONTEXT_DESCRIPTION("Noisy context"));
+  quiet = spt_context_create(all, "quiet" CONTEXT_DESCRIPTION("Quiet context"));
+  spt_context_enable(all);
+
+  for ( i = 0; i < 3; i++ )
+    cmlog(noisy, V_DEBUG, "stats test message %u", i);
+  cmlog(noisy, V_WARN, "stats test warning");
+  cmlog(quiet, V_INFO, "stats test info");
+
+  spt_context_get_stats(noisy, &stats);
+  assert(stats.messages[V_DEBUG] == 3);
+  assert(stats.messages[V_WARN] == 1);
+  assert(stats.bytes[V_DEBUG] >= 3 * strlen("[noisy] stats test message 0\n"));
+
+  spt_context_get_stats(quiet, &stats);
+  assert(stats.messages[V_INFO] == 1 && stats.messages[V_DEBUG] == 0);
+
+  assert(spt_context_dump_stats(all, stdout, SPT_CONTEXT_STATS_TABLE) == 3);
+  assert(spt_context_dump_stats(all, stdout, SPT_CONTEXT_STATS_JSON) == 3);
+
+  spt_context_reset_stats_recursive(all);
+  spt_context_get_stats(noisy, &stats);
+  assert(stats.messages[V_DEBUG] == 0 && stats.bytes[V_DEBUG] == 0);
+
+  spt_context_destroy_recursive(all);
+}
+#endif
+
+#ifdef SPT_CONTEXT_ENABLE_OUTPUT_HANDLERS
+/** Check that output handlers are inherited and buffer their output. */
+static void
+test_output_handlers(void)
+{
+  char path[] = "/tmp/cmlog-test-XXXXXX";
+  char buf[256];
+  int fd = mkstemp(path);
+  ssize_t n;
+  spt_context_t *all, *sub, *leaf, *other;
+  spt_context_handler_t* handler;
+
+  assert(fd >= 0);
+  all = spt_context_create(NULL, "all" CONTEXT_DESCRIPTION("Test hidden context"));
+  sub = spt_context_create(all, "sub" CONTEXT_DESCRIPTION("Subsystem"));
+  leaf = spt_context_create(sub, "leaf" CONTEXT_DESCRIPTION("Subsystem child"));
+  other = spt_context_create(all, "other" CONTEXT_DESCRIPTION("Unrelated"));
+  spt_context_enable(all);
+
+  handler = spt_context_handler_create_fd(fd, 4096, 0, 1);
+  assert(handler != NULL);
+  spt_context_set_handler(sub, handler);
+  assert(spt_context_get_handler(leaf) == handler);
+  assert(spt_context_get_handler(other) == NULL);
+
+  cmlog(leaf, V_INFO, "handler test %d", 1);
+  cmlog(sub, V_WARN, "handler test %d", 2);
+  cmlog(other, V_DEBUG, "this goes to stderr");
+
+  /* Nothing written until the buffer is flushed. */
+  assert(lseek(fd, 0, SEEK_END) == 0);
+  assert(spt_context_handler_flush(handler) == 0);
+
+  n = pread(fd, buf, sizeof(buf) - 1, 0);
+  assert(n > 0);
+  buf[n] = '\0';
+  assert(!strcmp(buf, "[I] [all.sub.leaf] handler test 1\n[W] [all.sub] handler test 2\n"));
+
+  spt_context_handler_destroy(handler);
+  unlink(path);
+
+  /* With a flush interval, buffered output is written once it is due
+     even if nothing else is logged. */
+  strcpy(path, "/tmp/cmlog-test-XXXXXX");
+  fd = mkstemp(path);
+  assert(fd >= 0);
+  handler = spt_context_handler_create_fd(fd, 4096, 20, 1);
+  assert(handler != NULL);
+  spt_context_set_handler(sub, handler);
+
+  cmlog(sub, V_INFO, "flushed by timer");
+  for ( n = 0; n < 100 && lseek(fd, 0, SEEK_END) == 0; n++ )
+    usleep(10000);
+  n = pread(fd, buf, sizeof(buf) - 1, 0);
+  assert(n > 0);
+  buf[n] = '\0';
+  assert(!strcmp(buf, "[I] [all.sub] flushed by timer\n"));
+
+  spt_context_handler_destroy(handler);
+  unlink(path);
+  spt_context_destroy_recursive(all);
+}
+#endif
+
+#ifdef SPT_CONTEXT_ENABLE_CALLBACKS
+/** Callback counters for test_callbacks. */
+struct callback_counts
+{
+  unsigned int created, destroyed, changed, last_active;
+};
+
+static void
+count_create(spt_context_t* cxt __attribute__ (( unused )), void* data)
+{
+  ((struct callback_counts*) data)->created++;
+}
+
+static void
+count_destroy(spt_context_t* cxt __attribute__ (( unused )), void* data)
+{
+  ((struct callback_counts*) data)->destroyed++;
+}
+
+static void
+count_state_change(spt_context_t* cxt __attribute__ (( unused )), uint8_t active, void* data)
+{
+  ((struct callback_counts*) data)->changed++;
+  ((struct callback_counts*) data)->last_active = active;
+}
+
+/** Check that state-change callbacks fire once per transition, after
+ *  the reconfiguration is complete.
+ */
+static void
+test_callbacks(void)
+{
+  static const spt_context_callbacks_t callbacks =
+    { &count_create, &count_destroy, &count_state_change, NULL, NULL, NULL, NULL };
+  struct callback_counts outer = { 0, 0, 0, 0 }, inner = { 0, 0, 0, 0 };
+  spt_context_parse_spec_t* pspec_list;
+  spt_context_t *all, *sub, *leaf;
+
+  all = spt_context_create(NULL, "all" CONTEXT_DESCRIPTION("Test hidden context"));
+  sub = spt_context_create(all, "sub" CONTEXT_DESCRIPTION("Subsystem"));
+  spt_context_set_callbacks(all, &callbacks, &outer);
+
+  leaf = spt_context_create(sub, "leaf" CONTEXT_DESCRIPTION("Subsystem child"));
+  assert(outer.created == 1 && outer.changed == 0);
+
+  /* all, sub and leaf all become active. */
+  spt_context_enable(all);
+  assert(outer.changed == 3 && outer.last_active == 1);
+
+  /* No transition, no callback. */
+  spt_context_enable(all);
+  assert(outer.changed == 3);
+
+  /* Switching off and on again within a batch is not a change. */
+  spt_context_begin_update();
+  spt_context_disable(sub);
+  spt_context_reset(sub);
+  spt_context_end_update(all);
+  assert(outer.changed == 3);
+
+  pspec_list = spt_context_parse_specs("-sub.leaf");
+  spt_context_apply_parse_specs(all, pspec_list);
+  spt_context_parse_spec_destroy(pspec_list);
+  assert(outer.changed == 4 && outer.last_active == 0);
+
+  /* leaf no longer sees callbacks set on its ancestors. */
+  spt_context_set_callbacks(leaf, &callbacks, &inner);
+  spt_context_callbacks_set_inheritance(leaf, SPT_CONTEXT_CALLBACKS_NO_INHERITANCE);
+  spt_context_enable(leaf);
+  assert(inner.changed == 1 && inner.last_active == 1);
+  assert(outer.changed == 4);
+
+  spt_context_destroy_recursive(all);
+  assert(outer.destroyed == 2 && inner.destroyed == 1);
+}
+#endif
+
 int main(int argc, char** argv)
 {
   char* s;
@@ -192,6 +491,17 @@ int main(int argc, char** argv)
 
   mtrace();
   mlog_set_level(V_DEBUG);
+  test_glob_specs();
+  test_sampling();
+#ifdef SPT_CONTEXT_ENABLE_STATISTICS
+  test_stats();
+#endif
+#ifdef SPT_CONTEXT_ENABLE_OUTPUT_HANDLERS
+  test_output_handlers();
+#endif
+#ifdef SPT_CONTEXT_ENABLE_CALLBACKS
+  test_callbacks();
+#endif
   do_test(s);
   muntrace();
 
@@ -0,0 +1,441 @@
+#define _GNU_SOURCE
+/* The consistency checks below must run in optimized builds, too. */
+#undef NDEBUG
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <support/matrix.h>
+
+static unsigned int random_state = 12345;
+
+/* Pseudo-random value in [-1, 1). */
+static scalar_t
+random_value(void)
+{
+  random_state = random_state * 1103515245U + 12345U;
+  return (scalar_t) (( random_state >> 8 ) % 2000) / S_LITERAL(1000.0) - S_LITERAL(1.0);
+}
+
+static Matrix*
+random_matrix(const unsigned int rows, const unsigned int cols)
+{
+  unsigned int i, j;
+  Matrix *m = matrix_new(rows, cols);
+
+  for ( i = 0; i < rows; i++ )
+    for ( j = 0; j < cols; j++ )
+      matrix_set(m, i, j, random_value());
+  return m;
+}
+
+static double
+now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+/* Check matrix_mult against a straightforward triple loop, in double
+   precision, allowing for rounding in sums of k products of values
+   below one. */
+static void
+check_mult(Matrix *a, Matrix *b)
+{
+  unsigned int i, j, p;
+  double s, tolerance = 1e-5 * (double) a->cols + 1e-6;
+  Matrix *c = matrix_mult(a, b, NULL);
+
+  for ( i = 0; i < c->rows; i++ )
+    for ( j = 0; j < c->cols; j++ )
+      {
+	s = 0;
+	for ( p = 0; p < a->cols; p++ )
+	  s += (double) matrix_get(a, i, p) * (double) matrix_get(b, p, j);
+	assert(fabs(s - (double) matrix_get(c, i, j)) <= tolerance);
+      }
+  matrix_free(c);
+}
+
+static void
+check(void)
+{
+  static const unsigned int sizes[][3] =
+    { { 1, 1, 1 }, { 3, 3, 3 }, { 7, 5, 9 }, { 33, 40, 31 }, { 65, 129, 70 },
+      { 150, 300, 17 }, { 97, 263, 301 }, { 10, 0, 10 } };
+  unsigned int i;
+  Matrix *a, *b, *big, *va, *vb;
+
+  for ( i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++ )
+    {
+      a = random_matrix(sizes[i][0], sizes[i][1]);
+      b = random_matrix(sizes[i][1], sizes[i][2]);
+      assert(( (size_t) a->values ) % MATRIX_ALIGNMENT == 0);
+      check_mult(a, b);
+      matrix_free(a);
+      matrix_free(b);
+    }
+
+  /* Views have a stride other than their width. */
+  big = random_matrix(300, 300);
+  va = matrix_view(big, 3, 5, 120, 77);
+  vb = matrix_view(big, 100, 1, 77, 201);
+  assert(va->stride == big->stride && &matrix_get(va, 2, 4) == &matrix_get(big, 5, 9));
+  check_mult(va, vb);
+  matrix_free(va);
+  matrix_free(vb);
+  matrix_free(big);
+}
+
+/* Largest difference between an element of a and one of b. */
+static double
+max_difference(Matrix *a, Matrix *b)
+{
+  unsigned int i, j;
+  double d, max = 0;
+
+  for ( i = 0; i < a->rows; i++ )
+    for ( j = 0; j < a->cols; j++ )
+      {
+	d = fabs((double) matrix_get(a, i, j) - (double) matrix_get(b, i, j));
+	if ( d > max )
+	  max = d;
+      }
+  return max;
+}
+
+/* A random matrix that is far from singular. */
+static Matrix*
+well_conditioned_matrix(const unsigned int n)
+{
+  unsigned int i;
+  Matrix *m = random_matrix(n, n);
+
+  for ( i = 0; i < n; i++ )
+    matrix_set(m, i, i, matrix_get(m, i, i) + (scalar_t) n);
+  return m;
+}
+
+static void
+check_lu(void)
+{
+  const unsigned int n = 12;
+  unsigned int i, j;
+  double det = 1;
+  Matrix *l = matrix_new(n, n), *u = matrix_new(n, n), *a, *inv, *id, *b, *x, *ax, *s;
+
+  /* The determinant of L U is the product of the diagonal of U. */
+  for ( i = 0; i < n; i++ )
+    for ( j = 0; j < n; j++ )
+      {
+	if ( j < i )
+	  matrix_set(l, i, j, random_value());
+	else if ( j > i )
+	  matrix_set(u, i, j, random_value());
+      }
+  for ( i = 0; i < n; i++ )
+    {
+      matrix_set(l, i, i, 1);
+      matrix_set(u, i, i, (scalar_t) ( i % 3 + 1 ) * ( i % 2 ? -1 : 1 ));
+      det *= (double) matrix_get(u, i, i);
+    }
+  a = matrix_mult(l, u, NULL);
+  assert(fabs((double) matrix_det(a) - det) <= 1e-3 * fabs(det));
+  matrix_free(a);
+
+  a = random_matrix(3, 3);
+  s = matrix_copy(a);
+  assert(fabs((double) matrix_det(a) - (double) matrix_det_in_place(s)) <= 1e-5);
+  matrix_free(s);
+  matrix_free(a);
+
+  /* Inverse and solve. */
+  a = well_conditioned_matrix(50);
+  inv = matrix_inverse(a, NULL);
+  id = matrix_set_identity(matrix_new(50, 50));
+  x = matrix_mult(a, inv, NULL);
+  assert(max_difference(x, id) <= 1e-5);
+  matrix_inverse(inv, inv);
+  assert(max_difference(inv, a) <= 1e-3);
+
+  b = random_matrix(50, 3);
+  matrix_free(x);
+  x = matrix_solve(a, b, NULL);
+  ax = matrix_mult(a, x, NULL);
+  assert(max_difference(ax, b) <= 1e-5);
+
+  /* Singular matrices. */
+  matrix_set_row(l, 0, 1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0, 8.0, 9.0, 10.0, 11.0, 12.0);
+  matrix_set_row(l, 5, 1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0, 8.0, 9.0, 10.0, 11.0, 12.0);
+  assert(! ( fabs((double) matrix_det(l)) > 0 ));
+  s = random_matrix(n, 3);
+  assert(matrix_inverse(l, NULL) == NULL && matrix_solve(l, s, NULL) == NULL);
+  matrix_free(s);
+
+  matrix_free(l);
+  matrix_free(u);
+  matrix_free(a);
+  matrix_free(inv);
+  matrix_free(id);
+  matrix_free(b);
+  matrix_free(x);
+  matrix_free(ax);
+}
+
+static void
+check_transpose(void)
+{
+  static const unsigned int sizes[][2] =
+    { { 1, 1 }, { 1, 40 }, { 16, 16 }, { 17, 17 }, { 33, 5 }, { 100, 100 }, { 257, 190 } };
+  unsigned int i, r, c;
+  Matrix *a, *t, *big, *view;
+
+  for ( i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++ )
+    {
+      a = random_matrix(sizes[i][0], sizes[i][1]);
+      t = matrix_transpose(a, NULL);
+      for ( r = 0; r < a->rows; r++ )
+	for ( c = 0; c < a->cols; c++ )
+	  assert(S_EQ(matrix_get(t, c, r), matrix_get(a, r, c)));
+
+      if ( MATRIX_IS_SQUARE(a) )
+	{
+	  matrix_transpose(a, a);
+	  assert(matrix_compare(a, t) == 0);
+	}
+      matrix_free(a);
+      matrix_free(t);
+    }
+
+  /* In place, in a view, leaving the rest of the matrix alone. */
+  big = random_matrix(150, 150);
+  a = matrix_copy(big);
+  view = matrix_view(big, 7, 20, 111, 111);
+  matrix_transpose_in_place(view);
+  for ( r = 0; r < big->rows; r++ )
+    for ( c = 0; c < big->cols; c++ )
+      if ( r >= 7 && r < 118 && c >= 20 && c < 131 )
+	assert(S_EQ(matrix_get(big, r, c), matrix_get(a, c - 20 + 7, r - 7 + 20)));
+      else
+	assert(S_EQ(matrix_get(big, r, c), matrix_get(a, r, c)));
+  matrix_free(view);
+  matrix_free(a);
+  matrix_free(big);
+}
+
+/* Run the multiplication checks, and compare sums and transposes with
+   the serial results, with every operation split between threads. */
+static void
+check_parallel(void)
+{
+  static const unsigned int sizes[][2] = { { 1, 1 }, { 3, 200 }, { 200, 3 }, { 257, 131 } };
+  unsigned int i;
+  Matrix *a, *b, *serial, *parallel;
+
+  matrix_set_threads(4);
+  matrix_set_parallel_threshold(1);
+#ifdef SPT_MATRIX_THREADS
+  assert(matrix_get_threads() == 4);
+#endif
+
+  check();
+
+  for ( i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++ )
+    {
+      a = random_matrix(sizes[i][0], sizes[i][1]);
+      b = random_matrix(sizes[i][0], sizes[i][1]);
+
+      matrix_set_threads(1);
+      serial = matrix_add(a, b, NULL);
+      matrix_set_threads(4);
+      parallel = matrix_add(a, b, NULL);
+      assert(matrix_compare(serial, parallel) == 0);
+      matrix_free(serial);
+      matrix_free(parallel);
+
+      matrix_set_threads(1);
+      serial = matrix_transpose(a, NULL);
+      matrix_set_threads(4);
+      parallel = matrix_transpose(a, NULL);
+      assert(matrix_compare(serial, parallel) == 0);
+      matrix_free(serial);
+      matrix_free(parallel);
+
+      matrix_free(a);
+      matrix_free(b);
+    }
+
+  matrix_set_threads(0);
+  matrix_set_parallel_threshold(MATRIX_PARALLEL_THRESHOLD);
+}
+
+static void
+bench_mult(const unsigned int n)
+{
+  Matrix *a = random_matrix(n, n), *b = random_matrix(n, n), *c = matrix_new(n, n);
+  unsigned int reps = 0;
+  double start = now(), elapsed;
+
+  do
+    {
+      matrix_mult(a, b, c);
+      reps++;
+      elapsed = now() - start;
+    }
+  while ( elapsed < 1.0 );
+
+  printf("matrix_mult    %4u x %-4u  %10.3f ms  %7.2f GFLOP/s  (%g)\n", n, n,
+	 elapsed * 1e3 / reps, 2.0 * n * n * n * reps / elapsed * 1e-9,
+	 (double) matrix_get(c, n / 2, n / 3));
+  matrix_free(a);
+  matrix_free(b);
+  matrix_free(c);
+}
+
+static void
+bench_add_transpose(const unsigned int n)
+{
+  Matrix *a = random_matrix(n, n), *b = random_matrix(n, n), *c = matrix_new(n, n);
+  unsigned int reps = 0;
+  double start = now(), elapsed;
+
+  do
+    {
+      matrix_add(a, b, c);
+      reps++;
+      elapsed = now() - start;
+    }
+  while ( elapsed < 0.5 );
+  printf("matrix_add     %4u x %-4u  %10.3f ms\n", n, n, elapsed * 1e3 / reps);
+
+  reps = 0;
+  start = now();
+  do
+    {
+      matrix_transpose(a, c);
+      reps++;
+      elapsed = now() - start;
+    }
+  while ( elapsed < 0.5 );
+  printf("matrix_transpose %4u x %-4u %8.3f ms  (%g)\n", n, n, elapsed * 1e3 / reps,
+	 (double) matrix_get(c, n / 2, n / 3));
+
+  matrix_free(a);
+  matrix_free(b);
+  matrix_free(c);
+}
+
+/* The transpose as matrix_transpose used to compute it. */
+static void
+naive_transpose(Matrix *m, Matrix *dest)
+{
+  unsigned int i, j;
+
+  for ( i = 0; i < m->rows; i++ )
+    for ( j = 0; j < m->cols; j++ )
+      matrix_set(dest, j, i, matrix_get(m, i, j));
+}
+
+/* Bandwidth of the transposes, counting one read and one write of each
+   element. */
+static void
+bench_transpose(const unsigned int n)
+{
+  static const char *names[] = { "naive loop", "matrix_transpose", "in place" };
+  Matrix *a = random_matrix(n, n), *c = matrix_new(n, n);
+  unsigned int reps, k;
+  double start, elapsed;
+
+  for ( k = 0; k < 3; k++ )
+    {
+      reps = 0;
+      start = now();
+      do
+	{
+	  if ( k == 0 )
+	    naive_transpose(a, c);
+	  else if ( k == 1 )
+	    matrix_transpose(a, c);
+	  else
+	    matrix_transpose(a, a);
+	  reps++;
+	  elapsed = now() - start;
+	}
+      while ( elapsed < 1.0 );
+
+      printf("transpose %-16s %5u x %-5u  %9.3f ms  %6.2f GB/s\n", names[k], n, n,
+	     elapsed * 1e3 / reps,
+	     2.0 * n * n * sizeof(scalar_t) * reps / elapsed * 1e-9);
+    }
+
+  matrix_free(a);
+  matrix_free(c);
+}
+
+static void
+bench_lu(const unsigned int n)
+{
+  Matrix *a = well_conditioned_matrix(n), *inv = matrix_new(n, n);
+  unsigned int reps = 0;
+  double start = now(), elapsed, sink = 0;
+
+  do
+    {
+      sink += (double) matrix_det(a);
+      reps++;
+      elapsed = now() - start;
+    }
+  while ( elapsed < 0.5 );
+  printf("matrix_det     %4u x %-4u  %10.3f ms  (%g)\n", n, n, elapsed * 1e3 / reps, sink);
+
+  reps = 0;
+  start = now();
+  do
+    {
+      matrix_inverse(a, inv);
+      reps++;
+      elapsed = now() - start;
+    }
+  while ( elapsed < 0.5 );
+  printf("matrix_inverse %4u x %-4u  %10.3f ms  (%g)\n", n, n, elapsed * 1e3 / reps,
+	 (double) matrix_get(inv, n / 2, n / 3));
+
+  matrix_free(a);
+  matrix_free(inv);
+}
+
+int
+main(int argc, char **argv)
+{
+  unsigned int n = argc > 1 ? (unsigned int) strtoul(argv[1], NULL, 10) : 1024, threads;
+
+  check();
+  check_lu();
+  check_transpose();
+  check_parallel();
+
+  printf("scalar_t = %s\n\n", S_TYPE_STRING);
+  bench_mult(64);
+  bench_mult(256);
+  threads = matrix_get_threads();
+  matrix_set_threads(1);
+  printf("\n1 thread:\n");
+  bench_mult(n);
+  bench_add_transpose(n < 2048 ? 2048 : n);
+  bench_transpose(512);
+  bench_transpose(n < 4096 ? 4096 : n);
+  matrix_set_threads(0);
+  if ( threads > 1 )
+    {
+      printf("\n%u threads:\n", threads);
+      bench_mult(n);
+      bench_add_transpose(n < 2048 ? 2048 : n);
+    }
+  printf("\n");
+  bench_lu(12);
+  bench_lu(256);
+
+  return 0;
+}
@@ -1,6 +1,52 @@
+/* The consistency checks below must run in optimized builds, too. */
+#undef NDEBUG
+#include <cassert>
 #include <iostream>
+#include <type_traits>
 #include <support/matrix.hh>
 
+static_assert(std::is_trivially_copyable< spt::Matrix<4,4> >::value
+	      && sizeof(spt::Matrix<4,4>) == 16 * sizeof(scalar_t),
+	      "4x4 matrices carry more than their values");
+
+static bool
+close_to(scalar_t a, scalar_t b)
+{
+  return S_ABS(a - b) < 1e-4f * ( 1 + S_ABS(a) + S_ABS(b) );
+}
+
+template < unsigned int _R, unsigned int _C >
+static bool
+close_to(const spt::Matrix<_R,_C>& a, const spt::Matrix<_R,_C>& b)
+{
+  for ( unsigned int i ( 0 ); i < _R; i++ )
+    for ( unsigned int j ( 0 ); j < _C; j++ )
+      if ( ! close_to(a.get(i, j), b.get(i, j)) )
+	return false;
+  return true;
+}
+
+/** Check the closed-form inverse of @p m against LU decomposition, by
+ *  way of the (N + 1) x (N + 1) matrix with @p m in its top left.
+ */
+template < unsigned int _N >
+static void
+check_closed_form(const spt::Matrix<_N,_N>& m)
+{
+  spt::Matrix<_N + 1, _N + 1> big ( spt::Matrix<_N + 1, _N + 1>::identity() );
+  for ( unsigned int i ( 0 ); i < _N; i++ )
+    for ( unsigned int j ( 0 ); j < _N; j++ )
+      big.set(i, j, m.get(i, j));
+
+  spt::Matrix<_N,_N> inv ( m.inverse() );
+  spt::Matrix<_N + 1, _N + 1> big_inv ( big.inverse() );
+  assert(close_to(m.determinant(), big.determinant()));
+  for ( unsigned int i ( 0 ); i < _N; i++ )
+    for ( unsigned int j ( 0 ); j < _N; j++ )
+      assert(close_to(inv.get(i, j), big_inv.get(i, j)));
+  assert(close_to(m * inv, spt::Matrix<_N,_N>::identity()));
+}
+
 const scalar_t values1[3][3] =
   {
     { 1, 2, 3 },
@@ -8,15 +54,24 @@ const scalar_t values1[3][3] =
     { 7, 8, 9 }
   };
 
+const scalar_t values2[4][4] =
+  {
+    { 2, 1, 0, 3 },
+    { 0, 0, 4, 1 },
+    { 5, 2, 1, 0 },
+    { 1, 3, 2, 2 }
+  };
+
 
 int
-main ( int argc, char** argv )
+main ( int, char** )
 {
   spt::Matrix<3,3> m(values1);
 
   std::cout << "M:" << std::endl;
   m.print();
   printf("det(M) = %.02f\n", m.determinant());
+  assert(S_ZERO(m.determinant()) && ! m.invert());
 
 
   spt::Matrix<3,3> n(m.transpose());
@@ -25,5 +80,97 @@ main ( int argc, char** argv )
   n.print();
   printf("det(N) = %.02f\n", n.determinant());
 
+
+  spt::Matrix<4,4> p(values2);
+  spt::Matrix<4,4> q(p.inverse());
+
+  std::cout << "P:" << std::endl;
+  p.print();
+  printf("det(P) = %.02f\n", p.determinant());
+  std::cout << "inverse(P):" << std::endl;
+  q.print();
+  assert(S_ABS(p.determinant() + 155) < 1e-3f && S_ABS(q.determinant() * p.determinant() - 1) < 1e-4f);
+
+  /* P x = b, for x = (1, 2, 3, 4). */
+  const scalar_t b[4] = { 16, 16, 12, 21 };
+  scalar_t x[4];
+  p.solve(b, x);
+  for ( unsigned int i ( 0 ); i < 4; i++ )
+    assert(S_ABS(x[i] - static_cast<scalar_t>(i + 1)) < 1e-4f);
+
+  /* Closed forms agree with LU decomposition. */
+  const scalar_t values3[2][2] = { { 3, -2 }, { 1, 4 } };
+  const scalar_t values4[3][3] = { { 2, 1, 0 }, { 0, 4, 1 }, { 5, 2, 1 } };
+  check_closed_form(spt::Matrix<2,2>(values3));
+  check_closed_form(spt::Matrix<3,3>(values4));
+  check_closed_form(p);
+  assert(close_to(p.trace(), 5) && close_to(m.trace(), 15));
+
+  /* Products and transposes. */
+  const scalar_t values5[2][3] = { { 1, 2, 3 }, { 4, 5, 6 } };
+  spt::Matrix<2,3> r(values5);
+  spt::Matrix<3,2> rt(r.transpose());
+  spt::Matrix<2,2> rrt(r * rt);
+  assert(close_to(rt.get(2, 1), 6) && close_to(rrt.get(0, 0), 14) && close_to(rrt.get(0, 1), 32)
+	 && close_to(rrt.get(1, 1), 77));
+
+  /* Blocked transposes, larger than one tile. */
+  spt::Matrix<37,21> wide;
+  for ( unsigned int i ( 0 ); i < 37; i++ )
+    for ( unsigned int j ( 0 ); j < 21; j++ )
+      wide.set(i, j, static_cast<scalar_t>(i * 100 + j));
+  spt::Matrix<21,37> tall(wide.transpose());
+  spt::Matrix<37,37> square;
+  for ( unsigned int i ( 0 ); i < 37; i++ )
+    for ( unsigned int j ( 0 ); j < 37; j++ )
+      square.set(i, j, static_cast<scalar_t>(i * 100 + j));
+  square.transposeInPlace();
+  for ( unsigned int i ( 0 ); i < 37; i++ )
+    for ( unsigned int j ( 0 ); j < 37; j++ )
+      assert(close_to(square.get(j, i), static_cast<scalar_t>(i * 100 + j))
+	     && ( j >= 21 || close_to(tall.get(j, i), wide.get(i, j)) ));
+  rrt.transposeInPlace();
+  assert(close_to(rrt.get(1, 0), 32));
+
+  spt::Vec<4> v ( 1, 2, 3, 4 ), pv ( p * v );
+  assert(close_to(pv[0], b[0]) && close_to(pv[1], b[1]) && close_to(pv[2], b[2]) && close_to(pv[3], b[3]));
+
+  /* Points, one at a time and in batches. */
+  const scalar_t affine[4][4] =
+    {
+      { 0, -1, 0, 10 },
+      { 1, 0, 0, 20 },
+      { 0, 0, 2, 30 },
+      { 0, 0, 0, 1 }
+    };
+  spt::Matrix<4,4> t(affine);
+  spt::Vec<3> point ( t.transformPoint(spt::Vec<3>(1, 2, 3)) );
+  assert(close_to(point[0], 8) && close_to(point[1], 21) && close_to(point[2], 36));
+
+  const unsigned int count ( 37 );
+  spt::VecArray<3> points, moved;
+  spt::VecArray<4> vectors, products;
+  spt::Vec<3> aos[count];
+  for ( unsigned int i ( 0 ); i < count; i++ )
+    {
+      scalar_t x ( static_cast<scalar_t>(i) );
+      aos[i] = spt::Vec<3>(x, 2 * x, -x);
+      points.push_back(aos[i]);
+      vectors.push_back(spt::Vec<4>(x, 1, 0, -x));
+    }
+  t.transformPoints(points, moved);
+  t.transformPoints(aos, aos, count);
+  p.transform(vectors, products);
+  for ( unsigned int i ( 0 ); i < count; i++ )
+    {
+      const spt::Vec<3> expected ( t.transformPoint(spt::Vec<3>(points[i])) ), batch = moved[i];
+      const spt::Vec<4> product = products[i];
+      for ( unsigned int k ( 0 ); k < 3; k++ )
+	assert(close_to(batch[k], expected[k]) && close_to(aos[i][k], expected[k]));
+      const spt::Vec<4> pvi ( p * spt::Vec<4>(vectors[i]) );
+      for ( unsigned int k ( 0 ); k < 4; k++ )
+	assert(close_to(product[k], pvi[k]));
+    }
+
   return 0;
 }
@@ -0,0 +1,633 @@
+/* The consistency checks below must run in optimized builds, too. */
+#undef NDEBUG
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <clocale>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <system_error>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#include <support/Rope.hh>
+#include <support/String.hh>
+#include <support/StringArena.hh>
+#include <support/StringBuilder.hh>
+#include <support/StringIntern.hh>
+#include <support/readFileIntoString.hh>
+
+/* Count heap allocations by interposing on the C allocator; operator
+   new ends up here too.  */
+extern "C"
+{
+  extern void* __libc_malloc(size_t);
+  extern void* __libc_calloc(size_t, size_t);
+  extern void* __libc_realloc(void*, size_t);
+
+  static unsigned long int allocations = 0;
+
+  void* malloc(size_t n) { ++allocations; return __libc_malloc(n); }
+  void* calloc(size_t n, size_t s) { ++allocations; return __libc_calloc(n, s); }
+  void* realloc(void* p, size_t n) { ++allocations; return __libc_realloc(p, n); }
+}
+
+static const char* short_words[] =
+  { "eth0", "rx", "debug", "context", "spt::String", "twenty-two characters" };
+static const char* long_words[] =
+  { "a string that is comfortably past the inline limit",
+    "another string that will need a separately allocated buffer" };
+
+#define N_ELEMENTS(a) ( sizeof(a) / sizeof(a[0]) )
+
+/** Run @p fn @p iterations times and print throughput and allocations
+ *  per iteration.
+ */
+template < typename _Fn >
+static void
+bench(const char* label, unsigned long int iterations, _Fn fn)
+{
+  unsigned long int start_allocations ( allocations );
+  auto start ( std::chrono::steady_clock::now() );
+  size_t sink ( 0 );
+
+  for ( unsigned long int i ( 0 ); i < iterations; ++i )
+    sink += fn(i);
+
+  auto end ( std::chrono::steady_clock::now() );
+  double ns ( std::chrono::duration<double, std::nano>(end - start).count() );
+
+  printf("%-40s %8.1f ns/op %6.2f allocs/op  (%zu)\n", label,
+	 ns / static_cast<double>(iterations),
+	 static_cast<double>(allocations - start_allocations) / static_cast<double>(iterations),
+	 sink);
+}
+
+/** Basic checks of the inline representation. */
+static void
+check_inline()
+{
+  spt::String a ( "short" ), b ( a ), c ( long_words[0] );
+  assert(a.isInline() && b.isInline() && ! c.isInline());
+  assert(a.data() != b.data() && a == b);
+
+  spt::String sub ( a.substring(1, 4) );
+  assert(sub == "hor" && sub.isSubstringOf(a));
+  assert(a.getSubstringRange(sub) == spt::String::range_type(1, 4));
+  assert(sub.withFullRange() == "short");
+
+  a += "-ish";
+  assert(a == "short-ish" && a.isInline());
+  a += spt::String(long_words[1]);
+  assert(! a.isInline() && a.length() == 9 + strlen(long_words[1]));
+
+  spt::String empty;
+  assert(! empty.data() && empty == spt::String());
+  assert(spt::String::copy_of(short_words[5]).isInline());
+  assert(c.substring(2, 8) == "string");
+}
+
+/** Basic checks of interning. */
+static void
+check_intern()
+{
+  spt::StringInternTable table ( spt::StringInternTable::ARENA );
+  const spt::String a ( table.intern("field_name") ), b ( table.intern(spt::String::copy_of("field_name")) );
+  assert(a.isInterned() && b.isInterned() && a.data() == b.data() && a == b);
+  assert(table.intern(long_words[0]) != a && table.size() == 2);
+  assert(! a.substring(0, 5).isInterned() && a.substring(0, 5) == "field");
+
+  /* Appending copies rather than modifying the canonical value. */
+  spt::String c ( a );
+  c += "_2";
+  assert(c == "field_name_2" && a == "field_name" && ! c.isInterned());
+
+  for ( unsigned int i ( 0 ); i < 1000; ++i )
+    {
+      char buf[32];
+      snprintf(buf, sizeof(buf), "name-%u", i);
+      table.intern(buf);
+    }
+  assert(table.size() == 1002 && table.intern("name-500") == spt::intern("name-500"));
+
+  /* Each table has its own canonical copy. */
+  spt::StringInternTable other;
+  const spt::String d ( other.intern(a) );
+  assert(d.isInternedIn(other) && ! d.isInternedIn(table) && a.isInternedIn(table));
+  const spt::String again ( other.intern(d) ), back ( table.intern(d) );
+  assert(d.data() != a.data() && d == a);
+  assert(again.data() == d.data() && back.data() == a.data());
+
+  /* Strings that outlive their table are no longer interned, and still
+     compare equal to values interned in a table at the same address. */
+  spt::String survivor;
+  {
+    spt::StringInternTable scoped;
+    survivor = scoped.intern("survivor");
+  }
+  assert(! survivor.isInterned() && survivor == "survivor");
+  {
+    spt::StringInternTable scoped;
+    assert(scoped.intern("survivor") == survivor && survivor == scoped.intern("survivor"));
+  }
+}
+
+/** Collect the tokens of a split as std::strings. */
+static std::vector<std::string>
+tokens(const spt::String::SplitRange& r)
+{
+  std::vector<std::string> out;
+  for ( const spt::String::Token& t : r )
+    out.push_back(std::string(t.data(), t.length()));
+  return out;
+}
+
+/** Basic checks of split, split_any and lines. */
+static void
+check_split()
+{
+  typedef std::vector<std::string> v;
+  spt::String csv ( spt::String::copy_of("id,name,,value,") );
+
+  assert(tokens(csv.split(',')) == v({ "id", "name", "", "value", "" }));
+  assert(tokens(spt::String("abc").split(',')) == v({ "abc" }));
+  assert(tokens(spt::String().split(',')).empty());
+  assert(tokens(spt::String::copy_of("  a \t bb\tc  ").split_any(" \t")) == v({ "a", "bb", "c" }));
+  assert(tokens(spt::String::copy_of(" \t ").split_any(" \t")).empty());
+  assert(tokens(spt::String::copy_of("one\r\ntwo\n\nthree\n").lines()) == v({ "one", "two", "", "three" }));
+
+  /* Tokens of a substring stay within it, and map back to it. */
+  spt::String sub ( csv.substring(3, 13) );	/* "name,,valu" */
+  assert(tokens(sub.split(',')) == v({ "name", "", "valu" }));
+  for ( const spt::String::Token& t : sub.split(',') )
+    assert(t.string() == sub.substring(t.range()) && t.string().isSubstringOf(sub));
+
+  spt::String::SplitRange r ( csv.split(',') );
+  assert(*++r.begin() == "name" && std::distance(r.begin(), r.end()) == 5);
+}
+
+/** Basic checks of appending, StringBuilder and Rope. */
+static void
+check_concat()
+{
+  spt::String s ( spt::String::copy_of(long_words[0]) ), copy ( s );
+  s += "!";
+  s += s;
+  assert(s.length() == 2 * ( strlen(long_words[0]) + 1 ) && s.find("!a string") != spt::String::npos);
+  assert(copy == long_words[0]);
+
+  /* Appending to a String that shares its whole buffer with another
+     must leave the other's buffer alone. */
+  const std::string fifty ( 50, 'a' ), sixty ( 60, 'b' );
+  spt::String whole ( spt::String::copy_of(fifty.c_str()) );
+  const spt::String sharer ( whole );
+  const char* shared ( sharer.data() );
+  whole += sixty.c_str();
+  assert(sharer.data() == shared && sharer == fifty.c_str() && whole == ( fifty + sixty ).c_str());
+
+  /* Writing through data() copies a shared buffer first. */
+  spt::String writer ( sharer );
+  writer.data()[0] = 'z';
+  assert(sharer.data() == shared && sharer == fifty.c_str() && writer[0] == 'z'
+	 && writer.data() != shared);
+
+  /* Likewise for Rope leaves, which share data with the appended
+     Strings. */
+  spt::Rope leaves;
+  leaves += sharer;
+  leaves += spt::String(sixty.c_str());
+  assert(sharer.data() == shared && sharer == fifty.c_str()
+	 && leaves.flatten() == ( fifty + sixty ).c_str());
+
+  spt::StringBuilder b;
+  b << "short";
+  spt::String shorter ( b.str() );
+  assert(shorter == "short" && shorter.isInline() && b.empty() && b.capacity() > 0);
+
+  for ( unsigned int i ( 0 ); i < 100; ++i )
+    b << short_words[i % N_ELEMENTS(short_words)] << ' ';
+  const char* buffer ( b.data() );
+  size_t length ( b.length() );
+  spt::String built ( b.str() );
+  assert(built.data() == buffer && built.length() == length && b.capacity() == 0);
+  assert(built.data()[built.length()] == '\0' && built.find("eth0 rx debug") == 0);
+
+  spt::Rope r;
+  std::string expected;
+  for ( unsigned int i ( 0 ); i < 5000; ++i )
+    {
+      const char* w ( i % 7 == 0 ? long_words[i % 2] : short_words[i % N_ELEMENTS(short_words)] );
+      r += spt::String(w);
+      expected += w;
+    }
+  spt::Rope r2 ( r + r );
+  expected += expected;
+  assert(r2.length() == expected.size() && r2.depth() <= spt::Rope::max_depth);
+  for ( size_t i ( 0 ); i < expected.size(); i += 97 )
+    assert(r2[i] == expected[i]);
+  const spt::String flat ( r2.flatten() ), again ( r2.flatten() );
+  assert(flat == expected.c_str() && r2.depth() == 0 && again.data() == flat.data());
+  assert(r.length() * 2 == r2.length());
+}
+
+/** Basic checks of compare and collate. */
+static void
+check_compare()
+{
+  spt::String a ( "apple" ), b ( spt::String::copy_of(long_words[0]) ), c ( b.substring(0, 8) );
+  assert(a.compare(a) == 0 && a.compare(spt::String("apple")) == 0);
+  assert(a < spt::String("apples") && spt::String("apples") > a && a < spt::String("b"));
+  assert(spt::String() < a && spt::String().compare(spt::String("")) == 0);
+  assert(c == "a string" && c < b && b.compare(c) > 0 && c.compare(spt::String("a string")) == 0);
+  /* Byte order: unsigned, and upper case before lower case. */
+  assert(spt::String("Zebra") < spt::String("apple") && spt::String("z") < spt::String("\xe9"));
+
+  assert(a.collate(spt::String("apple")) == 0 && c.collate(b) < 0 && b.collate(c) > 0);
+  spt::String long_c ( b + b + b + b + b + b );
+  assert(long_c.substring(0, 300).collate(long_c.substring(0, 299)) > 0);
+  assert(spt::String::collate_less()(a, spt::String("banana")));
+}
+
+/** Write @p text to a new temporary file and return its path. */
+static std::string
+temp_file(const std::string& text)
+{
+  char path[] = "/tmp/string-bench-XXXXXX";
+  int fd ( mkstemp(path) );
+  assert(fd >= 0);
+  assert(write(fd, text.data(), text.size()) == static_cast<ssize_t>(text.size()));
+  close(fd);
+  return path;
+}
+
+/** Basic checks of map_file. */
+static void
+check_map_file()
+{
+  std::string path ( temp_file("first line\nsecond line\n") );
+  {
+    spt::String s ( spt::String::map_file(path.c_str()) ), sub ( s.substring(6, 10) );
+    assert(s.length() == 23 && sub == "line" && ! s.isInline());
+
+    /* Private mapping: writes are not carried through to the file. */
+    s.data()[0] = 'F';
+    assert(s.substring(0, 5) == "First" && sub == "line");
+
+    spt::String grown ( s );
+    grown += "third line\n";
+    assert(grown.length() == 34 && s.length() == 23 && grown.substring(0, 5) == "First");
+  }
+  assert(spt::String::map_file(path.c_str()).substring(0, 5) == "first");
+  unlink(path.c_str());
+
+  std::string empty ( temp_file("") );
+  assert(spt::String::map_file(empty.c_str()).length() == 0);
+  unlink(empty.c_str());
+
+  bool threw ( false );
+  try { spt::String::map_file("/nonexistent/file"); }
+  catch ( const std::system_error& e ) { threw = e.code().value() == ENOENT; }
+  assert(threw);
+}
+
+/** Simulated request handling: copy the fields of a header-like
+ *  buffer out as Strings, and build a response from them.
+ */
+static size_t
+handle_request(const spt::String& request)
+{
+  /* Reused, so the only allocations are the Strings' own. */
+  static std::vector<spt::String> fields;
+  fields.clear();
+  for ( const spt::String::Token& line : request.lines() )
+    fields.push_back(spt::String::copy_of(line.data(), line.length()));
+
+  spt::String response ( "HTTP/1.1 200 OK" );
+  for ( const spt::String& f : fields )
+    {
+      response += "\r\nX-Echo: ";
+      response += f;
+    }
+  fields.clear();
+  return response.length();
+}
+
+/** Basic checks of arena-allocated Strings. */
+static void
+check_arena()
+{
+  spt::Arena arena;
+  spt::String interned, heap ( spt::String::copy_of(long_words[0]) );
+
+  for ( int pass ( 0 ); pass < 2; ++pass )
+    {
+      unsigned long int start_allocations ( allocations );
+      {
+	spt::StringArenaScope scope ( &arena );
+	spt::String a ( spt::String::copy_of(long_words[0]) ), b ( a ), c ( heap );
+	a += long_words[1];
+	a += a;
+	c += "!";
+	assert(a.length() == 2 * ( strlen(long_words[0]) + strlen(long_words[1]) ) && b == long_words[0]);
+	assert(c.length() == heap.length() + 1 && heap == long_words[0]);
+	assert(arena.bytesAllocated() > 0);
+	if ( pass == 1 )
+	  /* Everything above came from the arena reset last time. */
+	  assert(allocations == start_allocations);
+	else
+	  interned = spt::intern(long_words[1]);
+      }
+      arena.reset();
+      assert(arena.bytesAllocated() == 0);
+    }
+  /* Interned values don't use the request arena. */
+  assert(interned == long_words[1] && interned.isInterned());
+}
+
+/** Basic checks of hashing. */
+static void
+check_hash()
+{
+  std::hash<spt::String> h;
+  spt::String a ( long_words[0] ), b ( spt::String::copy_of(long_words[0]) );
+  spt::String c ( spt::String::copy_of("xx a string that is comfortably past the inline limit") );
+  c = c.substring(3, c.length());
+  assert(h(a) == h(b) && h(a) == h(c) && h(a) == h(spt::intern(long_words[0])));
+  assert(h(spt::String("short")) == h(spt::String::copy_of("a short").substring(2, 7)));
+  assert(h(a) != h(spt::String(long_words[1])) && h(spt::String()) == h(spt::String("")));
+
+  /* The cached value follows modifications. */
+  size_t before ( h(b) );
+  b.data()[0] = 'A';
+  assert(h(b) != before && h(b) == h(spt::String::copy_of(b.data(), b.length())));
+  b.data()[0] = 'a';
+  assert(h(b) == before);
+  b += "!";
+  assert(h(b) == spt::hash_chars(b.data(), b.length()) && h(b) != before);
+
+  /* Every length through the 16- and 48-byte paths, and all
+     single-byte changes, should give distinct values. */
+  std::string text ( long_words[1] );
+  text += long_words[0];
+  std::vector<size_t> seen;
+  for ( size_t n ( 0 ); n <= text.size(); ++n )
+    seen.push_back(spt::hash_chars(text.data(), n));
+  for ( size_t i ( 0 ); i < 64; ++i )
+    {
+      std::string t ( text );
+      t[i] ^= 1;
+      seen.push_back(spt::hash_chars(t.data(), t.size()));
+    }
+  std::sort(seen.begin(), seen.end());
+  assert(std::unique(seen.begin(), seen.end()) == seen.end());
+}
+
+int
+main(int argc, char** argv)
+{
+  unsigned long int iterations ( argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000UL );
+
+  check_inline();
+  check_intern();
+  check_split();
+  check_concat();
+  check_compare();
+  check_map_file();
+  check_arena();
+  check_hash();
+  printf("sizeof(spt::String) = %zu, inline capacity = %zu\n\n",
+	 sizeof(spt::String), static_cast<size_t>(spt::String::inline_capacity));
+
+  bench("String(const char*), short", iterations,
+	[](unsigned long int i) { spt::String s ( short_words[i % N_ELEMENTS(short_words)] ); return s.length(); });
+  bench("String(const char*), long", iterations,
+	[](unsigned long int i) { spt::String s ( long_words[i % N_ELEMENTS(long_words)] ); return s.length(); });
+  bench("String::copy_of, short", iterations,
+	[](unsigned long int i) { return spt::String::copy_of(short_words[i % N_ELEMENTS(short_words)]).length(); });
+  bench("String::copy_of, long", iterations,
+	[](unsigned long int i) { return spt::String::copy_of(long_words[i % N_ELEMENTS(long_words)]).length(); });
+  bench("String::take_ownership (always shared)", iterations,
+	[](unsigned long int i) { return spt::String::take_ownership(strdup(short_words[i % N_ELEMENTS(short_words)])).length(); });
+  bench("std::string, short", iterations,
+	[](unsigned long int i) { std::string s ( short_words[i % N_ELEMENTS(short_words)] ); return s.length(); });
+
+  std::vector<spt::String> v;
+  v.reserve(64);
+  bench("copy 64 short Strings", iterations / 64,
+	[&v](unsigned long int) {
+	  spt::String s ( "copy me" );
+	  v.clear();
+	  for ( int j ( 0 ); j < 64; ++j )
+	    v.push_back(s);
+	  return v.size();
+	});
+  bench("short + short", iterations,
+	[](unsigned long int i) {
+	  spt::String a ( short_words[i % 3] ), b ( short_words[(i + 1) % 3] );
+	  return (a + b).length();
+	});
+  bench("short += short", iterations,
+	[](unsigned long int i) {
+	  spt::String a ( short_words[i % 3] );
+	  a += short_words[(i + 1) % 3];
+	  return a.length();
+	});
+
+  spt::String long_a ( spt::String::copy_of(long_words[1]) ), long_b ( spt::String::copy_of(long_words[1]) );
+  bench("== on equal long Strings", iterations,
+	[&](unsigned long int) { return static_cast<size_t>(long_a == long_b); });
+  spt::String interned_a ( spt::intern(long_a) ), interned_b ( spt::intern(long_b) );
+  bench("== on equal interned Strings", iterations,
+	[&](unsigned long int) { return static_cast<size_t>(interned_a == interned_b); });
+  bench("spt::intern, existing value", iterations,
+	[](unsigned long int i) { return spt::intern(short_words[i % N_ELEMENTS(short_words)]).length(); });
+
+  /* Tokenizing a CSV-like buffer: repeated find + substring vs. split. */
+  std::string csv_text;
+  for ( unsigned int i ( 0 ); i < 2000; ++i )
+    csv_text += "1402,some field value,another one,3.14159,ok\n";
+  spt::String csv ( spt::String::copy_of(csv_text.c_str(), csv_text.size()) );
+  unsigned long int csv_iterations ( iterations / 50000 + 1 );
+
+  bench("CSV fields, find + substring", csv_iterations,
+	[&csv](unsigned long int) {
+	  size_t n ( 0 ), start ( 0 ), end;
+	  while ( ( end = csv.find_first_of(",\n", start, csv.length()) ) != spt::String::npos )
+	    {
+	      n += csv.substring(start, end).length();
+	      start = end + 1;
+	    }
+	  return n;
+	});
+  bench("CSV fields, lines + split", csv_iterations,
+	[&csv](unsigned long int) {
+	  size_t n ( 0 );
+	  for ( const spt::String::Token& line : csv.lines() )
+	    for ( const spt::String::Token& field : line.string().split(',') )
+	      n += field.length();
+	  return n;
+	});
+  bench("CSV fields, split_any", csv_iterations,
+	[&csv](unsigned long int) {
+	  size_t n ( 0 );
+	  for ( const spt::String::Token& field : csv.split_any(",\n") )
+	    n += field.length();
+	  return n;
+	});
+
+  /* Building a 64 KiB String from short pieces. */
+  unsigned long int concat_iterations ( iterations / 5000 + 1 );
+  bench("String += , 8192 pieces", concat_iterations,
+	[](unsigned long int) {
+	  spt::String s;
+	  for ( unsigned int j ( 0 ); j < 8192; ++j )
+	    s += "eight ch";
+	  return s.length();
+	});
+  bench("StringBuilder, 8192 pieces", concat_iterations,
+	[](unsigned long int) {
+	  spt::StringBuilder b;
+	  for ( unsigned int j ( 0 ); j < 8192; ++j )
+	    b.append("eight ch", 8);
+	  return b.str().length();
+	});
+  bench("StringBuilder + reserve, 8192 pieces", concat_iterations,
+	[](unsigned long int) {
+	  spt::StringBuilder b ( 8192 * 8 );
+	  for ( unsigned int j ( 0 ); j < 8192; ++j )
+	    b.append("eight ch", 8);
+	  return b.str().length();
+	});
+  bench("Rope + flatten, 8192 pieces", concat_iterations,
+	[](unsigned long int) {
+	  spt::Rope r;
+	  spt::String piece ( "eight ch" );
+	  for ( unsigned int j ( 0 ); j < 8192; ++j )
+	    r += piece;
+	  return r.flatten().length();
+	});
+  /* Assembling 16 MiB from 1024 shared 16 KiB pieces. */
+  spt::String big_piece ( 16384, 'x' );
+  bench("String +=, 1024 x 16 KiB", concat_iterations / 16 + 1,
+	[&big_piece](unsigned long int) {
+	  spt::String s;
+	  for ( unsigned int j ( 0 ); j < 1024; ++j )
+	    s += big_piece;
+	  return s.length();
+	});
+  bench("Rope, 1024 x 16 KiB", concat_iterations / 16 + 1,
+	[&big_piece](unsigned long int) {
+	  spt::Rope r;
+	  for ( unsigned int j ( 0 ); j < 1024; ++j )
+	    r += big_piece;
+	  return r.length();
+	});
+  /* Lookups in a 4096-entry map, repeating the same key objects. */
+  std::unordered_map<spt::String, size_t> string_map;
+  std::unordered_map<std::string, size_t> std_map;
+  std::vector<spt::String> keys;
+  std::vector<std::string> std_keys;
+  for ( unsigned int i ( 0 ); i < 4096; ++i )
+    {
+      char buf[64];
+      snprintf(buf, sizeof(buf), "metrics.interface.eth%u.rx_bytes_per_second", i);
+      keys.push_back(spt::String::copy_of(buf));
+      std_keys.push_back(buf);
+      string_map[keys.back()] = i;
+      std_map[std_keys.back()] = i;
+    }
+  bench("unordered_map<String> lookup", iterations,
+	[&](unsigned long int i) { return string_map.find(keys[i % keys.size()])->second; });
+  bench("unordered_map<std::string> lookup", iterations,
+	[&](unsigned long int i) { return std_map.find(std_keys[i % std_keys.size()])->second; });
+
+  /* Request-scoped Strings, on the heap and in a reset arena. */
+  std::string request_text;
+  for ( unsigned int i ( 0 ); i < 32; ++i )
+    request_text += "X-Request-Header-Field: some moderately long header value\r\n";
+  spt::String request ( spt::String::copy_of(request_text.c_str(), request_text.size()) );
+  bench("request, heap Strings", iterations / 100 + 1,
+	[&request](unsigned long int) { return handle_request(request); });
+  spt::Arena request_arena;
+  bench("request, arena Strings", iterations / 100 + 1,
+	[&](unsigned long int) {
+	  size_t n;
+	  {
+	    spt::StringArenaScope scope ( &request_arena );
+	    n = handle_request(request);
+	  }
+	  request_arena.reset();
+	  return n;
+	});
+
+  /* Counting the lines of a 16 MiB file. */
+  std::string file_text;
+  while ( file_text.size() < ( 16U << 20 ) )
+    file_text += csv_text;
+  std::string file_path ( temp_file(file_text) );
+  bench("readFileIntoString + lines, 16 MiB", csv_iterations,
+	[&file_path](unsigned long int) {
+	  std::pair<char*,size_t> contents ( spt::readFileIntoString(file_path.c_str()) );
+	  spt::String s ( spt::String::take_ownership(contents.first, contents.second) );
+	  size_t n ( 0 );
+	  for ( const spt::String::Token& line : s.lines() )
+	    n += line.empty() ? 0 : 1;
+	  return n;
+	});
+  bench("String::map_file + lines, 16 MiB", csv_iterations,
+	[&file_path](unsigned long int) {
+	  spt::String s ( spt::String::map_file(file_path.c_str()) );
+	  size_t n ( 0 );
+	  for ( const spt::String::Token& line : s.lines() )
+	    n += line.empty() ? 0 : 1;
+	  return n;
+	});
+  unlink(file_path.c_str());
+
+  /* Sorting field-name-like Strings, long enough to be heap-stored. */
+  std::vector<spt::String> unsorted;
+  unsigned int state ( 12345 );
+  for ( unsigned long int i ( 0 ); i < ( iterations < 1000000UL ? iterations : 1000000UL ); ++i )
+    {
+      char buf[48];
+      state = state * 1103515245U + 12345U;
+      snprintf(buf, sizeof(buf), "metrics.interface.eth%u.counter_%08x", state % 16, state);
+      unsorted.push_back(spt::String::copy_of(buf));
+    }
+  std::vector<spt::String> sorted;
+  bench("sort, byte order (operator <)", 1,
+	[&](unsigned long int) {
+	  sorted = unsorted;
+	  std::sort(sorted.begin(), sorted.end());
+	  return sorted.size();
+	});
+  setlocale(LC_COLLATE, "");
+  bench("sort, String::collate_less", 1,
+	[&](unsigned long int) {
+	  sorted = unsorted;
+	  std::sort(sorted.begin(), sorted.end(), spt::String::collate_less());
+	  return sorted.size();
+	});
+  bench("sort, std::string", 1,
+	[&](unsigned long int) {
+	  std::vector<std::string> v;
+	  for ( const spt::String& x : unsorted )
+	    v.push_back(std::string(x.data(), x.length()));
+	  std::sort(v.begin(), v.end());
+	  return v.size();
+	});
+
+  bench("std::string +=, 8192 pieces", concat_iterations,
+	[](unsigned long int) {
+	  std::string s;
+	  for ( unsigned int j ( 0 ); j < 8192; ++j )
+	    s += "eight ch";
+	  return s.length();
+	});
+
+  return 0;
+}
@@ -0,0 +1,166 @@
+/* The consistency checks below must run in optimized builds, too. */
+#undef NDEBUG
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <support/String.hh>
+#include <support/StringHash.hh>
+#include <support/StringSearch.hh>
+
+static const char* isa_names[] = { "scalar", "sse2", "avx2" };
+static const spt::StringSearchISA isas[] =
+  { spt::STRING_SEARCH_SCALAR, spt::STRING_SEARCH_SSE2, spt::STRING_SEARCH_AVX2 };
+
+#define N_ELEMENTS(a) ( sizeof(a) / sizeof(a[0]) )
+
+/** Fill @p buf with lowercase letters and spaces from a fixed seed. */
+static void
+fill_text(std::vector<char>& buf)
+{
+  unsigned int state ( 12345 );
+  for ( char& c : buf )
+    {
+      state = state * 1103515245U + 12345U;
+      unsigned int r ( ( state >> 16 ) % 27 );
+      c = r == 26 ? ' ' : static_cast<char>('a' + r);
+    }
+}
+
+/** Check every kernel at every ISA against the scalar kernels, over
+ *  many offsets and lengths (to exercise the unaligned heads and
+ *  partial tails).
+ */
+static void
+check_kernels(const std::vector<char>& text)
+{
+  static const char* needles[] = { "q", "zz", "abc", "xyzzy", "a string that is not there" };
+
+  for ( size_t k ( 1 ); k < N_ELEMENTS(isas); ++k )
+    {
+      if ( ! spt::string_search_set_isa(isas[k]) )
+	continue;
+
+      for ( size_t off ( 0 ); off < 64; off += 7 )
+	for ( size_t n ( 0 ); n < 300 && off + n <= text.size(); n += 13 )
+	  {
+	    const char* s ( text.data() + off );
+	    for ( char c : { 'a', 'q', ' ', '!' } )
+	      {
+		const char *f ( spt::find_byte(s, n, c) ), *rf ( spt::rfind_byte(s, n, c) );
+		size_t cnt ( spt::count_byte(s, n, c) );
+		const char* ff ( spt::find_first_of(s, n, "xyz ", 4) );
+		const char* fl ( spt::find_last_of(s, n, "abc", 3, true) );
+		spt::string_search_set_isa(spt::STRING_SEARCH_SCALAR);
+		assert(f == spt::find_byte(s, n, c));
+		assert(rf == spt::rfind_byte(s, n, c));
+		assert(cnt == spt::count_byte(s, n, c));
+		assert(ff == spt::find_first_of(s, n, "xyz ", 4));
+		assert(fl == spt::find_last_of(s, n, "abc", 3, true));
+		spt::string_search_set_isa(isas[k]);
+	      }
+	    for ( const char* needle : needles )
+	      {
+		size_t m ( strlen(needle) );
+		const char* found ( spt::find_substring(s, n, needle, m) );
+		assert(found == static_cast<const char*>(memmem(s, n, needle, m)));
+	      }
+	  }
+
+      /* Counts past the 255-iteration flush interval. */
+      std::vector<char> same ( 100000, 'x' );
+      assert(spt::count_byte(same.data(), same.size(), 'x') == same.size());
+    }
+}
+
+/** Check that String's search methods respect its range. */
+static void
+check_string()
+{
+  spt::String s ( spt::String::copy_of("  the quick brown fox jumps over the lazy dog  ") );
+  spt::String sub ( s.substring(6, 20) );   /* "quick brown fo" */
+
+  assert(sub.find('q') == 0 && sub.find('x') == spt::String::npos);
+  assert(sub.rfind('o') == 13 && sub.count('o') == 2);
+  assert(sub.find("brown") == 6 && sub.find("fox") == spt::String::npos);
+  assert(sub.find_first_of("wn") == 9);
+  assert(sub.find_element('o', 10, 14) == 13);
+  assert(s.count("the") == 2);
+  assert(s.trim(" ") == "the quick brown fox jumps over the lazy dog");
+  assert(s.trim(" ", "gdo ") == "the quick brown fox jumps over the lazy");
+  assert(spt::String::copy_of("    ").trim(" ").length() == 0);
+}
+
+/** Time @p reps calls of @p fn and print nanoseconds per call and
+ *  throughput.
+ */
+template < typename _Fn >
+static void
+bench(const char* label, const char* isa, size_t bytes, unsigned long int reps, _Fn fn)
+{
+  size_t sink ( 0 );
+  auto start ( std::chrono::steady_clock::now() );
+  for ( unsigned long int i ( 0 ); i < reps; ++i )
+    {
+      sink += fn();
+      /* Keep the compiler from hoisting pure calls out of the loop. */
+      __asm__ __volatile__ ( "" ::: "memory" );
+    }
+  auto end ( std::chrono::steady_clock::now() );
+  double ns ( std::chrono::duration<double, std::nano>(end - start).count() / static_cast<double>(reps) );
+
+  printf("%-16s %-7s %9zu B %12.1f ns/op %8.2f GB/s  (%zu)\n",
+	 label, isa, bytes, ns, static_cast<double>(bytes) / ns, sink);
+}
+
+int
+main(int argc, char** argv)
+{
+  size_t big ( argc > 1 ? strtoul(argv[1], NULL, 10) : 8UL << 20 );
+  std::vector<char> text ( big < 4096 ? 4096 : big );
+  fill_text(text);
+
+  check_kernels(text);
+  check_string();
+
+  /* Sizes from a short identifier up to the full (multi-megabyte)
+     buffer; the searched-for values are absent, so every byte is
+     examined. */
+  const size_t sizes[] = { 16, 64, 1024, 64 * 1024, text.size() };
+
+  for ( size_t size : sizes )
+    {
+      unsigned long int reps ( 1 + ( 256UL << 20 ) / ( size * 16 ) );
+      const char* s ( text.data() );
+
+      for ( size_t k ( 0 ); k < N_ELEMENTS(isas); ++k )
+	{
+	  if ( ! spt::string_search_set_isa(isas[k]) )
+	    continue;
+	  bench("find_byte", isa_names[k], size, reps,
+		[=]() { return static_cast<size_t>(spt::find_byte(s, size, '!') != NULL); });
+	  bench("rfind_byte", isa_names[k], size, reps,
+		[=]() { return static_cast<size_t>(spt::rfind_byte(s, size, '!') != NULL); });
+	  bench("count_byte", isa_names[k], size, reps,
+		[=]() { return spt::count_byte(s, size, 'e'); });
+	  bench("find_first_of", isa_names[k], size, reps,
+		[=]() { return static_cast<size_t>(spt::find_first_of(s, size, "!?#", 3) != NULL); });
+	  bench("find_substring", isa_names[k], size, reps,
+		[=]() { return static_cast<size_t>(spt::find_substring(s, size, "qqqxqq", 6) != NULL); });
+	}
+      bench("hash_bytes", "-", size, reps,
+	    [=]() { return static_cast<size_t>(spt::hash_bytes(s, size)); });
+      bench("hash_bytes", "std", size, reps,
+	    [=]() { return std::_Hash_impl::hash(s, size); });
+      bench("find_byte", "memchr", size, reps,
+	    [=]() { return static_cast<size_t>(memchr(s, '!', size) != NULL); });
+      bench("find_substring", "memmem", size, reps,
+	    [=]() { return static_cast<size_t>(memmem(s, size, "qqqxqq", 6) != NULL); });
+      putchar('\n');
+    }
+
+  return 0;
+}